@@ -2,6 +2,9 @@
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
 #include "hardware/timer.h"
+#include "hardware/sync.h"
+#include "debounce.h"
+#include "tone.h"
 
 // GPIOピンの定義
 #define BUTTON_PIN 3  // ボタンが接続されているGPIOピン番号
@@ -10,62 +13,21 @@
 // タイマー割り込みの周期 (ms)
 #define TIMER_INTERVAL_MS 10
 
-// ボタンの状態を格納するグローバル変数（volatileキーワードで最適化を防ぐ）
-volatile bool button_pressed = false;
+// エッジ割り込みでボタンを読むときに、確定してからチャタリングを無視する時間 (us)
+#define BUTTON_LOCKOUT_US 20000
 
-// BUZZERのデューティサイクルの定義
-#define BUZZER_ON 0.7 // ブザーONのデューティサイクル（30%）
-#define BUZZER_OFF 0  // ブザーOFFのデューティサイクル（0%）
+// チャタリング除去 (押されている状態がこの回数続いたら確定する)
+#define DEBOUNCE_SAMPLES 3
 
-// ラの音（A3）を再生する関数
-// 引数: slice_num - PWMスライス番号(PWM機能を構成する独立した信号生成ユニット)
-void play_note_a(uint slice_num)
-{
-    int freq = 220; // ラの音（A3）の周波数（220Hz）
 
-    // pwm_set_clkdiv()はPWMのクロック分周比を設定する関数
-    // 125.0fはPWMのクロック分周比（125MHz / 125 = 1MHz）を指定している
-    // つまり、PWMのクロックは1MHzになり
-    // 例えば、1MHzのクロックで、周期を1000に設定すると、1kHzの音が鳴る
-    pwm_set_clkdiv(slice_num, 125.0f);
+// ボタンのチャタリング除去の状態（タイマー割り込みで更新される）
+debounce_t buttons;
 
-    // PWMの周期を設定
-    // pwm_set_wrap()はPWMの周期を設定する関数
-    pwm_set_wrap(slice_num, 125000 / freq);
+// BUZZERのデューティサイクルの定義
+#define BUZZER_VOLUME (TONE_VOLUME_MAX * 7 / 10) // ブザーONのデューティサイクル（70%）
 
-    // pwm_set_chan_level()はPWMのデューティサイクルを設定する関数
-    // 125000 / freqはPWMの周期に対するデューティサイクルの比率を計算している
-    // 例えば、周波数が220Hzの場合、125000 / 220 = 568.18...となる
-    // これをデューティサイクルの比率として使用することで、音の大きさを調整できる
-    // 0.3はデューティサイクルの比率（30%）を指定している
-    pwm_set_chan_level(slice_num, PWM_CHAN_A, (125000 / freq) * BUZZER_ON);
-}
-
-static int count = 0;
-// タイマー割り込み関数
-bool timer_callback(struct repeating_timer *rt)
-{
-    // ボタンの状態を読み取る（プルアップなので、押されていないときはHIGH、押されているときはLOW）
-    if (gpio_get(BUTTON_PIN) == 0){
-        if(count < 3){
-            count++;
-        }
-
-        if(count >=3){
-            button_pressed = true;
-        }else{
-            button_pressed = false;
-        }
-        // ボタンが押されたときの処理
-    }
-    else
-    {
-        // ボタンが離されたときの処理
-        button_pressed = false;
-        count = 0;
-    }
-    return true; // 継続してタイマーを動作させる
-}
+// ブザーの状態 (鳴らしている音と、PWMに設定してある値)
+tone_t buzzer;
 
 int main()
 {
@@ -74,51 +36,46 @@ int main()
     stdio_init_all();
 
     // ボタン用GPIOの初期化
-    // gpio_init()はGPIOの初期化を行う関数
-    // gpio_set_dir()はGPIOの入出力方向を設定する関数
-    // gpio_pull_up()はGPIOのプルアップ抵抗を有効にする関数
+    // debounce_init_buttons()はボタンのピンをまとめて入力にし、プルアップ抵抗を有効にする関数
     // プルアップ抵抗とは、ボタンが押されていないときにGPIOピンをHIGHに保つための抵抗
-    gpio_init(BUTTON_PIN);
-    gpio_set_dir(BUTTON_PIN, GPIO_IN);
-    gpio_pull_up(BUTTON_PIN);
+    // 押されているとき (LOW) がDEBOUNCE_SAMPLES回続いたら押された、HIGHが続いたら離されたと確定する
+    debounce_init_buttons(&buttons, 1u << BUTTON_PIN, DEBOUNCE_SAMPLES);
 
     // ブザー用GPIOの初期化
-    // gpio_set_function()はGPIOの機能を設定する関数
-    // pwm_gpio_to_slice_num()はGPIOピン番号からPWMスライス番号を取得する関数
-    // PWMスライス番号はPWM機能を構成する独立した信号生成ユニット
-    // 例えば、GPIO12はPWM0のスライス番号0に対応している
-    gpio_set_function(BUZZER_PIN, GPIO_FUNC_PWM);
-    uint slice_num = pwm_gpio_to_slice_num(BUZZER_PIN);
-
-    // PWMの設定
-    // pwm_get_default_config()はPWMのデフォルト設定を取得する関数
-    // pwm_init()はPWMを初期化する関数
-    // pwm_set_chan_level()はPWMのデューティサイクルを設定する関数
-    pwm_config config = pwm_get_default_config();
-    pwm_init(slice_num, &config, true);
-    pwm_set_chan_level(slice_num, PWM_CHAN_A, BUZZER_OFF); // 最初は音を鳴らさない
-
-    // タイマーの設定
+    // tone_init()はブザーのピンをPWMに設定し、最初は音を鳴らさない状態にする関数
+    // 以降はtone_start_note()/tone_stop()で鳴らしたり止めたりする (値が変わったときだけPWMのレジスタを書き換える)
+    // 平均律の音の分周比と周期は、いまのシステムクロックからtone_init()が表にしておく
+    tone_init(&buzzer, BUZZER_PIN, false);
+
+#ifdef BUTTON_EDGE_DEBOUNCE
+    // ボタンの最初のエッジの割り込みで、すぐに押された (離された) と確定する
+    // その後BUTTON_LOCKOUT_USの間はハードウェアアラームが鳴るまでそのピンの割り込みを止めて、チャタリングを読み飛ばす
+    debounce_start_edge(&buttons, BUTTON_LOCKOUT_US);
+#else
+    // タイマーの設定 (TIMER_INTERVAL_MSごとにボタンを読む)
     struct repeating_timer timer; // タイマー構造体を宣言
     // 繰り返しタイマーを設定する関数
     // - 第1引数: 繰り返し間隔 (マイクロ秒)。負の値は、最初の実行も遅延させる
     // - 第2引数: コールバック関数 (タイマー割り込み時に実行される関数)
-    // - 第3引数: コールバック関数に渡すユーザーデータ (ここではNULL)
+    // - 第3引数: コールバック関数に渡すユーザーデータ (ここではボタンのチャタリング除去の状態)
     // - 第4引数: 設定するタイマー構造体へのポインタ
-    add_repeating_timer_ms(TIMER_INTERVAL_MS, timer_callback, NULL, &timer);
+    add_repeating_timer_ms(TIMER_INTERVAL_MS, debounce_timer_callback, &buttons, &timer);
+#endif
 
     // メインループ
+    // ボタンの状態が変わったときだけ音を鳴らす/止めて、次に変わるまでは眠る
     while (true)
     {
         // ボタンが押されていたら音を鳴らす
-        if (button_pressed)
+        if (debounce_is_down(&buttons, BUTTON_PIN))
         {
-            play_note_a(slice_num);
+            tone_start_note(&buzzer, TONE_NOTE_A3, BUZZER_VOLUME); // ラの音（A3）を鳴らす
         }
         else
         {
-            pwm_set_chan_level(slice_num, PWM_CHAN_A, BUZZER_OFF); // ブザーをOFF
+            tone_stop(&buzzer); // ブザーをOFF
         }
+        __wfe(); // ボタンの状態が変わる (__sev()が出る) まで眠る
     }
 
     return 0;
@@ -1,355 +1,3277 @@
 #include <stdio.h>        // 標準入出力関数 (printf など) を使うためにインクルード
 #include <stdlib.h>       // 標準ライブラリ関数 (rand() など) を使うためにインクルード
+#include <string.h>       // メモリ操作関数 (memset など) を使うためにインクルード
 #include "pico/stdlib.h"  // Pico SDK の標準関数を使うためにインクルード
 #include "hardware/i2c.h" // I2C (Inter-Integrated Circuit) 通信に関連する関数を使うためにインクルード
-#include "font8x8.h"      // 8x8 ドットフォントのデータを使うためにインクルード
+#include "hardware/dma.h" // DMA (ダイレクトメモリアクセス) を使うためにインクルード
+#include "hardware/irq.h" // 割り込みハンドラの登録に使うためにインクルード
+#include "hardware/sync.h" // コア間で共有する変数のメモリバリア (__dmb) を使うためにインクルード
+#ifdef LCD_DUAL_CORE
+#include "pico/multicore.h" // コア 1 で描画を動かすためにインクルード
+#endif
+#ifdef LCD_HOST_SIM
+#include "ssd1327_sim.h" // ホスト上で SSD1327 を模擬するシミュレータ (host/ssd1327_sim.c)
+#endif
+#include "glyphs_scaled.h" // font8x8.h からビルド時に生成した文字の索引と字形のテーブル (tools/gen_glyphs.py)
+#include "images.h"        // PGM / PNG からビルド時に生成した圧縮画像 (tools/pack_images.py)
 
 /* 定義 (マクロ) */
 #define I2C_SDA_PIN 6                                          // I2C の SDA (シリアルデータ) ピン：GPIO 6番を使用することを定義
 #define I2C_SCL_PIN 7                                          // I2C の SCL (シリアルクロック) ピン：GPIO 7番を使用することを定義
-#define I2C_SPEED 1000000                                      // I2C の通信速度を 1000000 Hz (1 MHz) に定義
+#define I2C0_SDA_PIN 4                                         // 2 つ目の I2C (i2c0) の SDA ピン：GPIO 4番
+#define I2C0_SCL_PIN 5                                         // 2 つ目の I2C (i2c0) の SCL ピン：GPIO 5番
+#define I2C_SPEED 1000000                                      // I2C の通信速度の上限を 1000000 Hz (1 MHz) に定義 (起動時にこの速度から順に試す)
 #define SSD1327_ADDR 0x3D                                      // SSD1327 OLED ディスプレイの I2C アドレスを 0x3D に定義
+#define SSD1327_ADDR_ALT 0x3C                                  // 同じバスに 2 枚目をつなぐときのアドレス (SA0 ピンを GND にしたパネル)
+#ifndef LCD_PANEL_COUNT
+#define LCD_PANEL_COUNT 1                                      // つないだパネルの枚数 (1〜4。つなぎ方は ssd1327_configs を参照)
+#endif
+#if LCD_PANEL_COUNT < 1 || LCD_PANEL_COUNT > 4
+#error "LCD_PANEL_COUNT は 1〜4 (I2C 2 つ × アドレス 2 つ)"
+#endif
+#define SSD1327_BUS_COUNT 2                                    // I2C コントローラの数 (i2c0 と i2c1。別のバスのパネルには同時に送れる)
 #define DISPLAY_WIDTH 128                                      // OLED ディスプレイの幅を 128 ピクセルに定義
 #define DISPLAY_HEIGHT 128                                     // OLED ディスプレイの高さを 128 ピクセルに定義
 #define DISPLAY_DATA_SIZE (DISPLAY_WIDTH * DISPLAY_HEIGHT / 2) // ディスプレイに必要なデータ量を計算して定義。SSD1327 は 1 ピクセルあたり 4 ビットなので、バイト数は総ピクセル数の半分
 #define font_HEART \x03                                        // ハートのフォントデータを定義。8x8 ドットフォントの一部として使用
+#ifdef LCD_DUAL_CORE
+#define FRAME_BUFFER_COUNT 3                                   // デュアルコア時は、描画中・送信待ち・送信中の 3 面を使い回す
+#else
+#define FRAME_BUFFER_COUNT 2                                   // フレームバッファの数 (2: 描画用と送信用のダブルバッファ, 1: RAM を節約し送信完了を待ってから描画する)
+#endif
+#define FRAME_QUEUE_SIZE 16                                    // コア間でフレームを受け渡すキューの大きさ (2 のべき乗で LCD_PANEL_COUNT × FRAME_BUFFER_COUNT 以上)
+#define FRAME_QUEUE_IMAGE 0x0F                                 // 面を使わないフレーム (圧縮画像の場面) をコア間で受け渡すときの面の番号
+#define FLUSH_CHUNK_SIZE 256                                   // DMA 1 回あたりに I2C へ送る語数 (ステージングバッファ 1 面の大きさ)
+#define DIRTY_RECT_MAX 4                                       // 1 面あたりに記録する変更領域 (矩形) の最大数。超えた分は近い矩形と結合する
+#define FLUSH_SEGMENT_MAX (DIRTY_RECT_MAX + 2)                 // 1 回の非同期転送に含められる I2C トランザクションの最大数 (ウィンドウ設定付きの表示データと、その前後のスクロールのコマンド)
+#define COMMAND_BATCH_MAX 48                                   // 1 回のトランザクションにまとめられるコマンドバイト数の上限
+#define WINDOW_COMMAND_SIZE 6                                  // ウィンドウ設定のコマンドバイト数 (0x15, 開始, 終了, 0x75, 開始, 終了)
+#define SSD1327_RETRY_MAX 4                                    // 1 回の転送で送り直す回数の上限 (超えたらその転送をあきらめる)
+#define SSD1327_PROBE_TRANSFERS 8                              // 起動時に各速度で試すトランザクションの数
+#define SSD1327_PROBE_BYTES 64                                 // 試すトランザクション 1 つあたりの NOP コマンド (0xE3) の数
+#define SSD1327_ERROR_WEIGHT 8                                 // エラー 1 回で増やすエラースコア (エラーのない転送 1 回で 1 減る)
+#define SSD1327_STEP_DOWN_SCORE 16                             // エラースコアがこの値に達したら通信速度を 1 段下げる (間を置かずに 2 回のエラー)
+#define SSD1327_STEP_UP_TRANSFERS 1000                         // エラーのない転送がこの回数続いたら、起動時に確かめた速度に向けて 1 段戻す
+#define SSD1327_STALL_FACTOR 4                                 // ステージングバッファ 1 面を送る時間のこの倍だけ進まなければ、バスが固まったとみなす
+#define SSD1327_GRAY_LEVELS 15                                 // グレースケール表 (0xB8) の段数 (GS1〜GS15。GS0 は常に消灯)
+#ifdef LCD_FRAME_CACHE
+#define FRAME_CACHE_ENTRIES 16                                 // 覚えておく場面の切り替わり (フレーム間の差分) の数
+#define FRAME_CACHE_POOL_SIZE 32768                            // 差分の表示データを置く領域のバイト数 (いっぱいになったらキャッシュを空にして覚え直す)
+#endif
+
+/* 型定義 */
+struct ssd1327;
+typedef void (*ssd1327_flush_callback_t)(struct ssd1327 *display, const uint8_t *data); // 非同期転送の完了時に呼ばれるコールバック関数の型 (送信し終えたパネルとバッファが渡される)
+
+// フレームバッファ。I2C の制御バイト (0x40) を表示データの直前に置き、コピーせずにそのまま送れるようにする
+// 表示データはワード単位の書き込みができるよう 4 バイト境界に揃える
+typedef struct
+{
+    uint8_t reserved[3];               // pixels を 4 バイト境界に揃えるための詰め物 (送信しない)
+    uint8_t control;                   // 制御バイト (0x40: 以降はデータ)
+    uint8_t pixels[DISPLAY_DATA_SIZE]; // 表示データ (1 バイトに横 2 ピクセル)
+} __attribute__((aligned(4))) ssd1327_framebuffer_t;
+
+// 画面上の矩形領域 (両端を含む)。X 方向は 2 ピクセル (1 バイト) 単位に揃えて扱う
+typedef struct
+{
+    int16_t x0, y0; // 左上の座標
+    int16_t x1, y1; // 右下の座標
+} rect_t;
+
+// 矩形のリスト (変更領域の記録に使う)
+typedef struct
+{
+    rect_t rects[DIRTY_RECT_MAX];
+    int count;
+} rect_list_t;
+
+// まとめて 1 回の I2C トランザクションで送るコマンド列
+// 先頭に制御バイト (0x00: 以降はすべてコマンド) を置き、コピーせずにそのまま送れるようにする
+typedef struct
+{
+    struct ssd1327 *display;              // 送り先のパネル (いっぱいになったときに途中まで送る先)
+    uint8_t bytes[1 + COMMAND_BATCH_MAX]; // 制御バイト + コマンドバイト
+    int length;                           // bytes に詰めたバイト数 (制御バイトを含む)
+} ssd1327_batch_t;
+
+// 圧縮画像 (images.h) の伸長器。圧縮データを先頭から 1 バイトずつ展開する (展開に使う RAM は直前の 1 行分だけ)
+typedef struct
+{
+    const uint8_t *start;               // 圧縮データの先頭 (送り直すときはここから展開し直す)
+    const uint8_t *src;                 // 次に読む圧縮データ (フラッシュ上)
+    uint8_t op;                         // 実行中の命令 (0b00: そのまま, 0b01: 繰り返し, 0b1: 1 行上を写す)
+    uint8_t remaining;                  // 実行中の命令で残っているバイト数
+    uint8_t column;                     // 展開中の行内の位置
+    uint8_t row_bytes;                  // ウィンドウ 1 行のバイト数
+    uint8_t above[DISPLAY_WIDTH / 2];   // 直前に展開した行 (最初の行の上は 0)
+} image_decoder_t;
+
+// 非同期転送で送る I2C トランザクション 1 つ分。prefix (制御バイトとコマンド) の後に、stride 間隔で並ぶ rows 行 × row_bytes バイトを送る
+typedef struct
+{
+    const uint8_t *prefix; // 先頭に送るバイト列 (継続制御バイト付きのコマンドと、最後の制御バイト 0x40)
+    uint8_t prefix_length; // prefix のバイト数
+    const uint8_t *data;   // 送るデータの先頭
+    uint16_t row_bytes;  // 1 行あたりのバイト数
+    uint16_t rows;       // 行数
+    uint16_t stride;     // ある行の先頭から次の行の先頭までのバイト数
+    image_decoder_t *decoder; // NULL でなければ data の代わりに、この伸長器で展開したバイトを送る
+    rect_t window;       // 表示データを送る矩形 (途中の行から送り直すときのウィンドウ設定に使う。コマンドだけなら使わない)
+} flush_segment_t;
+
+// パネルの表示設定 (スクロールと明るさ)。面ごとに持ち、その面のフレームを送るときにパネルへ反映する
+typedef struct
+{
+    uint8_t start_line;       // 表示開始ライン (0xA1)：画面の一番上に表示する RAM の行
+    bool hscroll;             // 水平スクロール (0x26/0x27) を動かすか
+    uint8_t hscroll_command;  // 0x26: 右へ流す, 0x27: 左へ流す
+    uint8_t hscroll_row0;     // 水平スクロールする RAM の最初の行
+    uint8_t hscroll_row1;     // 水平スクロールする RAM の最後の行
+    uint8_t hscroll_interval; // 1 コラム (2 ピクセル) 動かす間隔 (0: 2 フレーム, 1: 3, 2: 4, 3: 5, 4: 6, 5: 32, 6: 64, 7: 256 フレーム)
+    uint8_t contrast;         // コントラスト (0x81)：画面全体の明るさ
+    const uint8_t *gray_table; // グレースケール表 (0xB8 で送る GS1〜GS15 の 15 バイト。NULL なら 0xB9 の線形の表)
+} panel_state_t;
+
+// 直前のフラッシュで送ったデータ量の統計
+typedef struct
+{
+    uint32_t bytes_sent;    // 表示データとして送ったバイト数
+    uint32_t bytes_skipped; // 変更がないため送らずに済んだバイト数
+    uint32_t windows;       // 送ったウィンドウ (矩形) の数
+} flush_stats_t;
+
+// パネル 1 枚のつなぎ方
+typedef struct
+{
+    i2c_inst_t *i2c; // つないだ I2C コントローラ
+    uint8_t sda_pin; // SDA ピン
+    uint8_t scl_pin; // SCL ピン
+    uint8_t address; // I2C アドレス
+} ssd1327_config_t;
+
+// 非同期転送をステージングバッファにどこまで詰めたか
+typedef struct
+{
+    int segment_index;   // ステージング中のトランザクションの番号
+    int row;             // ステージング中のトランザクション内の行
+    int column;          // ステージング中の行内のバイト位置
+    int prefix_position; // ステージング中のトランザクションの prefix をどこまで詰めたか
+    bool resuming;       // 途中の行から送り直していて、prefix の代わりに resume_prefix を送る
+} flush_cursor_t;
+
+// バスの転送の統計 (エラーと送り直し、実効スループット)
+typedef struct
+{
+    uint32_t speed_hz;      // 現在の通信速度
+    uint32_t transfers;     // 送り終えた転送 (非同期転送とブロッキング送信) の数
+    uint32_t errors;        // NAK による中断と、バスの固まりを検出した回数
+    uint32_t retries;       // 送り直した回数 (非同期転送は中断したステージングバッファから、ブロッキング送信はトランザクションごと)
+    uint32_t bus_clears;    // SCL を手で動かしてバスを解放した回数
+    uint32_t speed_changes; // 動作中に通信速度を変えた回数
+    uint32_t failures;      // 送り直しても送れずにあきらめた転送の数
+    uint64_t bytes;         // 送れたバイト数 (送り直した分は数えない)
+    uint64_t busy_us;       // 転送にかかった時間の合計 (送り直しを含む)。bytes をこれで割ったものが実効スループット
+} ssd1327_bus_stats_t;
+
+// I2C コントローラ 1 つ分の非同期転送の状態。DMA チャネルとステージングバッファはバスごとに持ち、
+// 同じバスにつないだパネルは順番に使う (送信中に別のパネルの転送を始めると、終わるまで待ち行列に入る)
+// I2C の data_cmd レジスタは 8 ビット書き込みでも 32 ビット全体に複製されて書き込まれるため
+// (上位のコマンドビットが化ける)、DMA は 16 ビット単位で書き込む。
+// フレームバッファを 16 ビットに広げたステージングバッファを 2 面用意し、片方を送信中にもう片方を詰める。
+// NAK で転送が中断したら、まだ届いたと言い切れないステージングバッファの先頭の行から送り直す
+typedef struct
+{
+    i2c_inst_t *i2c;                             // I2C コントローラ (NULL ならまだ初期化していない)
+    uint8_t sda_pin;                             // SDA ピン (バスを解放するときに手で動かす)
+    uint8_t scl_pin;                             // SCL ピン
+    int dma_channel;                             // 転送に使う DMA チャネル番号
+    uint16_t chunk[2][FLUSH_CHUNK_SIZE];         // data_cmd レジスタに書き込む語のステージングバッファ (ピンポン)
+    int chunk_len[2];                            // 各ステージングバッファに詰めた語数 (0 なら空)
+    int active_chunk;                            // DMA が送信中のステージングバッファの番号
+    flush_cursor_t cursor;                       // 次にステージングバッファに詰める位置
+    flush_cursor_t chunk_from[2];                // 各ステージングバッファの先頭の位置
+    flush_cursor_t resume;                       // 転送が中断したときに送り直す位置 (I2C の FIFO にまだ残っているかもしれない最初の位置)
+    uint8_t resume_prefix[WINDOW_COMMAND_SIZE * 2 + 1]; // 途中の行から送り直すときのウィンドウ設定 (継続制御バイト付き)
+    int resume_prefix_length;                    // resume_prefix のバイト数
+    struct ssd1327 *volatile active;             // 送信中のパネル (NULL ならバスは空いている)
+    struct ssd1327 *waiting[LCD_PANEL_COUNT];    // 送信の順番を待っているパネル (先に来た順)
+    int waiting_count;                           // waiting に入っている数
+
+    int speed_level;                             // いまの通信速度 (ssd1327_speeds の番号。大きいほど遅い)
+    int best_level;                              // 起動時に確かめた、安定して送れる最も速い通信速度
+    int error_score;                             // 最近のエラーの多さ (エラーで増え、エラーのない転送で減る)
+    int clean_transfers;                         // エラーなしで続けて送れた転送の数
+    int attempt;                                 // 送信中の転送を送り直した回数
+    uint32_t transfer_bytes;                     // 送信中の転送のバイト数
+    uint64_t start_us;                           // 送信中の転送を始めた時刻
+    volatile uint32_t progress_us;               // 送信中の転送が最後に進んだ時刻 (バスが固まったかの判定に使う)
+    ssd1327_bus_stats_t stats;                   // 転送の統計
+} ssd1327_bus_t;
+
+// パネル 1 枚分の状態 (ディスプレイのハンドル)。ssd1327_* の関数はすべてこのハンドルに対して動く
+// フレームは描き終えた順 (frame_buffer_submit した順) にパネルへ送る。各面は描き始めるときに直前のフレームと同じ内容にそろえる
+// dirty : 直前のフレームとその面の内容が異なるかもしれない領域。送信するとこの領域だけが送られる
+// content : その面で 0 以外のピクセルが描かれているかもしれない領域。クリアしたときにこの領域が dirty になる
+// stale : 最後に描き終えたフレームとその面の内容が異なるかもしれない領域。描き始めるときにこの領域をコピーしてそろえる
+typedef struct ssd1327
+{
+    ssd1327_bus_t *bus;                                    // つないだバス
+    uint8_t address;                                       // I2C アドレス
+    uint8_t number;                                        // 何枚目のパネルか (0 から)
+
+    ssd1327_framebuffer_t frame_buffers[FRAME_BUFFER_COUNT]; // 表示データを格納するフレームバッファ (送信中の面とは別の面に次のフレームを描画する)
+    uint8_t *buffer;                                       // 現在の描画先 (バックバッファ) の表示データを指すポインタ
+    int back_buffer_index;                                 // バックバッファとして使っている面の番号
+    rect_list_t dirty_rects[FRAME_BUFFER_COUNT];
+    rect_list_t content_rects[FRAME_BUFFER_COUNT];
+    rect_list_t stale_rects[FRAME_BUFFER_COUNT];
+    volatile int latest_frame;                             // 最後に描き終えた面の番号 (まだなければ -1)
+    bool panel_in_sync;                                    // パネルの内容が「次に送るフレームの直前のフレーム」と一致しているか (起動直後は内容が不明)
+    const image_t *image_shown;                            // パネルに出している圧縮画像 (NULL なら画像ではないか、内容が不明)
+    int image_frame_shown;                                 // そのうち最後に送ったフレームの番号
+    panel_state_t frame_panel[FRAME_BUFFER_COUNT];         // 各面のフレームを表示するときの設定 (描き始めるときに直前のフレームから引き継ぐ)
+    panel_state_t panel_state;                             // パネルに設定済みの状態
+    flush_stats_t flush_stats;                             // 直前のフラッシュの統計 (送ったバイト数と省略したバイト数)
+
+    // 次に送る (または送信中の) 非同期転送の内容
+    flush_segment_t flush_segments[FLUSH_SEGMENT_MAX];                         // 送信する I2C トランザクションの並び
+    uint8_t flush_window_prefix[FLUSH_SEGMENT_MAX][WINDOW_COMMAND_SIZE * 2 + 1]; // 各トランザクションの先頭に送るウィンドウ設定 (継続制御バイト付き)
+    int flush_segment_count;                                                  // 送信するトランザクションの数
+    ssd1327_batch_t flush_panel_batch[2];                                     // 表示データの前 [0] と後 [1] に送る表示設定のコマンド
+    image_decoder_t flush_image_decoder;                                      // 送信中の圧縮画像の伸長器 (DMA 割り込みの中でステージングバッファに展開する)
+    const uint8_t *flush_data;                                                // 送信中のフレームバッファ (コールバックに渡す)
+    ssd1327_flush_callback_t flush_callback;                                  // 転送完了時に呼ぶコールバック (NULL なら呼ばない)
+    volatile bool flush_in_progress;                                          // 非同期転送中 (または順番待ち) かどうか (割り込みハンドラで false に戻る)
+    volatile bool flush_failed;                                               // 送り直しても送れずにあきらめた転送があった (次のフレームは全体を送る)
+} ssd1327_t;
 
 /* グローバル変数 */
-i2c_inst_t *i2c = i2c1;
-// 使用する I2C インスタンスとして i2c1 を指定
-uint8_t buffer[DISPLAY_DATA_SIZE]; // ディスプレイに表示するデータを一時的に格納するバッファ (配列)
+// パネルのつなぎ方 (先頭から LCD_PANEL_COUNT 枚を使う)。2 つのバスに分けたパネルには同時に送れる。
+// 同じバスの 2 枚は SA0 ピンでアドレスを分け、バスを交代で使う
+static const ssd1327_config_t ssd1327_configs[] = {
+    {i2c1, I2C_SDA_PIN, I2C_SCL_PIN, SSD1327_ADDR},       // 1 枚目
+    {i2c0, I2C0_SDA_PIN, I2C0_SCL_PIN, SSD1327_ADDR},     // 2 枚目 (1 枚目と同時に送れる)
+    {i2c1, I2C_SDA_PIN, I2C_SCL_PIN, SSD1327_ADDR_ALT},   // 3 枚目 (1 枚目とバスを交代で使う)
+    {i2c0, I2C0_SDA_PIN, I2C0_SCL_PIN, SSD1327_ADDR_ALT}, // 4 枚目 (2 枚目とバスを交代で使う)
+};
+static ssd1327_bus_t ssd1327_buses[SSD1327_BUS_COUNT]; // 各 I2C コントローラの転送の状態 (i2c_get_index の順)
+// 使う通信速度 (速い順)。起動時に上から試して安定して送れる最も速い速度を選び、動作中はエラーの数に応じて上下させる
+static const uint32_t ssd1327_speeds[] = {I2C_SPEED, 800000, 600000, 400000, 200000, 100000};
+ssd1327_t displays[LCD_PANEL_COUNT];                   // つないだパネル
+
+/* パネルの表示設定 */
+#define PANEL_DEFAULT {.contrast = 0x80} // 初期化シーケンスで設定する状態 (開始ライン 0、水平スクロールなし、コントラスト 0x80、線形のグレースケール表)
+static const panel_state_t panel_default = PANEL_DEFAULT; // フレームバッファ以外のバッファを送るときに使う設定
 
 /* プロトタイプ宣言 (関数の事前定義) */
-static void i2c_init_pico();
-static void ssd1327_send_command(uint8_t command);
-static void ssd1327_send_data(uint8_t data);
-static void ssd1327_set_window(uint16_t X_start, uint16_t Y_start, uint16_t X_end, uint16_t Y_end);
-static void ssd1327_init();
-static void ssd1327_set_display(uint8_t *data);
+static void i2c_init_pico(const ssd1327_config_t *config);
+static bool ssd1327_init(ssd1327_t *display, const ssd1327_config_t *config);
+static bool ssd1327_write(ssd1327_t *display, const uint8_t *src, size_t len);
+static void ssd1327_bus_poll(ssd1327_bus_t *bus);
+static void ssd1327_batch_begin(ssd1327_t *display, ssd1327_batch_t *batch);
+static void ssd1327_batch_add(ssd1327_batch_t *batch, uint8_t command);
+static void ssd1327_batch_add_table(ssd1327_batch_t *batch, const uint8_t *commands, size_t count);
+static void ssd1327_batch_add_window(ssd1327_batch_t *batch, int X_start, int Y_start, int X_end, int Y_end);
+static void ssd1327_batch_send(ssd1327_batch_t *batch);
+static int ssd1327_batch_encode_with_data(const ssd1327_batch_t *batch, uint8_t *out);
+static void ssd1327_flush_init(ssd1327_bus_t *bus);
+static void ssd1327_set_display_async(ssd1327_t *display, const uint8_t *data, ssd1327_flush_callback_t callback);
+static bool ssd1327_is_flush_in_progress(ssd1327_t *display);
+static void ssd1327_wait_flush(ssd1327_t *display);
+static void ssd1327_wait_bus(ssd1327_bus_t *bus);
+static void ssd1327_flush_dirty_async(ssd1327_t *display, const uint8_t *data, ssd1327_flush_callback_t callback);
+static void ssd1327_show_image_async(ssd1327_t *display, const image_t *image, int frame, ssd1327_flush_callback_t callback);
+static void ssd1327_swap_buffers(ssd1327_t *display, ssd1327_flush_callback_t callback);
+static int frame_buffer_find(const uint8_t *data, ssd1327_t **display);
+static void frame_buffer_sent(ssd1327_t *display, const uint8_t *data, bool full_frame);
+static void frame_buffer_acquire(ssd1327_t *display, int index);
+static void frame_buffer_trim_dirty(ssd1327_t *display, int index);
+static void frame_buffer_submit(ssd1327_t *display, int index);
+static void rect_list_add(rect_list_t *list, int x0, int y0, int x1, int y1);
+static void mark_dirty(const uint8_t *buffer, int x0, int y0, int x1, int y1);
+static void clear_buffer(uint8_t *buffer);
+void image_draw(uint8_t *buffer, const image_t *image, int frame);
+static const panel_state_t *frame_panel_of(const uint8_t *data);
+static bool ssd1327_batch_add_scroll_stop(ssd1327_batch_t *batch, const panel_state_t *scroll, rect_t *band);
+static void ssd1327_batch_add_panel_state(ssd1327_batch_t *batch, const panel_state_t *state);
 
 /* 関数 */
 
-// I2C を初期化する関数
-static void i2c_init_pico()
+// パネルをつなぐ I2C を初期化する関数
+static void i2c_init_pico(const ssd1327_config_t *config)
+{
+    i2c_init(config->i2c, I2C_SPEED);
+    // 指定した I2C インスタンス (i2c0 / i2c1) と速度 (1MHz) で I2C を初期化
+    gpio_set_function(config->sda_pin, GPIO_FUNC_I2C); // SDA ピンを I2C の機能として使用するように設定
+    gpio_set_function(config->scl_pin, GPIO_FUNC_I2C); // SCL ピンを I2C の機能として使用するように設定
+    gpio_pull_up(config->sda_pin);                     // SDA ピンにプルアップ抵抗を有効化
+    gpio_pull_up(config->scl_pin);                     // SCL ピンにプルアップ抵抗を有効化
+}
+
+/* I2C の送信 (エラーの検出と回復) */
+// 送信の結果を確かめ、NAK なら送り直し、バスが固まっていれば SCL を手で動かして解放する。
+// 通信速度は起動時に速い順に試して決め、動作中はエラーが続けば 1 段下げ、しばらくエラーがなければ戻す
+
+// バスの通信速度を speed_level に合わせる関数 (バスが空いているときに呼ぶ)
+static void ssd1327_bus_apply_speed(ssd1327_bus_t *bus)
+{
+    uint32_t speed = ssd1327_speeds[bus->speed_level];
+    if (bus->stats.speed_hz != speed)
+    {
+        i2c_set_baudrate(bus->i2c, speed);
+        bus->stats.speed_hz = speed;
+    }
+}
+
+// 送信のエラーを記録する関数。間を置かずに続いたら通信速度を 1 段下げる (次に送り始めるときから遅くなる)
+static void ssd1327_bus_error(ssd1327_bus_t *bus)
+{
+    bus->stats.errors++;
+    bus->clean_transfers = 0;
+    bus->error_score += SSD1327_ERROR_WEIGHT;
+    if (bus->error_score >= SSD1327_STEP_DOWN_SCORE && bus->speed_level < (int)count_of(ssd1327_speeds) - 1)
+    {
+        bus->speed_level++;
+        bus->error_score = 0;
+        bus->stats.speed_changes++;
+    }
+}
+
+// エラーなしで送り終えたことを記録する関数。しばらく続いたら、起動時に確かめた速度に向けて通信速度を 1 段戻す
+static void ssd1327_bus_clean(ssd1327_bus_t *bus)
+{
+    if (bus->error_score > 0)
+    {
+        bus->error_score--;
+    }
+    if (++bus->clean_transfers >= SSD1327_STEP_UP_TRANSFERS && bus->speed_level > bus->best_level)
+    {
+        bus->speed_level--;
+        bus->clean_transfers = 0;
+        bus->stats.speed_changes++;
+    }
+}
+
+// len バイトのトランザクションがバス上でかかる時間の目安 (us) を返す関数 (アドレスを含めて 1 バイト 9 ビット)
+static uint32_t ssd1327_bus_time_us(const ssd1327_bus_t *bus, uint32_t len)
+{
+    return (uint64_t)(len + 1) * 9 * 1000000 / ssd1327_speeds[bus->speed_level];
+}
+
+// SDA を Low に保ったまま止まったスレーブからバスを解放する関数 (I2C バス仕様のバスクリア)
+// SCL を手で最大 9 回動かしてスレーブに残りのビットを送り切らせ、STOP 条件を出してから I2C を初期化し直す
+static void ssd1327_bus_clear(ssd1327_bus_t *bus)
+{
+    gpio_init(bus->sda_pin);   // SIO の入力にする (プルアップで High になる)
+    gpio_init(bus->scl_pin);
+    gpio_put(bus->sda_pin, 0); // 出力にしたときは Low を出す (出力と入力を切り替えてオープンドレインの代わりにする)
+    gpio_put(bus->scl_pin, 0);
+    for (int i = 0; i < 9 && !gpio_get(bus->sda_pin); i++)
+    {
+        gpio_set_dir(bus->scl_pin, GPIO_OUT); // SCL を Low に引く
+        busy_wait_us(5);
+        gpio_set_dir(bus->scl_pin, GPIO_IN);  // SCL を放して High に戻す
+        busy_wait_us(5);
+    }
+    gpio_set_dir(bus->sda_pin, GPIO_OUT); // SCL が High の間に SDA を Low から High に戻して STOP 条件を出す
+    busy_wait_us(5);
+    gpio_set_dir(bus->sda_pin, GPIO_IN);
+    busy_wait_us(5);
+
+    i2c_init(bus->i2c, ssd1327_speeds[bus->speed_level]); // I2C をリセットして初期化し直す
+    bus->stats.speed_hz = ssd1327_speeds[bus->speed_level];
+    gpio_set_function(bus->sda_pin, GPIO_FUNC_I2C);
+    gpio_set_function(bus->scl_pin, GPIO_FUNC_I2C);
+    i2c_get_hw(bus->i2c)->intr_mask = 0;
+    bus->stats.bus_clears++;
+}
+
+// src の len バイトを 1 回のトランザクションでパネルに送る関数 (ブロッキング。送れたら true)
+// NAK ならトランザクションごと送り直し、タイムアウトならバスが固まったとみなして解放してから送り直す
+static bool ssd1327_write(ssd1327_t *display, const uint8_t *src, size_t len)
+{
+    ssd1327_bus_t *bus = display->bus;
+    ssd1327_wait_bus(bus); // 非同期転送中はバスが空くまで待つ
+    for (int attempt = 0;; attempt++)
+    {
+        ssd1327_bus_apply_speed(bus);
+        uint64_t start_us = time_us_64();
+        int result = i2c_write_timeout_us(bus->i2c, display->address, src, len, false,
+                                          SSD1327_STALL_FACTOR * ssd1327_bus_time_us(bus, len) + 1000);
+        bus->stats.busy_us += time_us_64() - start_us;
+        if (result == (int)len)
+        {
+            bus->stats.transfers++;
+            bus->stats.bytes += len;
+            ssd1327_bus_clean(bus);
+            return true;
+        }
+        ssd1327_bus_error(bus);
+        if (result == PICO_ERROR_TIMEOUT)
+        {
+            ssd1327_bus_clear(bus);
+        }
+        if (attempt == SSD1327_RETRY_MAX)
+        {
+            bus->stats.failures++;
+            return false;
+        }
+        bus->stats.retries++;
+    }
+}
+
+// パネル display に NOP コマンド (0xE3) を並べたトランザクションを何度か送り、すべて届く最も速い通信速度をバスの上限にする関数
+// 同じバスの 2 枚目以降は 1 枚目で決めた速度から試すので、バスの速度は遅いほうのパネルに合う。
+// どの速度でも届かなければ (パネルがつながっていなければ) バスの速度は変えずに false を返す
+static bool ssd1327_probe_speed(ssd1327_t *display)
+{
+    ssd1327_bus_t *bus = display->bus;
+    uint8_t probe[1 + SSD1327_PROBE_BYTES];
+    probe[0] = 0x00;                              // 以降はすべてコマンド
+    memset(probe + 1, 0xe3, SSD1327_PROBE_BYTES); // NOP
+    for (int level = bus->best_level; level < (int)count_of(ssd1327_speeds); level++)
+    {
+        bus->speed_level = level;
+        ssd1327_bus_apply_speed(bus);
+        int sent = 0;
+        while (sent < SSD1327_PROBE_TRANSFERS)
+        {
+            int result = i2c_write_timeout_us(bus->i2c, display->address, probe, sizeof(probe), false,
+                                              SSD1327_STALL_FACTOR * ssd1327_bus_time_us(bus, sizeof(probe)) + 1000);
+            if (result != (int)sizeof(probe))
+            {
+                if (result == PICO_ERROR_TIMEOUT)
+                {
+                    ssd1327_bus_clear(bus);
+                }
+                break;
+            }
+            sent++;
+        }
+        if (sent == SSD1327_PROBE_TRANSFERS)
+        {
+            bus->best_level = level;
+            return true;
+        }
+    }
+    bus->speed_level = bus->best_level;
+    return false;
+}
+
+// パネル display に送るコマンドバッチを空にする関数
+static void ssd1327_batch_begin(ssd1327_t *display, ssd1327_batch_t *batch)
+{
+    batch->display = display;
+    batch->bytes[0] = 0x00; // 最初のバイトは「以降はすべてコマンド」を示す制御バイト (0x00)
+    batch->length = 1;
+}
+
+// コマンドバッチにコマンドバイトを 1 つ追加する関数 (いっぱいになったら、それまでの分を送ってから詰め直す)
+static void ssd1327_batch_add(ssd1327_batch_t *batch, uint8_t command)
+{
+    if (batch->length == (int)sizeof(batch->bytes))
+    {
+        ssd1327_batch_send(batch);
+    }
+    batch->bytes[batch->length++] = command;
+}
+
+// コマンドの表 (コマンドとその引数を並べた配列) をまとめてコマンドバッチに追加する関数
+static void ssd1327_batch_add_table(ssd1327_batch_t *batch, const uint8_t *commands, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        ssd1327_batch_add(batch, commands[i]);
+    }
+}
+
+// 描画範囲 (ウィンドウ) を設定するコマンドをコマンドバッチに追加する関数
+static void ssd1327_batch_add_window(ssd1327_batch_t *batch, int X_start, int Y_start, int X_end, int Y_end)
+{
+    ssd1327_batch_add(batch, 0x15);        // コラムアドレス設定コマンド
+    ssd1327_batch_add(batch, X_start / 2); // 開始 X 座標を 2 で割った値 (SSD1327 は 2 ピクセル単位でアドレスを指定する)
+    ssd1327_batch_add(batch, X_end / 2);   // 終了 X 座標を 2 で割った値
+    ssd1327_batch_add(batch, 0x75);        // ロウアドレス設定コマンド
+    ssd1327_batch_add(batch, Y_start);     // 開始 Y 座標
+    ssd1327_batch_add(batch, Y_end);       // 終了 Y 座標
+}
+
+// コマンドバッチの内容を 1 回の I2C トランザクションで送信し、バッチを空にする関数
+static void ssd1327_batch_send(ssd1327_batch_t *batch)
+{
+    ssd1327_t *display = batch->display;
+    if (batch->length > 1)
+    {
+        ssd1327_write(display, batch->bytes, batch->length); // 非同期転送中はバスが空くまで待つ
+    }
+    ssd1327_batch_begin(display, batch);
+}
+
+// コマンドバッチを、表示データを続けて送れる形 (継続制御バイト付き) に変換する関数。書き込んだバイト数を返す
+// 各コマンドの前に 0x80 (Co=1: 次の 1 バイトはコマンド、その後にまた制御バイトが来る) を置き、最後に 0x40 (以降はデータ) を置く
+// out には (コマンド数 × 2 + 1) バイトの領域が必要
+static int ssd1327_batch_encode_with_data(const ssd1327_batch_t *batch, uint8_t *out)
+{
+    int length = 0;
+    for (int i = 1; i < batch->length; i++)
+    {
+        out[length++] = 0x80;
+        out[length++] = batch->bytes[i];
+    }
+    out[length++] = 0x40;
+    return length;
+}
+
+// SSD1327 の初期化シーケンス (データシートに記載されている初期設定)。コマンドとその引数を順に並べた表
+static const uint8_t ssd1327_init_sequence[] = {
+    0xae,             // ディスプレイをオフにする (スリープモード ON)
+    0x15, 0x00, 0x7f, // コラムアドレス設定：開始コラム (0)、終了コラム (127)
+    0x75, 0x00, 0x7f, // ロウアドレス設定：開始ロウ (0)、終了ロウ (127)
+    0x81, 0x80,       // コントラスト設定 (0x80 は中間的な明るさ)
+    0xa0, 0x51,       // セグメントリマップ (0x51 で左右反転。必要に応じて変更)
+    0xa1, 0x00,       // スタートライン設定 (通常は 0)
+    0xa2, 0x00,       // 表示オフセット設定 (通常は 0)
+    0xa4,             // 全画面表示オフ (通常表示モード)
+    0xa8, 0x7f,       // マルチプレックス比設定 (0x7F で 128 ライン)
+    0xad, 0x02,       // マスターコンフィグレーション
+    0xb0, 0x0b,       // 電源制御
+    0xb1, 0xf1,       // 位相長設定
+    0xab, 0x01,       // 表示イネーブル (リセット)
+    0xbc, 0x3f,       // プリチャージ電流設定
+    0xbe, 0x0f,       // VCOMH レベル設定
+    0xd5, 0x62,       // 表示クロック制御の設定
+    0x87, 0x0f,       // コントラスト微調整
+    0xaf,             // ディスプレイをオンにする (スリープモード OFF)
+};
+
+// パネル display を config のつなぎ方で使えるようにする関数
+// そのバスを初めて使うときは I2C と非同期転送 (DMA と割り込み) を初期化する。
+// パネルが安定して受け取れる通信速度を確かめてから、初期化シーケンス全体を 1 回のトランザクションで送る。パネルが応答しなければ false を返す
+static bool ssd1327_init(ssd1327_t *display, const ssd1327_config_t *config)
+{
+    ssd1327_bus_t *bus = &ssd1327_buses[i2c_get_index(config->i2c)];
+    if (bus->i2c == NULL)
+    {
+        bus->i2c = config->i2c;
+        bus->sda_pin = config->sda_pin;
+        bus->scl_pin = config->scl_pin;
+        bus->stats.speed_hz = I2C_SPEED;
+        i2c_init_pico(config); // I2C 通信に必要な設定 (ピン、速度など) を行う
+        ssd1327_flush_init(bus); // DMA による非同期転送を使えるようにする
+    }
+
+    memset(display, 0, sizeof(*display));
+    display->bus = bus;
+    display->address = config->address;
+    display->number = display - displays;
+    for (int i = 0; i < FRAME_BUFFER_COUNT; i++)
+    {
+        display->frame_buffers[i].control = 0x40;
+        display->frame_panel[i] = panel_default;
+    }
+    display->buffer = display->frame_buffers[0].pixels;
+    display->latest_frame = -1;
+    display->panel_state = panel_default;
+
+    bool present = ssd1327_probe_speed(display); // 同じバスの先のパネルより遅ければ、バス全体をこのパネルに合わせる
+
+    ssd1327_batch_t batch;
+    ssd1327_batch_begin(display, &batch);
+    ssd1327_batch_add_table(&batch, ssd1327_init_sequence, sizeof(ssd1327_init_sequence));
+    ssd1327_batch_send(&batch);
+    return present;
+}
+
+// 圧縮画像の伸長器を、ウィンドウ 1 行が row_bytes バイトの圧縮データ src の先頭に合わせる関数
+static void image_decoder_begin(image_decoder_t *decoder, const uint8_t *src, int row_bytes)
+{
+    decoder->start = src;
+    decoder->src = src;
+    decoder->remaining = 0;
+    decoder->column = 0;
+    decoder->row_bytes = row_bytes;
+    memset(decoder->above, 0, row_bytes);
+}
+
+// 圧縮画像を 1 バイト展開して返す関数 (DMA 割り込みの中からも呼ばれるので、1 バイトあたり数命令で済ませる)
+static inline uint8_t image_decoder_next(image_decoder_t *decoder)
+{
+    if (decoder->remaining == 0)
+    {
+        decoder->op = *decoder->src++; // 次の命令を読む
+        decoder->remaining = (decoder->op & 0x80 ? decoder->op & 0x7f : decoder->op & 0x3f) + 1;
+    }
+    uint8_t value;
+    if (decoder->op & 0x80)
+    {
+        value = decoder->above[decoder->column]; // 1 行上の同じ位置を写す
+    }
+    else if (decoder->op & 0x40)
+    {
+        value = *decoder->src; // 同じ値を繰り返す (最後の 1 バイトで値を読み終える)
+        if (decoder->remaining == 1)
+        {
+            decoder->src++;
+        }
+    }
+    else
+    {
+        value = *decoder->src++; // そのまま
+    }
+    decoder->remaining--;
+    decoder->above[decoder->column] = value;
+    if (++decoder->column == decoder->row_bytes)
+    {
+        decoder->column = 0;
+    }
+    return value;
+}
+
+// 圧縮画像の伸長器を圧縮データの先頭に戻す関数 (中断したトランザクションを送り直すとき)
+static void image_decoder_rewind(image_decoder_t *decoder)
+{
+    image_decoder_begin(decoder, decoder->start, decoder->row_bytes);
+}
+
+// バスのステージングバッファ index に、送信中のパネルの次の送信データを 16 ビット語として詰める関数。詰めた語数を返す
+// トランザクションの最後のバイトには STOP ビットを付ける。FIFO に続きがあれば I2C は自動で次の START を発行する
+static int ssd1327_flush_fill(ssd1327_bus_t *bus, int index)
+{
+    const ssd1327_t *display = bus->active;
+    flush_cursor_t *cursor = &bus->cursor;
+    uint16_t *dst = bus->chunk[index];
+    int count = 0;
+
+    bus->chunk_from[index] = *cursor; // この面が中断したら、ここから送り直す
+    while (count < FLUSH_CHUNK_SIZE && cursor->segment_index < display->flush_segment_count)
+    {
+        const flush_segment_t *segment = &display->flush_segments[cursor->segment_index];
+        const uint8_t *prefix = cursor->resuming ? bus->resume_prefix : segment->prefix; // 途中の行から送り直すときは、その行からのウィンドウ設定
+        int prefix_length = cursor->resuming ? bus->resume_prefix_length : segment->prefix_length;
+
+        if (cursor->prefix_position < prefix_length)
+        {
+            dst[count++] = prefix[cursor->prefix_position++]; // トランザクションの先頭は制御バイトとコマンド
+            if (cursor->prefix_position == prefix_length && segment->rows == 0)
+            {
+                dst[count - 1] |= I2C_IC_DATA_CMD_STOP_BITS; // 表示データのない (コマンドだけの) トランザクションはここで終える
+                *cursor = (flush_cursor_t){cursor->segment_index + 1, 0, 0, 0, false};
+            }
+            continue;
+        }
+
+        if (segment->decoder != NULL)
+        {
+            while (count < FLUSH_CHUNK_SIZE && cursor->column < segment->row_bytes)
+            {
+                dst[count++] = image_decoder_next(segment->decoder); // 圧縮画像はフラッシュから読みながら展開する
+                cursor->column++;
+            }
+        }
+        else
+        {
+            const uint8_t *row = segment->data + cursor->row * segment->stride;
+            while (count < FLUSH_CHUNK_SIZE && cursor->column < segment->row_bytes)
+            {
+                dst[count++] = row[cursor->column++]; // 上位ビット (コマンド/STOP/RESTART) は 0 のまま
+            }
+        }
+        if (cursor->column == segment->row_bytes)
+        {
+            cursor->column = 0;
+            cursor->row++;
+            if (cursor->row == segment->rows)
+            {
+                dst[count - 1] |= I2C_IC_DATA_CMD_STOP_BITS; // トランザクションの最後のバイトの送信後に STOP 条件を発行させる
+                *cursor = (flush_cursor_t){cursor->segment_index + 1, 0, 0, 0, false};
+            }
+        }
+    }
+    return count;
+}
+
+// 中断した転送のカーソルを、送り直す位置 (resume) まで戻す関数
+// フレームバッファの表示データの途中なら、その行から下だけを書き込むウィンドウ設定を作り、その行の先頭から送る。
+// 圧縮画像 (伸長器は途中に戻せない) とコマンドだけのトランザクションは、先頭から送り直す
+static void ssd1327_bus_rewind(ssd1327_bus_t *bus)
+{
+    flush_cursor_t *cursor = &bus->cursor;
+    *cursor = bus->resume;
+    for (int i = cursor->segment_index; i < bus->active->flush_segment_count; i++)
+    {
+        if (bus->active->flush_segments[i].decoder != NULL)
+        {
+            image_decoder_rewind(bus->active->flush_segments[i].decoder); // 送り直す位置より後の圧縮画像も、もう展開を進めている
+        }
+    }
+    if (cursor->segment_index >= bus->active->flush_segment_count)
+    {
+        return;
+    }
+
+    const flush_segment_t *segment = &bus->active->flush_segments[cursor->segment_index];
+    if (segment->decoder != NULL || segment->rows == 0 || cursor->row == 0)
+    {
+        *cursor = (flush_cursor_t){cursor->segment_index, 0, 0, 0, false};
+        return;
+    }
+
+    ssd1327_batch_t batch;
+    ssd1327_batch_begin(bus->active, &batch);
+    ssd1327_batch_add_window(&batch, segment->window.x0, segment->window.y0 + cursor->row, segment->window.x1, segment->window.y1);
+    bus->resume_prefix_length = ssd1327_batch_encode_with_data(&batch, bus->resume_prefix);
+    cursor->column = 0;
+    cursor->prefix_position = 0;
+    cursor->resuming = true;
+}
+
+// カーソルの位置からステージングバッファを 2 面詰めて、DMA で送信し始める関数 (転送の始めと、送り直すときに呼ぶ)
+static void ssd1327_bus_transmit(ssd1327_bus_t *bus)
+{
+    ssd1327_bus_apply_speed(bus); // エラーが続いて通信速度を下げていれば、ここから遅くなる
+    bus->resume = bus->cursor;
+    bus->chunk_len[0] = ssd1327_flush_fill(bus, 0); // 最初の 2 面を詰めておく
+    bus->chunk_len[1] = ssd1327_flush_fill(bus, 1);
+    bus->active_chunk = 0;
+    bus->progress_us = time_us_32();
+
+    i2c_hw_t *hw = i2c_get_hw(bus->i2c);
+    hw->enable = 0;                  // 送信先アドレスを変更するため一旦 I2C を無効化
+    hw->tar = bus->active->address;  // 送信先アドレスを設定
+    hw->enable = 1;
+    (void)hw->clr_stop_det;          // 以前の STOP 検出フラグを消しておく
+    (void)hw->clr_tx_abrt;           // 以前の中断フラグも消しておく
+    hw->intr_mask = I2C_IC_INTR_MASK_M_TX_ABRT_BITS; // 送信中は NAK による中断だけを割り込みで受け取る
+    bus->i2c->restart_on_next = false;
+
+    dma_channel_transfer_from_buffer_now(bus->dma_channel, bus->chunk[0], bus->chunk_len[0]); // 転送開始
+}
+
+// パネル display の転送内容をバスに載せて送信し始める関数 (バスが空いているときに、割り込み禁止の中か割り込みハンドラから呼ぶ)
+static void ssd1327_bus_start(ssd1327_bus_t *bus, ssd1327_t *display)
+{
+    bus->active = display;
+    bus->cursor = (flush_cursor_t){0};
+    bus->attempt = 0;
+    bus->transfer_bytes = 0;
+    for (int i = 0; i < display->flush_segment_count; i++)
+    {
+        const flush_segment_t *segment = &display->flush_segments[i];
+        bus->transfer_bytes += segment->prefix_length + segment->row_bytes * segment->rows;
+    }
+    bus->start_us = time_us_64();
+    ssd1327_bus_transmit(bus);
+}
+
+// 送信中の DMA を止める関数 (止めた後に完了割り込みが残らないようにする)
+static void ssd1327_bus_halt(ssd1327_bus_t *bus)
+{
+    i2c_get_hw(bus->i2c)->intr_mask = 0;
+    dma_channel_set_irq0_enabled(bus->dma_channel, false);
+    dma_channel_abort(bus->dma_channel);
+    dma_channel_acknowledge_irq0(bus->dma_channel);
+    dma_channel_set_irq0_enabled(bus->dma_channel, true);
+}
+
+// 送信中の転送を終える関数 (delivered は最後まで届いたか)。同じバスで順番を待っているパネルがあれば、続けてその転送を始める
+static void ssd1327_bus_finish(ssd1327_bus_t *bus, bool delivered)
+{
+    ssd1327_t *done = bus->active;
+    bus->stats.busy_us += time_us_64() - bus->start_us;
+    if (delivered)
+    {
+        bus->stats.transfers++;
+        bus->stats.bytes += bus->transfer_bytes;
+        if (bus->attempt == 0)
+        {
+            ssd1327_bus_clean(bus);
+        }
+    }
+
+    bus->active = NULL;
+    if (bus->waiting_count > 0)
+    {
+        ssd1327_t *next = bus->waiting[0]; // 先に待っていたパネルから送る
+        bus->waiting_count--;
+        memmove(&bus->waiting[0], &bus->waiting[1], bus->waiting_count * sizeof(bus->waiting[0]));
+        ssd1327_bus_start(bus, next);
+    }
+
+    done->flush_in_progress = false;
+    if (done->flush_callback != NULL)
+    {
+        done->flush_callback(done, done->flush_data); // 送信し終えたバッファを通知
+    }
+}
+
+// 中断した転送を、まだ届いたと言い切れない位置から送り直す関数
+// 送り直しが SSD1327_RETRY_MAX 回を超えたらあきらめて、パネルの次のフレームを全体で送らせる
+static void ssd1327_bus_retry(ssd1327_bus_t *bus)
+{
+    if (++bus->attempt > SSD1327_RETRY_MAX)
+    {
+        bus->stats.failures++;
+        bus->active->flush_failed = true;
+        ssd1327_bus_finish(bus, false);
+        return;
+    }
+    bus->stats.retries++;
+    ssd1327_bus_rewind(bus);
+    ssd1327_bus_transmit(bus);
+}
+
+// バスが固まっていないか調べる関数 (転送の完了を待つループから呼ぶ)。転送がしばらく進んでいなければ、バスを解放して送り直す
+// SDA を Low に保ったまま止まったスレーブがいると、I2C は START も STOP も出せず、中断の割り込みも来ないので時間で判断する
+static void ssd1327_bus_poll(ssd1327_bus_t *bus)
+{
+    uint32_t limit_us = SSD1327_STALL_FACTOR * ssd1327_bus_time_us(bus, FLUSH_CHUNK_SIZE) + 2000;
+    if (bus->active == NULL || time_us_32() - bus->progress_us < limit_us)
+    {
+        return;
+    }
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (bus->active != NULL && time_us_32() - bus->progress_us >= limit_us) // 割り込みを禁止する前に進んでいなければ
+    {
+        ssd1327_bus_halt(bus);
+        ssd1327_bus_error(bus);
+        ssd1327_bus_clear(bus);
+        ssd1327_bus_retry(bus);
+    }
+    restore_interrupts(interrupts);
+}
+
+// DMA 転送完了割り込みハンドラ：次のステージングバッファの送信を始め、空いた面に続きを詰める
+// DMA_IRQ_0 は両方のバスの DMA チャネルで共有するので、完了したチャネルをすべて処理する
+static void ssd1327_dma_irq_handler()
+{
+    for (int b = 0; b < SSD1327_BUS_COUNT; b++)
+    {
+        ssd1327_bus_t *bus = &ssd1327_buses[b];
+        if (bus->i2c == NULL || !dma_channel_get_irq0_status(bus->dma_channel))
+        {
+            continue;
+        }
+        dma_channel_acknowledge_irq0(bus->dma_channel);
+        if (i2c_get_hw(bus->i2c)->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS)
+        {
+            continue; // NAK で中断している。I2C 割り込みで送り直すので先へ進めない
+        }
+
+        int done = bus->active_chunk; // 送信し終えた面
+        int next = done ^ 1;          // 詰めてある次の面
+        bus->resume = bus->chunk_from[done]; // 送信し終えた面より前は、もう FIFO に残っていない
+        bus->progress_us = time_us_32();
+        if (bus->chunk_len[next] > 0)
+        {
+            // I2C の TX FIFO が空になる前に次の面の DMA を始めてから、空いた面を詰め直す
+            bus->active_chunk = next;
+            dma_channel_transfer_from_buffer_now(bus->dma_channel, bus->chunk[next], bus->chunk_len[next]);
+            bus->chunk_len[done] = ssd1327_flush_fill(bus, done);
+        }
+        else
+        {
+            // 全データを FIFO に積み終えた。バス上の送信が終わる (STOP 検出) まで I2C 割り込みで待つ
+            i2c_get_hw(bus->i2c)->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+        }
+    }
+}
+
+// I2C 割り込みの処理：NAK で転送が中断したら送り直し、最後のトランザクションの STOP 条件を検出したら、そのパネルの非同期転送の完了とする
+static void ssd1327_i2c_irq(ssd1327_bus_t *bus)
+{
+    i2c_hw_t *hw = i2c_get_hw(bus->i2c);
+    if (hw->intr_stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+    {
+        // I2C は FIFO の残りを捨てて STOP を出している。DMA を止めてから、中断したステージングバッファの先頭の行から送り直す
+        ssd1327_bus_halt(bus);
+        (void)hw->clr_tx_abrt;
+        (void)hw->clr_stop_det;
+        ssd1327_bus_error(bus);
+        ssd1327_bus_retry(bus);
+        return;
+    }
+    if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)
+    {
+        (void)hw->clr_stop_det; // 読み出すことで STOP 検出フラグをクリア
+        // 途中のトランザクションの STOP の場合は FIFO に続きが残っているか、次の送信が始まっている
+        // (フラグをクリアしてから調べるので、この後に最後の STOP が来れば再び割り込みが入る)
+        if (!(hw->status & I2C_IC_STATUS_TFE_BITS) || (hw->status & I2C_IC_STATUS_MST_ACTIVITY_BITS))
+        {
+            return;
+        }
+        hw->intr_mask = 0; // ブロッキング送信の STOP 検出と干渉しないよう、転送の終わりにだけ割り込みを有効にする
+        ssd1327_bus_finish(bus, true);
+    }
+}
+
+// I2C コントローラごとの割り込みハンドラ
+static void ssd1327_i2c0_irq_handler() { ssd1327_i2c_irq(&ssd1327_buses[0]); }
+static void ssd1327_i2c1_irq_handler() { ssd1327_i2c_irq(&ssd1327_buses[1]); }
+
+// バスの非同期転送に使う DMA チャネルと割り込みを初期化する関数 (i2c_init_pico の後に呼ぶ)
+static void ssd1327_flush_init(ssd1327_bus_t *bus)
+{
+    bus->dma_channel = dma_claim_unused_channel(true); // 空いている DMA チャネルを確保
+
+    dma_channel_config config = dma_channel_get_default_config(bus->dma_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);            // 16 ビット単位で転送 (data_cmd の上位ビットを 0 に保つ)
+    channel_config_set_read_increment(&config, true);                       // 読み出し元 (ステージングバッファ) は 1 語ずつ進める
+    channel_config_set_write_increment(&config, false);                     // 書き込み先 (data_cmd レジスタ) は固定
+    channel_config_set_dreq(&config, i2c_get_dreq(bus->i2c, true));         // I2C の TX FIFO に空きがあるときだけ転送する
+    dma_channel_configure(bus->dma_channel, &config, &i2c_get_hw(bus->i2c)->data_cmd, NULL, 0, false);
+
+    dma_channel_set_irq0_enabled(bus->dma_channel, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, ssd1327_dma_irq_handler); // 2 つ目のバスでも同じハンドラを登録し直すだけ
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    uint index = i2c_get_index(bus->i2c);
+    i2c_get_hw(bus->i2c)->intr_mask = 0; // 転送の終わり以外では I2C 割り込みを発生させない
+    irq_set_exclusive_handler(I2C0_IRQ + index, index == 0 ? ssd1327_i2c0_irq_handler : ssd1327_i2c1_irq_handler);
+    irq_set_enabled(I2C0_IRQ + index, true);
+}
+
+// display の flush_segments に並べたトランザクションを DMA で送信し始める関数
+// 同じバスで別のパネルへの転送中なら、順番待ちに入れて、その転送が終わった割り込みの中で始める
+static void ssd1327_flush_start(ssd1327_t *display, const uint8_t *data, ssd1327_flush_callback_t callback)
 {
-    i2c_init(i2c, I2C_SPEED);
-    // 指定した I2C インスタンス (i2c1) と速度 (1MHz) で I2C を初期化
-    gpio_set_function(I2C_SDA_PIN, GPIO_FUNC_I2C); // SDA ピン (GPIO 6) を I2C の機能として使用するように設定
-    gpio_set_function(I2C_SCL_PIN, GPIO_FUNC_I2C); // SCL ピン (GPIO 7) を I2C の機能として使用するように設定
-    gpio_pull_up(I2C_SDA_PIN);                     // SDA ピンにプルアップ抵抗を有効化
-    gpio_pull_up(I2C_SCL_PIN);                     // SCL ピンにプルアップ抵抗を有効化
+    ssd1327_bus_t *bus = display->bus;
+    display->flush_data = data;
+    display->flush_callback = callback;
+    display->flush_in_progress = true;
+
+    uint32_t interrupts = save_and_disable_interrupts(); // 転送完了の割り込みと、バスの空きの判定が食い違わないようにする
+    if (bus->active == NULL)
+    {
+        ssd1327_bus_start(bus, display);
+    }
+    else
+    {
+        bus->waiting[bus->waiting_count++] = display; // パネルごとに 1 つまでなので溢れない
+    }
+    restore_interrupts(interrupts);
 }
 
-// SSD1327 にコマンドを送信する関数
-static void ssd1327_send_command(uint8_t command)
-{
-    uint8_t buffer[2] = {0x00, command};
-    // 送信するデータバッファを作成。最初のバイト 0x00 はコマンドであることを示す制御バイト
-    i2c_write_blocking(i2c, SSD1327_ADDR, buffer, 2, false); // I2C デバイス (SSD1327_ADDR) にバッファの内容 (2バイト) を送信。false は STOP ビットを送信しないことを意味します
+// 矩形 rect の範囲を送るトランザクション (ウィンドウ設定 + 表示データ) を flush_segments に追加し、追加したトランザクションを返す関数
+// data が NULL のときは、呼び出し側が返したトランザクションに伸長器を設定する
+static flush_segment_t *ssd1327_flush_add_window(ssd1327_t *display, const uint8_t *data, const rect_t *rect)
+{
+    ssd1327_batch_t batch;
+    ssd1327_batch_begin(display, &batch);
+    ssd1327_batch_add_window(&batch, rect->x0, rect->y0, rect->x1, rect->y1);
+
+    uint8_t *prefix = display->flush_window_prefix[display->flush_segment_count];
+    int prefix_length = ssd1327_batch_encode_with_data(&batch, prefix); // ウィンドウ設定と表示データを 1 つのトランザクションにまとめる
+
+    int row_bytes = (rect->x1 - rect->x0 + 1) / 2;
+    int rows = rect->y1 - rect->y0 + 1;
+    flush_segment_t *segment = &display->flush_segments[display->flush_segment_count++];
+    *segment = (flush_segment_t){
+        prefix, prefix_length, data != NULL ? data + (rect->y0 * DISPLAY_WIDTH + rect->x0) / 2 : NULL, row_bytes, rows, DISPLAY_WIDTH / 2, NULL, *rect};
+
+    display->flush_stats.bytes_sent += row_bytes * rows;
+    display->flush_stats.windows++;
+    return segment;
+}
+
+// コマンドバッチを、表示データのない 1 つのトランザクションとして flush_segments に追加する関数 (空なら何もしない)
+// batch は転送が終わるまで書き換えないこと
+static void ssd1327_flush_add_commands(ssd1327_t *display, const ssd1327_batch_t *batch)
+{
+    if (batch->length > 1)
+    {
+        display->flush_segments[display->flush_segment_count++] = (flush_segment_t){batch->bytes, batch->length, NULL, 0, 0, 0, NULL, {0, 0, 0, 0}};
+    }
+}
+
+// 非同期転送を組み立て始める関数 (前の転送が終わるまで待ってから、トランザクションの並びと表示設定のコマンドを空にする)
+static void ssd1327_flush_begin(ssd1327_t *display)
+{
+    ssd1327_wait_flush(display); // 前の転送が終わるまで待つ (flush_segments を書き換えるため)
+    display->flush_stats = (flush_stats_t){0};
+    display->flush_segment_count = 0;
+    ssd1327_batch_begin(display, &display->flush_panel_batch[0]);
+    ssd1327_batch_begin(display, &display->flush_panel_batch[1]);
+}
+
+// 2 つのスクロール設定の水平スクロールが同じかどうかを返す関数
+static bool scroll_hscroll_equal(const panel_state_t *a, const panel_state_t *b)
+{
+    if (!a->hscroll || !b->hscroll)
+    {
+        return a->hscroll == b->hscroll;
+    }
+    return a->hscroll_command == b->hscroll_command && a->hscroll_interval == b->hscroll_interval &&
+           a->hscroll_row0 == b->hscroll_row0 && a->hscroll_row1 == b->hscroll_row1;
+}
+
+// バッチの送り先のパネルで動いている水平スクロールが scroll と違えば、止めるコマンド (0x2E) をバッチに追加する関数
+// 水平スクロール中はパネルの RAM の内容そのものがずれていくので、止めたら band の行を送り直すこと。止めたら true を返す
+static bool ssd1327_batch_add_scroll_stop(ssd1327_batch_t *batch, const panel_state_t *scroll, rect_t *band)
+{
+    panel_state_t *panel = &batch->display->panel_state;
+    if (!panel->hscroll || scroll_hscroll_equal(scroll, panel))
+    {
+        return false;
+    }
+    ssd1327_batch_add(batch, 0x2e); // 水平スクロールを止める
+    *band = (rect_t){0, panel->hscroll_row0, DISPLAY_WIDTH - 1, panel->hscroll_row1};
+    panel->hscroll = false;
+    return true;
+}
+
+// バッチの送り先のパネルの開始ライン、水平スクロール、明るさを state に合わせるコマンドのうち、変わるものだけをバッチに追加する関数
+// 表示データを書き込んだ後に送る (先に開始ラインを動かすと、書き換える前の行が一瞬反対側の端に見える)
+// フェードのように明るさだけが変わるフレームでは、送るのはこのコマンドの数バイトだけになる
+static void ssd1327_batch_add_panel_state(ssd1327_batch_t *batch, const panel_state_t *state)
+{
+    panel_state_t *panel = &batch->display->panel_state;
+    if (state->start_line != panel->start_line)
+    {
+        ssd1327_batch_add(batch, 0xa1); // 表示開始ライン設定
+        ssd1327_batch_add(batch, state->start_line);
+    }
+    if (state->hscroll && !panel->hscroll)
+    {
+        const uint8_t setup[] = {
+            state->hscroll_command,  // 水平スクロール設定 (0x26: 右, 0x27: 左)
+            0x00,                    // ダミー
+            state->hscroll_row0,     // 開始ロウ
+            state->hscroll_interval, // 1 ステップの間隔
+            state->hscroll_row1,     // 終了ロウ
+            0x00,                    // 開始コラム
+            DISPLAY_WIDTH / 2 - 1,   // 終了コラム
+            0x00,                    // ダミー
+            0x2f,                    // スクロール開始
+        };
+        ssd1327_batch_add_table(batch, setup, sizeof(setup));
+    }
+    if (state->gray_table != panel->gray_table)
+    {
+        if (state->gray_table != NULL)
+        {
+            ssd1327_batch_add(batch, 0xb8); // グレースケール表の設定 (GS1〜GS15 のパルス幅)
+            ssd1327_batch_add_table(batch, state->gray_table, SSD1327_GRAY_LEVELS);
+        }
+        else
+        {
+            ssd1327_batch_add(batch, 0xb9); // 線形のグレースケール表に戻す
+        }
+    }
+    if (state->contrast != panel->contrast)
+    {
+        ssd1327_batch_add(batch, 0x81); // コントラスト設定
+        ssd1327_batch_add(batch, state->contrast);
+    }
+    *panel = *state;
+}
+
+// フレームバッファのポインタから、そのフレームバッファを持つパネル (*display) と面の番号を返す関数 (フレームバッファ以外なら -1)
+static int frame_buffer_find(const uint8_t *data, ssd1327_t **display)
+{
+    for (int d = 0; d < LCD_PANEL_COUNT; d++)
+    {
+        for (int i = 0; i < FRAME_BUFFER_COUNT; i++)
+        {
+            if (data == displays[d].frame_buffers[i].pixels)
+            {
+                *display = &displays[d];
+                return i;
+            }
+        }
+    }
+    *display = NULL;
+    return -1;
+}
+
+// パネル display のフレームバッファのポインタから面の番号を返す関数 (そのパネルのフレームバッファ以外なら -1)
+static int frame_buffer_index(const ssd1327_t *display, const uint8_t *data)
+{
+    for (int i = 0; i < FRAME_BUFFER_COUNT; i++)
+    {
+        if (data == display->frame_buffers[i].pixels)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// パネルへ送ったことを記録する関数
+// 差分 (dirty) を送った場合は、送った面が順番どおりの次のフレームなのでパネルは引き続きそろっている。
+// 全画面を送った場合は、最後に描き終えたフレームを送ったときだけそろう (それ以外は次の送信を全画面にする)
+static void frame_buffer_sent(ssd1327_t *display, const uint8_t *data, bool full_frame)
+{
+    int index = frame_buffer_index(display, data);
+    if (index >= 0)
+    {
+        display->dirty_rects[index].count = 0;
+    }
+    if (full_frame)
+    {
+        display->panel_in_sync = (index >= 0 && index == display->latest_frame);
+    }
+}
+
+// 面 index に描き始める前に、最後に描き終えたフレームと同じ内容にそろえる関数
+// その面が送信中でないこと (転送完了のコールバックを受け取った後であること) を呼び出し側が保証する
+static void frame_buffer_acquire(ssd1327_t *display, int index)
+{
+    int latest = display->latest_frame;
+    if (latest >= 0 && latest != index)
+    {
+        const uint8_t *source = display->frame_buffers[latest].pixels;
+        uint8_t *target = display->frame_buffers[index].pixels;
+        const rect_list_t *stale = &display->stale_rects[index];
+        for (int r = 0; r < stale->count; r++)
+        {
+            const rect_t *rect = &stale->rects[r]; // 内容が異なるかもしれない領域だけをコピーする
+            int offset = (rect->y0 * DISPLAY_WIDTH + rect->x0) / 2;
+            int row_bytes = (rect->x1 - rect->x0 + 1) / 2;
+            for (int y = rect->y0; y <= rect->y1; y++)
+            {
+                memcpy(target + offset, source + offset, row_bytes);
+                offset += DISPLAY_WIDTH / 2;
+            }
+        }
+        display->content_rects[index] = display->content_rects[latest]; // 描画済みの領域も引き継ぐ
+        display->frame_panel[index] = display->frame_panel[latest];     // スクロールと明るさの設定も引き継ぐ
+        display->dirty_rects[index].count = 0;                          // 直前のフレームと同じ内容になったので差分はない
+    }
+    display->stale_rects[index].count = 0;
+}
+
+// 面 index の変更領域から、直前に描き終えたフレームと実際には内容が同じ行を除く関数
+// 各矩形の上下から同じ行を削り、すべて同じなら矩形ごと除く。同じ内容を描き直しただけなら何も送らずに済む
+// 直前のフレームの面は、次に描き始める (frame_buffer_acquire する) まで書き換わらないので、そのまま比べられる
+static void frame_buffer_trim_dirty(ssd1327_t *display, int index)
+{
+    int latest = display->latest_frame;
+    if (latest < 0 || latest == index)
+    {
+        return; // 比べる相手がない (フレームバッファが 1 面だけのときは、直前のフレームはもう上書きされている)
+    }
+    const uint8_t *previous = display->frame_buffers[latest].pixels;
+    const uint8_t *current = display->frame_buffers[index].pixels;
+    rect_list_t *list = &display->dirty_rects[index];
+    for (int r = 0; r < list->count;)
+    {
+        rect_t *rect = &list->rects[r];
+        int column = rect->x0 / 2;
+        int row_bytes = (rect->x1 - rect->x0 + 1) / 2;
+        while (rect->y0 <= rect->y1 &&
+               memcmp(current + rect->y0 * (DISPLAY_WIDTH / 2) + column, previous + rect->y0 * (DISPLAY_WIDTH / 2) + column, row_bytes) == 0)
+        {
+            rect->y0++; // 上の行が同じなら削る
+        }
+        while (rect->y1 >= rect->y0 &&
+               memcmp(current + rect->y1 * (DISPLAY_WIDTH / 2) + column, previous + rect->y1 * (DISPLAY_WIDTH / 2) + column, row_bytes) == 0)
+        {
+            rect->y1--; // 下の行が同じなら削る
+        }
+        if (rect->y0 > rect->y1)
+        {
+            *rect = list->rects[--list->count]; // すべて同じなので矩形ごと除く (最後の矩形を詰めて、同じ位置をもう一度調べる)
+            continue;
+        }
+        r++;
+    }
+}
+
+// 面 index を描き終えたことを記録する関数。この面が次に送るフレームになる
+// 変更領域を実際に変わった行まで絞り、ほかの面には、この面で変わった領域を「そろえ直す領域」として加える
+static void frame_buffer_submit(ssd1327_t *display, int index)
+{
+    frame_buffer_trim_dirty(display, index);
+    for (int i = 0; i < FRAME_BUFFER_COUNT; i++)
+    {
+        if (i == index)
+        {
+            continue;
+        }
+        for (int r = 0; r < display->dirty_rects[index].count; r++)
+        {
+            const rect_t *rect = &display->dirty_rects[index].rects[r];
+            rect_list_add(&display->stale_rects[i], rect->x0, rect->y0, rect->x1, rect->y1);
+        }
+    }
+    __dmb(); // 描画結果と記録を書き終えてから、ほかのコアに見えるようにする
+    display->latest_frame = index;
+}
+
+// バッファの内容を DMA で SSD1327 に送信し始め、転送の完了を待たずに戻る関数
+// 転送が終わると callback (NULL 可) が割り込みの中から呼ばれる。転送中は data を書き換えないこと
+static void ssd1327_set_display_async(ssd1327_t *display, const uint8_t *data, ssd1327_flush_callback_t callback)
+{
+    const rect_list_t full = {{{0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1}}, 1};
+
+    const panel_state_t *state = frame_panel_of(data);
+    rect_t band;
+
+    ssd1327_flush_begin(display);
+    display->image_shown = NULL; // パネルの内容が画像ではなくなるので、次に画像を送るときは全画面から送り直す
+    ssd1327_batch_add_scroll_stop(&display->flush_panel_batch[0], state, &band); // 全体を送り直すので、止めた行も一緒に送られる
+    ssd1327_flush_add_commands(display, &display->flush_panel_batch[0]);
+    ssd1327_flush_add_window(display, data, &full.rects[0]);
+    ssd1327_batch_add_panel_state(&display->flush_panel_batch[1], state);
+    ssd1327_flush_add_commands(display, &display->flush_panel_batch[1]);
+    frame_buffer_sent(display, data, true);
+    ssd1327_flush_start(display, data, callback);
+}
+
+// バッファのうち直前のフレームから変更された領域 (dirty) だけを DMA で送信し始める関数
+// data は描き終えた (frame_buffer_submit した) フレームバッファで、描き終えた順に送ること。変更がなければ何も送らない
+static void ssd1327_flush_dirty_async(ssd1327_t *display, const uint8_t *data, ssd1327_flush_callback_t callback)
+{
+    ssd1327_wait_flush(display); // 前の転送が届いたかどうかが決まるまで待つ
+    if (display->flush_failed)
+    {
+        display->flush_failed = false;
+        display->panel_in_sync = false; // 前の転送をあきらめたので、パネルの内容は分からない
+    }
+
+    int index = frame_buffer_index(display, data);
+    if (index < 0 || !display->panel_in_sync)
+    {
+        ssd1327_set_display_async(display, data, callback); // 変更領域を記録していないバッファや、パネルの内容が不明なときは全体を送る
+        display->panel_in_sync = (index >= 0);              // 描き終えた順に送っているので、この後のフレームの差分はこの面からになる
+        return;
+    }
+
+    ssd1327_flush_begin(display);
+    display->image_shown = NULL;
+
+    rect_list_t sent = display->dirty_rects[index];
+    rect_t band;
+    if (ssd1327_batch_add_scroll_stop(&display->flush_panel_batch[0], &display->frame_panel[index], &band))
+    {
+        rect_list_add(&sent, band.x0, band.y0, band.x1, band.y1); // 水平スクロールを止めた行は RAM の内容がずれているので送り直す
+    }
+    ssd1327_flush_add_commands(display, &display->flush_panel_batch[0]);
+    for (int r = 0; r < sent.count; r++)
+    {
+        ssd1327_flush_add_window(display, data, &sent.rects[r]);
+    }
+    ssd1327_batch_add_panel_state(&display->flush_panel_batch[1], &display->frame_panel[index]); // 開始ラインや明るさだけを変えたフレームでは、送るのは新しく現れた行とこのコマンドだけになる
+    ssd1327_flush_add_commands(display, &display->flush_panel_batch[1]);
+    display->flush_stats.bytes_skipped = DISPLAY_DATA_SIZE - display->flush_stats.bytes_sent;
+    frame_buffer_sent(display, data, false);
+
+    if (display->flush_segment_count == 0)
+    {
+        if (callback != NULL)
+        {
+            callback(display, data); // 送るものがないのですぐに完了を通知
+        }
+        return;
+    }
+    ssd1327_flush_start(display, data, callback);
+}
+
+// 圧縮画像のフレームを 1 フレーム目から重ねて展開しておくバッファ (パネルに直前のフレームが出ていないときに、差分の代わりに全体を送る)
+// 全パネルで共有し、同じ画像の同じフレームなら展開し直さない
+static uint8_t image_keyframe[DISPLAY_DATA_SIZE];
+static const image_t *image_keyframe_image; // image_keyframe に展開した画像 (NULL ならまだない)
+static int image_keyframe_frame;            // そのフレーム番号
+
+// 圧縮画像 image の frame 番目のフレームまでを重ねた全画面を image_keyframe に展開して返す関数
+static const uint8_t *image_keyframe_compose(const image_t *image, int frame)
+{
+    if (image_keyframe_image == image && image_keyframe_frame == frame)
+    {
+        return image_keyframe;
+    }
+    for (int d = 0; d < LCD_PANEL_COUNT; d++)
+    {
+        ssd1327_wait_flush(&displays[d]); // 前に展開したフレームを送っている途中のパネルがあるかもしれないので、送り終えるまで書き換えない
+    }
+    for (int k = 0; k <= frame; k++)
+    {
+        image_draw(image_keyframe, image, k); // フレームバッファではないので変更領域は記録されない
+    }
+    image_keyframe_image = image;
+    image_keyframe_frame = frame;
+    return image_keyframe;
+}
+
+// 圧縮画像 image の frame 番目のフレームを、フラッシュから展開しながら DMA で SSD1327 に送信し始める関数
+// 展開は送信と同時に DMA 割り込みの中で少しずつ行うので、フレームバッファを使わずにバスの速さで再生できる。
+// frame が 1 以上なら、そのフレームのウィンドウ (直前のフレームから変わった矩形) だけを送る。
+// パネルに直前のフレーム (frame - 1) が出ていなければ (前の転送をあきらめた、フレームを飛ばした、間にフレームバッファを送ったなど)、
+// 1 フレーム目から重ねて展開した全画面を送る。転送が終わると callback (NULL 可) に NULL が渡される
+static void ssd1327_show_image_async(ssd1327_t *display, const image_t *image, int frame, ssd1327_flush_callback_t callback)
+{
+    const image_frame_t *entry = &image->frames[frame];
+    const rect_t full = {0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1};
+    rect_t band;
+
+    ssd1327_flush_begin(display); // 伸長器もパネルごとに持つので、前の転送が終わってから設定し直す
+    if (display->flush_failed)
+    {
+        display->flush_failed = false;
+        display->image_shown = NULL; // 前の転送をあきらめたので、パネルの内容は分からない
+    }
+    const uint8_t *keyframe = NULL;
+    if (frame > 0 && (display->image_shown != image || display->image_frame_shown != frame - 1))
+    {
+        keyframe = image_keyframe_compose(image, frame);
+    }
+
+    ssd1327_batch_add_scroll_stop(&display->flush_panel_batch[0], &panel_default, &band); // 画像は全画面から始めるので、止めた行も送り直される
+    ssd1327_flush_add_commands(display, &display->flush_panel_batch[0]);
+    if (keyframe != NULL)
+    {
+        ssd1327_flush_add_window(display, keyframe, &full); // 展開済みのバッファは途中の行から送り直せるので、NAK が続いても届く
+    }
+    else if (entry->x0 <= entry->x1)
+    {
+        rect_t window = {entry->x0, entry->y0, entry->x1, entry->y1};
+        flush_segment_t *segment = ssd1327_flush_add_window(display, NULL, &window);
+        image_decoder_begin(&display->flush_image_decoder, image->data + entry->offset, segment->row_bytes);
+        segment->decoder = &display->flush_image_decoder;
+        segment->row_bytes *= segment->rows; // 伸長器は行の区切りを自分で数えるので、ウィンドウ全体を 1 行として送る
+        segment->rows = 1;
+    }
+    ssd1327_batch_add_panel_state(&display->flush_panel_batch[1], &panel_default); // 開始ライン 0、スクロールなしで表示する
+    ssd1327_flush_add_commands(display, &display->flush_panel_batch[1]);
+    display->flush_stats.bytes_skipped = DISPLAY_DATA_SIZE - display->flush_stats.bytes_sent;
+    display->panel_in_sync = false; // パネルの内容はどのフレームバッファとも違うので、次にフレームバッファを送るときは全体を送る
+    display->image_shown = image;
+    display->image_frame_shown = frame;
+
+    if (display->flush_segment_count == 0)
+    {
+        if (callback != NULL)
+        {
+            callback(display, NULL); // 直前のフレームと同じなので何も送らない
+        }
+        return;
+    }
+    ssd1327_flush_start(display, NULL, callback);
+}
+
+// パネル display への非同期転送中 (または順番待ち) かどうかを返す関数
+static bool ssd1327_is_flush_in_progress(ssd1327_t *display)
+{
+    return display->flush_in_progress;
+}
+
+// パネル display への非同期転送が終わるまで待つ関数 (ほかのパネルへの転送は待たない)
+static void ssd1327_wait_flush(ssd1327_t *display)
+{
+    while (ssd1327_is_flush_in_progress(display))
+    {
+        tight_loop_contents();
+        ssd1327_bus_poll(display->bus); // バスが固まっていれば解放して送り直す
+    }
+}
+
+// バスの非同期転送がすべて終わるまで待つ関数 (ブロッキング送信の前に呼ぶ)
+static void ssd1327_wait_bus(ssd1327_bus_t *bus)
+{
+    while (bus->active != NULL)
+    {
+        tight_loop_contents(); // 順番待ちのパネルは、前の転送が終わった割り込みの中で続けて始まる
+        ssd1327_bus_poll(bus);
+    }
+}
+
+// 描画し終えたバックバッファの送信を始め、次の面を描画先にする関数 (callback は転送完了時に呼ばれる。NULL 可)
+// 次の描画先は前のフレームの送信に使われていた面なので、その転送が終わってから切り替わる
+// 切り替え先の面は今回のフレームと同じ内容にそろえるので、次の描画先は常に「いまパネルに出ている内容」から始まる
+static void ssd1327_swap_buffers(ssd1327_t *display, ssd1327_flush_callback_t callback)
+{
+    int next = (display->back_buffer_index + 1) % FRAME_BUFFER_COUNT;
+
+    frame_buffer_submit(display, display->back_buffer_index);
+    ssd1327_flush_dirty_async(display, display->buffer, callback); // 変更された領域だけを送る (前の転送が終わるまで待ってから始まる)
+
+    if (next == display->back_buffer_index)
+    {
+        ssd1327_wait_flush(display); // フレームバッファが 1 面だけのときは、送信が終わるまで次の描画を始められない
+    }
+    frame_buffer_acquire(display, next);
+
+    display->back_buffer_index = next;
+    display->buffer = display->frame_buffers[next].pixels;
+}
+
+// 矩形をリストに加える関数。画面外は切り取り、X 方向は 2 ピクセル単位に広げる
+// 重なる・接する矩形とは結合し、リストがいっぱいなら面積の増え方が最も小さい矩形と結合する
+static void rect_list_add(rect_list_t *list, int x0, int y0, int x1, int y1)
+{
+    // 画面の範囲に切り取る
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > DISPLAY_WIDTH - 1) x1 = DISPLAY_WIDTH - 1;
+    if (y1 > DISPLAY_HEIGHT - 1) y1 = DISPLAY_HEIGHT - 1;
+    if (x0 > x1 || y0 > y1)
+    {
+        return; // 画面の外なので何もしない
+    }
+
+    rect_t rect = {x0 & ~1, y0, x1 | 1, y1}; // SSD1327 のコラムは 2 ピクセル単位なので偶数から奇数までに揃える
+
+    // 重なる・接する矩形を取り込んで 1 つにまとめる (まとめた後の矩形で最初から調べ直す)
+    for (int i = 0; i < list->count;)
+    {
+        rect_t *other = &list->rects[i];
+        if (rect.x0 <= other->x1 + 1 && other->x0 <= rect.x1 + 1 &&
+            rect.y0 <= other->y1 + 1 && other->y0 <= rect.y1 + 1)
+        {
+            rect.x0 = MIN(rect.x0, other->x0);
+            rect.y0 = MIN(rect.y0, other->y0);
+            rect.x1 = MAX(rect.x1, other->x1);
+            rect.y1 = MAX(rect.y1, other->y1);
+            list->rects[i] = list->rects[--list->count]; // 取り込んだ矩形はリストから外す
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (list->count < DIRTY_RECT_MAX)
+    {
+        list->rects[list->count++] = rect;
+        return;
+    }
+
+    // リストがいっぱいなので、結合したときの面積の増え方が最も小さい矩形を探す
+    int best = 0;
+    int best_growth = INT32_MAX;
+    for (int i = 0; i < list->count; i++)
+    {
+        const rect_t *other = &list->rects[i];
+        int w = MAX(rect.x1, other->x1) - MIN(rect.x0, other->x0) + 1;
+        int h = MAX(rect.y1, other->y1) - MIN(rect.y0, other->y0) + 1;
+        int growth = w * h - (other->x1 - other->x0 + 1) * (other->y1 - other->y0 + 1);
+        if (growth < best_growth)
+        {
+            best = i;
+            best_growth = growth;
+        }
+    }
+    rect_t other = list->rects[best];
+    list->rects[best] = list->rects[--list->count];
+    rect_list_add(list, MIN(rect.x0, other.x0), MIN(rect.y0, other.y0), MAX(rect.x1, other.x1), MAX(rect.y1, other.y1)); // 結合した矩形を加え直す
+}
+
+// バッファの指定した範囲に描画したことを記録する関数 (フレームバッファ以外なら何もしない)
+static void mark_dirty(const uint8_t *buffer, int x0, int y0, int x1, int y1)
+{
+    ssd1327_t *display;
+    int index = frame_buffer_find(buffer, &display);
+    if (index < 0)
+    {
+        return;
+    }
+    rect_list_add(&display->dirty_rects[index], x0, y0, x1, y1);
+    rect_list_add(&display->content_rects[index], x0, y0, x1, y1);
+}
+
+// バッファを 0 (黒) でクリアする関数
+// 何かが描かれていた領域だけを dirty にするので、次のフラッシュでは前のフレームの描画範囲だけが送られる
+static void clear_buffer(uint8_t *buffer)
+{
+    memset(buffer, 0, DISPLAY_DATA_SIZE);
+
+    ssd1327_t *display;
+    int index = frame_buffer_find(buffer, &display);
+    if (index < 0)
+    {
+        return;
+    }
+    for (int r = 0; r < display->content_rects[index].count; r++)
+    {
+        const rect_t *rect = &display->content_rects[index].rects[r];
+        rect_list_add(&display->dirty_rects[index], rect->x0, rect->y0, rect->x1, rect->y1);
+    }
+    display->content_rects[index].count = 0;
+    display->frame_panel[index].start_line = 0; // 描き直すので、スクロールも元に戻す (明るさはそのまま引き継ぐ)
+    display->frame_panel[index].hscroll = false;
+}
+
+// 指定した座標のピクセルの明るさを設定する関数 (4ビットグレースケール：0〜15 の値で明るさを指定)
+// 一番内側のループで呼ばれるので変更領域は記録しない。図形ごとに呼び出し側でまとめて mark_dirty する
+void set_pixel(uint8_t *buffer, int x, int y, uint8_t brightness)
+{
+    if (x < 0 || x >= DISPLAY_WIDTH || y < 0 || y >= DISPLAY_HEIGHT)
+    {
+        return; // 画面の外は描画しない
+    }
+
+    int index = (y * DISPLAY_WIDTH + x) / 2; // 指定された x, y 座標に対応するバッファ内のインデックスを計算
+                                             // SSD1327 は横方向に 2 ピクセルで 1 バイトを扱うため、インデックスを 2 で割る
+    if (x % 2 == 0)
+    {
+        // x が偶数の場合、そのピクセルはバイトの上位 4 ビットに対応
+        buffer[index] = (buffer[index] & 0x0F) | (brightness << 4); // 元の下位 4 ビットを保持し、上位 4 ビットを新しい明るさで更新
+    }
+    else
+    {
+        // x が奇数の場合、そのピクセルはバイトの下位 4 ビットに対応
+        buffer[index] = (buffer[index] & 0xF0) | (brightness & 0x0F); // 元の上位 4 ビットを保持し、下位 4 ビットを新しい明るさで更新
+    }
+}
+
+// フレームバッファ buffer の (x0, y0)〜(x1, y1) を描き換えたことを記録する関数
+// set_pixel で描いた図形は、描き終えてからその外枠をこの関数で 1 回だけ記録する
+void display_mark_dirty(uint8_t *buffer, int x0, int y0, int x1, int y1)
+{
+    mark_dirty(buffer, x0, y0, x1, y1);
+}
+
+// 文字から字形の番号を求める関数。128 個の文字コードの索引を 1 回引くだけで済む
+// 索引にない文字 (制御文字や 0x80 以上) は FONT_GLYPH_MISSING (四角) になる
+static inline int font_index_of(char c)
+{
+    uint8_t code = (uint8_t)c;
+    return code < FONT_INDEX_SIZE ? font_glyph_index[code] : FONT_GLYPH_MISSING;
+}
+
+// 1 行のうち X 座標 x0〜x1 (両端を含む) を同じ明るさで塗りつぶす関数 (row は行の先頭、範囲は画面内であること)
+// 奇数の端だけニブル (4 ビット) 単位で書き、間は 2 ピクセル分のバイトをまとめて書き込む
+// 間が長いときは 4 バイト境界までをバイトで埋め、残りを 1 ワード (8 ピクセル) ずつ書き込む
+static void fill_span(uint8_t *row, int x0, int x1, uint8_t brightness)
+{
+    brightness &= 0x0F;
+    if (x0 & 1)
+    {
+        row[x0 / 2] = (row[x0 / 2] & 0xF0) | brightness; // 左端が奇数：バイトの下位 4 ビットだけ更新
+        x0++;
+    }
+    if (!(x1 & 1) && x0 <= x1)
+    {
+        row[x1 / 2] = (row[x1 / 2] & 0x0F) | (brightness << 4); // 右端が偶数：バイトの上位 4 ビットだけ更新
+        x1--;
+    }
+    uint8_t packed = brightness * 0x11; // 1 バイトに 2 ピクセル分の明るさを詰めた値
+    uint8_t *dst = row + x0 / 2;
+    uint8_t *end = row + (x1 + 1) / 2;
+    if (end - dst >= 8)
+    {
+        uint32_t word = packed * 0x01010101u; // 4 バイト分の明るさ
+        while ((uintptr_t)dst & 3)
+        {
+            *dst++ = packed;
+        }
+        for (; end - dst >= 4; dst += 4)
+        {
+            memcpy(dst, &word, 4); // 境界に揃えてあるので 1 回のワード書き込みになる
+        }
+    }
+    while (dst < end)
+    {
+        *dst++ = packed; // 間の残りは 2 ピクセルずつバイト単位で書き込む
+    }
+}
+
+// 拡大済みの字形テーブルから指定したスケールのものを探す関数 (生成されていないスケールなら NULL)
+static const glyph_table_t *glyph_table_for(int scale)
+{
+    for (int i = 0; i < GLYPH_TABLE_COUNT; i++)
+    {
+        if (glyph_tables[i].scale == scale)
+        {
+            return &glyph_tables[i];
+        }
+    }
+    return NULL;
+}
+
+#if !GLYPH_TABLE_RLE // RLE の字形テーブルは draw_glyph_prescaled の中で展開しながら書き込むので使わない
+// 1 行のうち col0〜col1-1 バイト目に、字形のマスク mask (点灯ピクセルのニブルが 0xF) の部分だけ明るさ packed を書き込む関数
+// 4 バイト (8 ピクセル) ずつまとめて処理し、全消灯なら読み飛ばし、全点灯ならそのまま書き込む
+static void blend_glyph_bytes(uint8_t *dst, const uint8_t *mask, int col0, int col1, uint8_t packed)
+{
+    uint32_t packed_word = packed * 0x01010101u; // 4 バイト分の明るさ
+    int c = col0;
+    for (; c + 4 <= col1; c += 4)
+    {
+        uint32_t m;
+        memcpy(&m, mask + c, 4); // 境界に揃っていない位置でも 1 ワードとして読み書きする
+        if (m == 0)
+        {
+            continue;
+        }
+        uint32_t word = packed_word;
+        if (m != 0xFFFFFFFFu)
+        {
+            memcpy(&word, dst + c, 4);
+            word = (word & ~m) | (packed_word & m); // 点灯するニブルだけ書き換える
+        }
+        memcpy(dst + c, &word, 4);
+    }
+    for (; c < col1; c++) // 残りの端数はバイト単位
+    {
+        uint8_t m = mask[c];
+        dst[c] = (dst[c] & ~m) | (packed & m);
+    }
+}
+#endif
+
+// 拡大済みの字形テーブルを使って 1 文字を描画する関数 (x は偶数であること。画面の端で切り取る)
+// 字形はフラッシュ上に SSD1327 と同じ並びで横方向に展開してあるので、各行をそのまま scale 回重ねるだけで済む
+static void draw_glyph_prescaled(uint8_t *buffer, const glyph_table_t *table, int font_index, int x, int y, uint8_t brightness)
+{
+    const uint8_t *src = table->data + table->offsets[font_index];
+    uint8_t packed = (brightness & 0x0F) * 0x11;              // 1 バイトに 2 ピクセル分の明るさを詰めた値
+    int scale = table->scale;
+    int row_bytes = table->row_bytes;
+    int col0 = MAX(0, -x / 2);                                 // 画面の左にはみ出す分を飛ばす
+    int col1 = MIN(row_bytes, (DISPLAY_WIDTH - x) / 2);        // 画面の右にはみ出す分を除く
+    int row0 = MAX(0, -y);                                     // 画面の上にはみ出す分を飛ばす
+    int row1 = MIN(8 * scale, DISPLAY_HEIGHT - y);             // 画面の下にはみ出す分を除く
+    uint8_t *origin = buffer + y * (DISPLAY_WIDTH / 2) + x / 2; // 字形の左上に対応するバイト (画面外を指すこともある)
+
+#if GLYPH_TABLE_RLE
+    // (繰り返し回数, 値) の組を順に展開する。消灯 (0) の区間は読み飛ばすだけ
+    const uint8_t *end = table->data + table->offsets[font_index + 1];
+    int position = 0; // 展開後の字形の中での位置 (バイト)
+    for (; src < end; src += 2)
+    {
+        int run = src[0];
+        uint8_t mask = src[1];
+        if (mask == 0)
+        {
+            position += run;
+            continue;
+        }
+        while (run > 0)
+        {
+            int line = position / row_bytes; // 字形の元の行 (画面上では scale 行になる)
+            int col = position % row_bytes;
+            int n = MIN(run, row_bytes - col); // この行に収まる分
+            for (int row = MAX(line * scale, row0); row < MIN(line * scale + scale, row1); row++)
+            {
+                uint8_t *dst = origin + row * (DISPLAY_WIDTH / 2);
+                for (int c = MAX(col, col0); c < MIN(col + n, col1); c++)
+                {
+                    dst[c] = (mask == 0xFF) ? packed : (dst[c] & ~mask) | (packed & mask);
+                }
+            }
+            position += n;
+            run -= n;
+        }
+    }
+#else
+    for (int row = row0; row < row1; row++)
+    {
+        blend_glyph_bytes(origin + row * (DISPLAY_WIDTH / 2), src + (row / scale) * row_bytes, col0, col1, packed);
+    }
+#endif
+}
+
+// 指定した座標に 1 文字を描画する関数
+// 拡大済みの字形テーブルがあるスケールで X 座標が偶数なら、テーブルの行をそのまま重ねる
+// それ以外はフォントの各行を一度だけ「点灯する区間」に展開し、拡大した区間をバイト単位で塗りつぶす (画面の端で切り取る)
+void draw_char(uint8_t *buffer, char c, int x, int y, uint8_t brightness, int scale)
+{
+    int font_index = font_index_of(c); // 字形の番号を索引から取得
+    if (font_index == FONT_GLYPH_BLANK)
+    {
+        return; // 空白は何も描かない (背景は透過なので変更領域も増やさない)
+    }
+
+    mark_dirty(buffer, x, y, x + 8 * scale - 1, y + 8 * scale - 1); // 文字の外枠を変更領域として記録
+
+    const glyph_table_t *table = glyph_table_for(scale);
+    if (table != NULL && !(x & 1))
+    {
+        draw_glyph_prescaled(buffer, table, font_index, x, y, brightness);
+        return;
+    }
+
+    for (int row = 0; row < 8; row++) // 8x8 フォントなので、縦に 8 行処理
+    {
+        uint8_t line = font_glyphs[font_index][row]; // 字形の表から、指定された文字の指定された行のデータを取得 (1バイトで 8 ピクセルの情報)
+
+        // 連続して点灯するビットを 1 つの区間にまとめ、拡大後の X 座標の範囲に変換する (8 ビットなので区間は最大 4 つ)
+        int span_start[4];
+        int span_end[4];
+        int spans = 0;
+        for (int col = 0; col < 8;)
+        {
+            if (!(line & (0x80 >> col))) // 左端から順にビットをチェック
+            {
+                col++;
+                continue;
+            }
+            int start = col;
+            while (col < 8 && (line & (0x80 >> col)))
+            {
+                col++;
+            }
+            int x0 = MAX(x + start * scale, 0);                 // 画面の左端で切り取る
+            int x1 = MIN(x + col * scale - 1, DISPLAY_WIDTH - 1); // 画面の右端で切り取る
+            if (x0 <= x1)
+            {
+                span_start[spans] = x0;
+                span_end[spans] = x1;
+                spans++;
+            }
+        }
+        if (spans == 0)
+        {
+            continue;
+        }
+
+        // 同じ区間を縦に scale 行分書き込む (画面の上下で切り取る)
+        int y0 = MAX(y + row * scale, 0);
+        int y1 = MIN(y + row * scale + scale - 1, DISPLAY_HEIGHT - 1);
+        for (int py = y0; py <= y1; py++)
+        {
+            uint8_t *dst = buffer + py * (DISPLAY_WIDTH / 2); // この行の先頭
+            for (int i = 0; i < spans; i++)
+            {
+                fill_span(dst, span_start[i], span_end[i], brightness);
+            }
+        }
+    }
+}
+
+// 指定した座標に文字列を描画する関数
+void draw_string(uint8_t *buffer, const char *str, int x, int y, uint8_t brightness)
+{
+    int scale = 2; // 文字を 2 倍に拡大するスケールを設定
+
+    while (*str && x < DISPLAY_WIDTH) // 文字列の終端 ('\0') か、画面の右端に達するまで繰り返す
+    {
+        draw_char(buffer, *str, x, y, brightness, scale); // 現在の文字を描画
+        x += 8 * scale + 4;
+        // 次の文字を描画する X 座標を 8×scale分、右に移動 (8x8 フォントの幅)
+        // 文字間のスペースを4ピクセル分確保
+        str++;
+        // 文字列の次の文字を指すようにポインタをインクリメント
+    }
+}
+
+/* 図形の描画 */
+// いずれも画面の外にはみ出す部分は切り取り、描いた範囲を変更領域として記録する
+// 横方向はバイト (2 ピクセル) 単位でまとめて書き込み、ニブル単位の処理は奇数の端だけで行う
+
+// 塗りつぶした矩形を描く関数 (左上が (x, y)、幅 w、高さ h)
+void fill_rect(uint8_t *buffer, int x, int y, int w, int h, uint8_t brightness)
+{
+    int x0 = MAX(x, 0);
+    int y0 = MAX(y, 0);
+    int x1 = MIN(x + w - 1, DISPLAY_WIDTH - 1);
+    int y1 = MIN(y + h - 1, DISPLAY_HEIGHT - 1);
+    if (x0 > x1 || y0 > y1)
+    {
+        return; // 画面と重ならない
+    }
+    mark_dirty(buffer, x0, y0, x1, y1);
+
+    if (x0 == 0 && x1 == DISPLAY_WIDTH - 1)
+    {
+        // 画面の幅いっぱいなら行は連続しているので、まとめて 1 回で埋める
+        memset(buffer + y0 * (DISPLAY_WIDTH / 2), (brightness & 0x0F) * 0x11, (y1 - y0 + 1) * (DISPLAY_WIDTH / 2));
+        return;
+    }
+    for (int py = y0; py <= y1; py++)
+    {
+        fill_span(buffer + py * (DISPLAY_WIDTH / 2), x0, x1, brightness);
+    }
+}
+
+// 水平線を描く関数 (X 座標 x0〜x1、両端を含む)
+void draw_hline(uint8_t *buffer, int x0, int x1, int y, uint8_t brightness)
+{
+    if (x0 > x1)
+    {
+        int t = x0;
+        x0 = x1;
+        x1 = t;
+    }
+    fill_rect(buffer, x0, y, x1 - x0 + 1, 1, brightness);
+}
+
+// 垂直線を描く関数 (Y 座標 y0〜y1、両端を含む)。各行の同じニブルだけを書き換える
+void draw_vline(uint8_t *buffer, int x, int y0, int y1, uint8_t brightness)
+{
+    if (y0 > y1)
+    {
+        int t = y0;
+        y0 = y1;
+        y1 = t;
+    }
+    y0 = MAX(y0, 0);
+    y1 = MIN(y1, DISPLAY_HEIGHT - 1);
+    if (x < 0 || x >= DISPLAY_WIDTH || y0 > y1)
+    {
+        return;
+    }
+    mark_dirty(buffer, x, y0, x, y1);
+
+    uint8_t mask = (x & 1) ? 0x0F : 0xF0;                  // 偶数の X はバイトの上位 4 ビット、奇数は下位 4 ビット
+    uint8_t value = ((brightness & 0x0F) * 0x11) & mask;
+    uint8_t *dst = buffer + y0 * (DISPLAY_WIDTH / 2) + x / 2;
+    for (int py = y0; py <= y1; py++)
+    {
+        *dst = (*dst & ~mask) | value;
+        dst += DISPLAY_WIDTH / 2; // 次の行の同じバイトへ
+    }
+}
+
+// 矩形の枠を描く関数 (左上が (x, y)、幅 w、高さ h)
+void draw_rect(uint8_t *buffer, int x, int y, int w, int h, uint8_t brightness)
+{
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+    draw_hline(buffer, x, x + w - 1, y, brightness);
+    if (h > 1)
+    {
+        draw_hline(buffer, x, x + w - 1, y + h - 1, brightness);
+    }
+    if (h > 2)
+    {
+        draw_vline(buffer, x, y + 1, y + h - 2, brightness);
+        if (w > 1)
+        {
+            draw_vline(buffer, x + w - 1, y + 1, y + h - 2, brightness);
+        }
+    }
+}
+
+// 点が画面のどちら側の外にあるかを表すビット (Cohen-Sutherland の領域コード)
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_TOP 4
+#define CLIP_BOTTOM 8
+
+static int clip_code(int x, int y)
+{
+    return (x < 0 ? CLIP_LEFT : 0) | (x >= DISPLAY_WIDTH ? CLIP_RIGHT : 0) |
+           (y < 0 ? CLIP_TOP : 0) | (y >= DISPLAY_HEIGHT ? CLIP_BOTTOM : 0);
+}
+
+// 線分の両端を画面の中まで縮める関数。線分が画面と交わらなければ false を返す
+static bool clip_line(int *x0, int *y0, int *x1, int *y1)
+{
+    int code0 = clip_code(*x0, *y0);
+    int code1 = clip_code(*x1, *y1);
+    while (code0 | code1)
+    {
+        if (code0 & code1)
+        {
+            return false; // 両端が同じ側の外にある
+        }
+        int code = code0 ? code0 : code1; // 外にある方の端を、はみ出している辺との交点へ動かす
+        int64_t dx = *x1 - *x0;
+        int64_t dy = *y1 - *y0;
+        int x, y;
+        if (code & CLIP_TOP)
+        {
+            y = 0;
+            x = *x0 + dx * (0 - *y0) / dy;
+        }
+        else if (code & CLIP_BOTTOM)
+        {
+            y = DISPLAY_HEIGHT - 1;
+            x = *x0 + dx * (DISPLAY_HEIGHT - 1 - *y0) / dy;
+        }
+        else if (code & CLIP_LEFT)
+        {
+            x = 0;
+            y = *y0 + dy * (0 - *x0) / dx;
+        }
+        else
+        {
+            x = DISPLAY_WIDTH - 1;
+            y = *y0 + dy * (DISPLAY_WIDTH - 1 - *x0) / dx;
+        }
+        if (code == code0)
+        {
+            *x0 = x;
+            *y0 = y;
+            code0 = clip_code(x, y);
+        }
+        else
+        {
+            *x1 = x;
+            *y1 = y;
+            code1 = clip_code(x, y);
+        }
+    }
+    return true;
+}
+
+// 線分を描く関数 (両端を含む)。水平線と垂直線はまとめて書き込み、それ以外はブレゼンハムのアルゴリズムで 1 ピクセルずつ描く
+void draw_line(uint8_t *buffer, int x0, int y0, int x1, int y1, uint8_t brightness)
+{
+    if (y0 == y1)
+    {
+        draw_hline(buffer, x0, x1, y0, brightness);
+        return;
+    }
+    if (x0 == x1)
+    {
+        draw_vline(buffer, x0, y0, y1, brightness);
+        return;
+    }
+    if (!clip_line(&x0, &y0, &x1, &y1))
+    {
+        return;
+    }
+    mark_dirty(buffer, MIN(x0, x1), MIN(y0, y1), MAX(x0, x1), MAX(y0, y1));
+
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int step_x = x0 < x1 ? 1 : -1;
+    int step_y = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+    while (true)
+    {
+        set_pixel(buffer, x0, y0, brightness);
+        if (x0 == x1 && y0 == y1)
+        {
+            break;
+        }
+        int e2 = 2 * error;
+        if (e2 >= dy)
+        {
+            error += dy;
+            x0 += step_x;
+        }
+        if (e2 <= dx)
+        {
+            error += dx;
+            y0 += step_y;
+        }
+    }
+}
+
+// 4 ビットグレースケールの画像を (x, y) に描く関数 (画像の内容でそのまま上書きする)
+// 画像はフレームバッファと同じ並び (1 バイトに横 2 ピクセル、上位 4 ビットが左) で、1 行は (w + 1) / 2 バイト
+// x が偶数なら画像とフレームバッファのニブルの位置が揃うので、行の中ほどは memcpy で写す
+void draw_bitmap(uint8_t *buffer, int x, int y, int w, int h, const uint8_t *bitmap)
+{
+    int sx0 = MAX(0, -x);                // 画像の中で描き始める列 (画面の左にはみ出す分を飛ばす)
+    int sx1 = MIN(w, DISPLAY_WIDTH - x); // 画像の中で描き終える列の次
+    int sy0 = MAX(0, -y);
+    int sy1 = MIN(h, DISPLAY_HEIGHT - y);
+    if (sx0 >= sx1 || sy0 >= sy1)
+    {
+        return;
+    }
+    mark_dirty(buffer, x + sx0, y + sy0, x + sx1 - 1, y + sy1 - 1);
+
+    int stride = (w + 1) / 2;
+    for (int sy = sy0; sy < sy1; sy++)
+    {
+        const uint8_t *src = bitmap + sy * stride;
+        uint8_t *dst = buffer + (y + sy) * (DISPLAY_WIDTH / 2);
+        int sx = sx0;
+        if (!(x & 1))
+        {
+            if (sx & 1)
+            {
+                dst[(x + sx) / 2] = (dst[(x + sx) / 2] & 0xF0) | (src[sx / 2] & 0x0F); // 奇数の左端は下位 4 ビットだけ
+                sx++;
+            }
+            int bytes = (sx1 - sx) / 2;
+            memcpy(dst + (x + sx) / 2, src + sx / 2, bytes);
+            sx += bytes * 2;
+            if (sx < sx1)
+            {
+                dst[(x + sx) / 2] = (dst[(x + sx) / 2] & 0x0F) | (src[sx / 2] & 0xF0); // 偶数の右端は上位 4 ビットだけ
+            }
+            continue;
+        }
+        for (; sx < sx1; sx++)
+        {
+            // x が奇数のときはニブルの位置が 1 つずれるので、1 ピクセルずつ入れ替えて書き込む
+            uint8_t value = (sx & 1) ? (src[sx / 2] & 0x0F) : (src[sx / 2] >> 4);
+            int dx = x + sx;
+            uint8_t *d = dst + dx / 2;
+            *d = (dx & 1) ? ((*d & 0xF0) | value) : ((*d & 0x0F) | (value << 4));
+        }
+    }
+}
+
+/* スクロール */
+// SSD1327 の表示開始ライン (0xA1) を動かすと、RAM を書き換えずに画面全体を縦に流せる。
+// フレームバッファはパネルの RAM と同じ並びのまま、新しく画面に現れる行だけを描き直すので、
+// 1 ステップで送るのはその行と数バイトのコマンドだけになる。水平スクロール (0x26/0x27) はパネルが自分で流すので転送が要らない。
+// 設定は面ごとに持ち、その面を送るときにパネルへ反映する (clear_buffer で元に戻る)
+
+// バッファの面の表示設定を返す関数 (フレームバッファ以外なら初期化直後の設定)
+static const panel_state_t *frame_panel_of(const uint8_t *data)
+{
+    ssd1327_t *display;
+    int index = frame_buffer_find(data, &display);
+    return index >= 0 ? &display->frame_panel[index] : &panel_default;
+}
+
+// 画面の Y 座標 y (0〜127) に表示される RAM の行を返す関数。スクロール中の画面に描くときは、描画関数にこの行を渡す
+int scroll_row(const uint8_t *buffer, int y)
+{
+    return (y + frame_panel_of(buffer)->start_line) % DISPLAY_HEIGHT;
+}
+
+// 画面全体を縦に rows 行流す関数 (正なら上へ、負なら下へ)
+// 反対側の端に新しく現れる行は background で塗りつぶし、変更領域として記録する (呼び出し側はそこに続きを描く)
+void scroll_vertical(uint8_t *buffer, int rows, uint8_t background)
+{
+    ssd1327_t *display;
+    int index = frame_buffer_find(buffer, &display);
+    if (index < 0 || rows == 0)
+    {
+        return; // フレームバッファ以外は開始ラインを持たない
+    }
+    rows = MAX(-DISPLAY_HEIGHT, MIN(rows, DISPLAY_HEIGHT));
+
+    display->frame_panel[index].start_line = (display->frame_panel[index].start_line + rows + DISPLAY_HEIGHT) % DISPLAY_HEIGHT;
+    int first = rows > 0 ? DISPLAY_HEIGHT - rows : 0; // 新しく現れた行の画面上の Y 座標
+    for (int i = 0; i < abs(rows); i++)
+    {
+        fill_rect(buffer, 0, scroll_row(buffer, first + i), DISPLAY_WIDTH, 1, background); // 隣り合う行の変更領域は 1 つの矩形にまとまる
+    }
+}
+
+// RAM の行 row0〜row1 をパネルの水平スクロールで横に流し続ける関数 (left が true なら左へ、interval は panel_state_t を参照)
+// 流している間は何も送らずに済むが、パネルの RAM の内容そのものがずれていくので、止めるときにその行を送り直す
+void scroll_horizontal_start(uint8_t *buffer, int row0, int row1, bool left, uint8_t interval)
+{
+    ssd1327_t *display;
+    int index = frame_buffer_find(buffer, &display);
+    row0 = MAX(row0, 0);
+    row1 = MIN(row1, DISPLAY_HEIGHT - 1);
+    if (index < 0 || row0 > row1)
+    {
+        return;
+    }
+    display->frame_panel[index].hscroll = true;
+    display->frame_panel[index].hscroll_command = left ? 0x27 : 0x26;
+    display->frame_panel[index].hscroll_row0 = row0;
+    display->frame_panel[index].hscroll_row1 = row1;
+    display->frame_panel[index].hscroll_interval = interval & 0x07;
+}
+
+// 水平スクロールを止める関数 (止めた行はこの面を送るときに送り直される)
+void scroll_horizontal_stop(uint8_t *buffer)
+{
+    ssd1327_t *display;
+    int index = frame_buffer_find(buffer, &display);
+    if (index >= 0)
+    {
+        display->frame_panel[index].hscroll = false;
+    }
+}
+
+/* 明るさ (フェード) */
+// パネルのコントラスト (0x81) とグレースケール表 (0xB8) で画面全体の明るさを変える。表示データは書き換えないので、
+// フェードの 1 ステップで送るのは数バイトのコマンドだけになる (全体を描き直して送ると 8 KB)。設定は面ごとに持ち、その面を送るときにパネルへ反映する
+
+// ガンマ 2.2 のグレースケール表 (0xB8 の GS1〜GS15)。階調 n (0〜15) の明るさを (n / 15)^2.2 に比例させる
+// 既定の線形の表のままでは中間の階調が明るすぎて、画像が白っぽく見える。表は単調増加でなければならないので、暗い側は 1 ずつ増やしてある
+const uint8_t ssd1327_gray_gamma22[SSD1327_GRAY_LEVELS] = {1, 2, 3, 4, 6, 8, 12, 16, 20, 26, 32, 39, 46, 54, 63};
+
+// buffer の面を表示するときのコントラストを設定する関数
+void display_set_contrast(uint8_t *buffer, uint8_t contrast)
+{
+    ssd1327_t *display;
+    int index = frame_buffer_find(buffer, &display);
+    if (index >= 0)
+    {
+        display->frame_panel[index].contrast = contrast;
+    }
+}
+
+// buffer の面を表示するときのグレースケール表を設定する関数 (NULL なら線形の表。表は const の配列を渡し、中身を書き換えないこと)
+void display_set_gray_table(uint8_t *buffer, const uint8_t *table)
+{
+    ssd1327_t *display;
+    int index = frame_buffer_find(buffer, &display);
+    if (index >= 0)
+    {
+        display->frame_panel[index].gray_table = table;
+    }
+}
+
+// 整数の平方根 (切り捨て) を返す関数
+static uint32_t isqrt(uint32_t value)
+{
+    uint32_t root = 0;
+    for (uint32_t bit = 1u << 30; bit != 0; bit >>= 2)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+// フェードの step 段目 (0〜steps) のコントラストを返す関数 (0 段目が from、steps 段目が to)
+// 目に見える明るさはコントラストのおおよそ平方根に比例するので、平方根をとった値を等間隔に進めてから 2 乗して戻す
+uint8_t fade_contrast(uint8_t from, uint8_t to, uint32_t step, uint32_t steps)
+{
+    if (steps == 0 || step >= steps)
+    {
+        return to;
+    }
+    int32_t a = isqrt((uint32_t)from << 16); // 知覚上の明るさ (256 倍した平方根)
+    int32_t b = isqrt((uint32_t)to << 16);
+    int32_t level = a + (b - a) * (int32_t)step / (int32_t)steps;
+    return (uint8_t)MIN(255, (level * level + (1 << 15)) >> 16);
+}
+
+/* 画像 */
+// 圧縮画像 (images.h) はパネルへ送るときに ssd1327_show_image_async で展開しながら送れるので、普通はバッファに展開しない。
+// 画像の上に文字を重ねるときなど、フレームバッファに描きたいときだけ image_draw を使う
+
+// 圧縮画像 image の frame 番目のフレームのウィンドウをバッファに展開する関数
+// frame が 1 以上なら、バッファには直前のフレーム (frame - 1) が描かれていること
+void image_draw(uint8_t *buffer, const image_t *image, int frame)
+{
+    const image_frame_t *entry = &image->frames[frame];
+    if (entry->x0 > entry->x1)
+    {
+        return; // 直前のフレームと同じ
+    }
+    int row_bytes = (entry->x1 - entry->x0 + 1) / 2;
+    image_decoder_t decoder;
+    image_decoder_begin(&decoder, image->data + entry->offset, row_bytes);
+    for (int y = entry->y0; y <= entry->y1; y++)
+    {
+        uint8_t *row = buffer + (y * DISPLAY_WIDTH + entry->x0) / 2;
+        for (int i = 0; i < row_bytes; i++)
+        {
+            row[i] = image_decoder_next(&decoder);
+        }
+    }
+    mark_dirty(buffer, entry->x0, entry->y0, entry->x1, entry->y1);
+}
+
+/* ディザリング (8 ビット → 4 ビット) */
+// 写真やグラデーションのような 8 ビットのグレースケール画像を、4x4 のベイヤー行列による組織的ディザで 16 階調に減らす。
+// 階調 = (明るさ * 241 + しきい値 * 256 + 128) >> 12 で、明るさ 0 は必ず 0、255 は必ず 15 になる。
+// 途中の値は最大 65423 で 16 ビットに収まるので、32 ビット語に 2 ピクセルずつ並べて 1 回の掛け算で 2 ピクセル分を計算する。
+// tools/pack_images.py の --dither も同じ式と行列を使うので、ビルド時に変換した画像と実行時に変換した画像は一致する
+
+// 4x4 のベイヤー行列 (画面の座標 (x, y) のしきい値は dither_bayer4[y & 3][x & 3])
+static const uint8_t dither_bayer4[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+// 8 ビットの明るさ gray の 1 行 (width ピクセル) を、画面の座標 (x, y) から始まる行としてディザをかけ、
+// set_pixel と同じ並び (1 バイトに横 2 ピクセル、上位 4 ビットが左) で dst に詰める関数。width が奇数なら最後のバイトの下位 4 ビットは 0
+void dither_row(uint8_t *dst, const uint8_t *gray, int width, int x, int y)
+{
+    const uint8_t *bayer = dither_bayer4[y & 3];
+    // 4 ピクセルを 1 語に読み、偶数番目 (0, 2) と奇数番目 (1, 3) をそれぞれ 16 ビットずつの 2 レーンに分けて計算する
+    uint32_t bias_even = (bayer[x & 3] * 256u + 128) | (bayer[(x + 2) & 3] * 256u + 128) << 16;
+    uint32_t bias_odd = (bayer[(x + 1) & 3] * 256u + 128) | (bayer[(x + 3) & 3] * 256u + 128) << 16;
+    int i = 0;
+    for (; i + 4 <= width; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, gray + i, 4);                          // p0 | p1 << 8 | p2 << 16 | p3 << 24 (リトルエンディアン)
+        uint32_t even = (word & 0x00ff00ffu) * 241 + bias_even; // p0 と p2 の階調 (各レーンの 12〜15 ビット目)
+        uint32_t odd = ((word >> 8) & 0x00ff00ffu) * 241 + bias_odd;
+        uint32_t packed = ((even >> 8) & 0x00f000f0u) | ((odd >> 12) & 0x000f000fu); // 各レーンの下位 8 ビットが p0p1 と p2p3 のバイト
+        dst[i / 2] = packed;
+        dst[i / 2 + 1] = packed >> 16;
+    }
+    for (; i < width; i++)
+    {
+        uint8_t level = (gray[i] * 241 + bayer[(x + i) & 3] * 256 + 128) >> 12; // 4 ピクセルに満たない右端
+        dst[i / 2] = (i & 1) ? (dst[i / 2] | level) : (level << 4);
+    }
+}
+
+// 8 ビットのグレースケール画像 (w x h、1 行 stride バイト) にディザをかけて、左上を (x, y) としてバッファに描く関数 (画面外は切り取る)
+void draw_gray8(uint8_t *buffer, int x, int y, int w, int h, const uint8_t *gray, int stride)
+{
+    int sx0 = MAX(0, -x); // 画像の中で描き始める列
+    int sx1 = MIN(w, DISPLAY_WIDTH - x);
+    if (sx0 >= sx1)
+    {
+        return;
+    }
+    uint8_t row[DISPLAY_WIDTH / 2]; // ディザをかけた 1 行
+    for (int sy = MAX(0, -y); sy < MIN(h, DISPLAY_HEIGHT - y); sy++)
+    {
+        dither_row(row, gray + sy * stride + sx0, sx1 - sx0, x + sx0, y + sy);
+        draw_bitmap(buffer, x + sx0, y + sy, sx1 - sx0, 1, row); // 隣り合う行の変更領域は 1 つの矩形にまとまる
+    }
+}
+
+#ifdef LCD_BENCHMARK
+// 文字の 1 ドットを指定サイズに拡大して描画する関数 (以前の描画方法。変更領域は記録しない)
+static void draw_char_scaled(uint8_t *buffer, int x, int y, int col, int row, uint8_t brightness, int scale)
+{
+    for(int y_offset = 0; y_offset < scale; y_offset++)     // 縦方向の拡大
+    
+    {
+        for(int x_offset = 0; x_offset < scale; x_offset++) // 横方向の拡大
+        {   
+            // 拡大された座標を計算して、指定されたピクセルの明るさを設定
+            set_pixel(buffer, (x + col * scale )+ x_offset, (y + row * scale) + y_offset, brightness);  
+        }
+    }
+}
+
+// 以前の描画方法 (1 ピクセルずつ set_pixel 相当の書き込みを行う) で 1 文字を描画する関数。ベンチマークの比較用
+static void draw_char_per_pixel(uint8_t *buffer, char c, int x, int y, uint8_t brightness, int scale)
+{
+    int font_index = font_index_of(c);
+    if (font_index == FONT_GLYPH_BLANK)
+    {
+        return;
+    }
+    for (int row = 0; row < 8; row++)
+    {
+        uint8_t line = font_glyphs[font_index][row];
+        for (int col = 0; col < 8; col++)
+        {
+            if (line & (1 << (7 - col)))
+            {
+                draw_char_scaled(buffer, x, y, col, row, brightness, scale);
+            }
+        }
+    }
+}
+
+// 文字列を scale 倍で描画する関数 (draw_string と同じ文字送り)。per_pixel が true なら以前の描画方法を使う
+static void benchmark_draw_string(uint8_t *buffer, const char *str, int x, int y, int scale, bool per_pixel)
+{
+    for (; *str && x < DISPLAY_WIDTH; str++, x += 8 * scale + 4)
+    {
+        if (per_pixel)
+        {
+            draw_char_per_pixel(buffer, *str, x, y, 15, scale);
+        }
+        else
+        {
+            draw_char(buffer, *str, x, y, 15, scale);
+        }
+    }
+}
+
+// main() が描画する文字列とスケールで、以前の描画方法と新しい描画方法の速度を比べる関数
+// 結果は標準出力 (USB シリアル) に表示する。描画結果が一致しない場合もその旨を表示する
+static void benchmark_glyph_blitter()
+{
+    static uint8_t old_buffer[DISPLAY_DATA_SIZE]; // フレームバッファ以外に描くので変更領域は記録されない
+    static uint8_t new_buffer[DISPLAY_DATA_SIZE];
+    const struct
+    {
+        const char *str;
+        int x, y, scale;
+    } cases[] = {
+        {"3", 32, 32, 8},
+        {"2", 32, 32, 8},
+        {"1", 32, 32, 8},
+        {"HAPPY", 14, 18, 2},
+        {"BIRTH", 14, 56, 2},
+        {"DAY\x03", 26, 94, 2},
+        {"NAGOMI", 6, 56, 2},
+    };
+    const int iterations = 100; // 1 ケースあたりの繰り返し回数
+
+    printf("glyph blitter benchmark (%d iterations)\n", iterations);
+    for (size_t i = 0; i < count_of(cases); i++)
+    {
+        memset(old_buffer, 0, sizeof(old_buffer));
+        memset(new_buffer, 0, sizeof(new_buffer));
+
+        uint64_t start = time_us_64();
+        for (int n = 0; n < iterations; n++)
+        {
+            benchmark_draw_string(old_buffer, cases[i].str, cases[i].x, cases[i].y, cases[i].scale, true);
+        }
+        uint64_t old_us = time_us_64() - start;
+
+        start = time_us_64();
+        for (int n = 0; n < iterations; n++)
+        {
+            benchmark_draw_string(new_buffer, cases[i].str, cases[i].x, cases[i].y, cases[i].scale, false);
+        }
+        uint64_t new_us = time_us_64() - start;
+
+        printf("  \"%s\" x%d: per-pixel %llu us, draw_char %llu us%s\n", cases[i].str, cases[i].scale,
+               (unsigned long long)old_us, (unsigned long long)new_us,
+               memcmp(old_buffer, new_buffer, DISPLAY_DATA_SIZE) == 0 ? "" : " (MISMATCH)");
+    }
 }
 
-// SSD1327 にデータを送信する関数
-static void ssd1327_send_data(uint8_t data)
+// 図形の描画関数と、同じ図形を set_pixel で 1 ピクセルずつ描いた場合の速度を比べる関数
+static void benchmark_primitives()
 {
-    uint8_t buffer[2] = {0x40, data};
-    // 送信するデータバッファを作成。最初のバイト 0x40 はデータであることを示す制御バイト
-    i2c_write_blocking(i2c, SSD1327_ADDR, buffer, 2, false); // I2C デバイスにバッファの内容 (2バイト) を送信
-}
+    static uint8_t old_buffer[DISPLAY_DATA_SIZE];
+    static uint8_t new_buffer[DISPLAY_DATA_SIZE];
+    const struct
+    {
+        const char *name;
+        int x, y, w, h;
+    } cases[] = {
+        {"full screen", 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT},
+        {"bar 101x12 (odd edges)", 13, 40, 101, 12},
+        {"gauge 8x100", 60, 14, 8, 100},
+        {"clipped 60x60", 100, -20, 60, 60},
+    };
+    const int iterations = 100;
 
-// SSD1327 の描画範囲 (ウィンドウ) を設定する関数
-static void ssd1327_set_window(uint16_t X_start, uint16_t Y_start, uint16_t X_end, uint16_t Y_end)
-{
-    // 引数として渡された座標がディスプレイの範囲を超えていないかチェック
-    if (X_start >= DISPLAY_WIDTH || Y_start >= DISPLAY_HEIGHT ||
-        X_end >= DISPLAY_WIDTH || Y_end >= DISPLAY_HEIGHT)
+    printf("primitive benchmark (%d iterations)\n", iterations);
+    for (size_t i = 0; i < count_of(cases); i++)
     {
-        return; // 範囲外の場合は何もせずに関数を終了
-    }
+        memset(old_buffer, 0, sizeof(old_buffer));
+        memset(new_buffer, 0, sizeof(new_buffer));
+
+        uint64_t start = time_us_64();
+        for (int n = 0; n < iterations; n++)
+        {
+            for (int py = cases[i].y; py < cases[i].y + cases[i].h; py++)
+            {
+                for (int px = cases[i].x; px < cases[i].x + cases[i].w; px++)
+                {
+                    set_pixel(old_buffer, px, py, 9);
+                }
+            }
+        }
+        uint64_t old_us = time_us_64() - start;
+
+        start = time_us_64();
+        for (int n = 0; n < iterations; n++)
+        {
+            fill_rect(new_buffer, cases[i].x, cases[i].y, cases[i].w, cases[i].h, 9);
+        }
+        uint64_t new_us = time_us_64() - start;
 
-    // コラム (X軸) アドレスの設定
-    ssd1327_send_command(0x15);
-    // コラムアドレス設定コマンドを送信
-    ssd1327_send_command(X_start / 2); // 開始 X 座標を 2 で割った値を送信 (SSD1327 は 2 ピクセル単位でアドレスを指定する)
-    ssd1327_send_command(X_end / 2);
-    // 終了 X 座標を 2 で割った値を送信
+        printf("  %s: set_pixel %llu us, fill_rect %llu us%s\n", cases[i].name,
+               (unsigned long long)old_us, (unsigned long long)new_us,
+               memcmp(old_buffer, new_buffer, DISPLAY_DATA_SIZE) == 0 ? "" : " (MISMATCH)");
+    }
 
-    // ロウ (Y軸) アドレスの設定
-    ssd1327_send_command(0x75);
-    // ロウアドレス設定コマンドを送信
-    ssd1327_send_command(Y_start); // 開始 Y 座標を送信
-    ssd1327_send_command(Y_end);
-    // 終了 Y 座標を送信
+    uint64_t start = time_us_64();
+    for (int n = 0; n < iterations; n++)
+    {
+        memset(new_buffer, 0x99, sizeof(new_buffer));
+    }
+    printf("  memset of a full frame: %llu us\n", (unsigned long long)(time_us_64() - start));
 }
 
-// SSD1327 を初期化する関数
-static void ssd1327_init()
+// 8 ビットのグレースケール画像にディザをかける速さを、1 ピクセルずつ set_pixel で書き込む方法と比べる関数
+static void benchmark_dither()
 {
-    // SSD1327 の初期化シーケンス (データシートに記載されている初期設定)
-    ssd1327_send_command(0xae); // ディスプレイをオフにする (スリープモード ON)
+    static uint8_t gray[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    static uint8_t old_buffer[DISPLAY_DATA_SIZE];
+    static uint8_t new_buffer[DISPLAY_DATA_SIZE];
+    const int iterations = 100;
 
-    // コラムアドレス設定
-    ssd1327_send_command(0x15); // コラムアドレス設定コマンド
-    ssd1327_send_command(0x00); // 開始コラムアドレス (0)
-    ssd1327_send_command(0x7f); // 終了コラムアドレス (127)
+    for (int y = 0; y < DISPLAY_HEIGHT; y++)
+    {
+        for (int x = 0; x < DISPLAY_WIDTH; x++)
+        {
+            gray[y * DISPLAY_WIDTH + x] = (x * 2 + y) * 255 / (DISPLAY_WIDTH * 2 + DISPLAY_HEIGHT - 3); // 斜めのグラデーション
+        }
+    }
 
-    // ロウアドレス設定
-    ssd1327_send_command(0x75); // ロウアドレス設定コマンド
-    ssd1327_send_command(0x00); // 開始ロウアドレス (0)
-    ssd1327_send_command(0x7f); // 終了ロウアドレス (127)
+    uint64_t start = time_us_64();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++)
+        {
+            for (int x = 0; x < DISPLAY_WIDTH; x++)
+            {
+                set_pixel(old_buffer, x, y, (gray[y * DISPLAY_WIDTH + x] * 241 + dither_bayer4[y & 3][x & 3] * 256 + 128) >> 12);
+            }
+        }
+    }
+    uint64_t old_us = time_us_64() - start;
 
-    // コントラスト設定
-    ssd1327_send_command(0x81); // コントラスト設定コマンド
-    ssd1327_send_command(0x80); // コントラスト値 (0x80 は中間的な明るさ)
+    start = time_us_64();
+    for (int n = 0; n < iterations; n++)
+    {
+        draw_gray8(new_buffer, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, gray, DISPLAY_WIDTH);
+    }
+    uint64_t new_us = time_us_64() - start;
 
-    // セグメントリマップ (表示の左右反転)
-    ssd1327_send_command(0xa0); // セグメントリマップ設定コマンド
-    ssd1327_send_command(0x51); // リマップ設定 (0x51 で左右反転。必要に応じて変更)
+    uint64_t pixels = (uint64_t)iterations * DISPLAY_WIDTH * DISPLAY_HEIGHT;
+    printf("dither benchmark (%d full frames)\n", iterations);
+    printf("  set_pixel %llu us (%.2f Mpixel/s), draw_gray8 %llu us (%.2f Mpixel/s)%s\n",
+           (unsigned long long)old_us, old_us ? (double)pixels / old_us : 0.0,
+           (unsigned long long)new_us, new_us ? (double)pixels / new_us : 0.0,
+           memcmp(old_buffer, new_buffer, DISPLAY_DATA_SIZE) == 0 ? "" : " (MISMATCH)");
+}
+#endif
 
-    // スタートライン設定
-    ssd1327_send_command(0xa1); // スタートライン設定コマンド
-    ssd1327_send_command(0x00); // スタートライン (通常は 0)
+void draw_countdown(uint8_t *buffer, char c)
+{
+   // 表示バッファを毎回クリア
+    clear_buffer(buffer); // 前のフレームで描いた領域だけが次の送信対象になる
 
-    // 表示オフセット設定
-    ssd1327_send_command(0xa2); // 表示オフセット設定コマンド
-    ssd1327_send_command(0x00); // オフセット値 (通常は 0)
+    int scale = 8; //　文字を8倍に拡大
+    draw_char(buffer, c, 32, 32, 15, scale); // 指定された文字をバッファに描画。指定座標 (32, 32) に、明るさ 15 で描画
+    
+}
 
-    // 全画面表示オン/オフ (反転表示)
-    ssd1327_send_command(0xa4); // 全画面表示オフ (通常表示モード)
+/* フレームスケジューラ */
 
-    // マルチプレックス比設定 (表示ライン数)
-    ssd1327_send_command(0xa8); // マルチプレックス比設定コマンド
-    ssd1327_send_command(0x7f); // 128 ライン (0x7F は 127 を意味し、0 から数えるので 128 ライン)
+// 1 つの場面 (シーン) を描画する関数の型。渡されたバッファに、場面の frame フレーム目 (0 から数える) を描く
+// 動く場面の状態は frame から決め、関数の中に持たない (パネルが複数あると、同じフレームを各パネルの分だけ描くため)
+typedef void (*scene_render_t)(uint8_t *buffer, uint32_t frame);
 
-    // マスターコンフィグレーション
-    ssd1327_send_command(0xad);
-    ssd1327_send_command(0x02);
+// 場面表の 1 行：描画関数と表示時間
+typedef struct
+{
+    scene_render_t render; // 場面を描画する関数
+    uint32_t duration_ms;  // この場面を表示しておく時間 (ms)。repeat が 2 以上なら 1 フレームあたりの時間
+    uint32_t repeat;       // この場面を続けて描くフレーム数 (0 と 1 は 1 フレーム)。スクロールのように少しずつ動く場面に使う
+    const image_t *image;  // NULL でなければ render の代わりに、この圧縮画像の全フレームを順に送る (フレームバッファを使わない)
+} scene_t;
+// repeat が 1 の場面は、前のフレームの内容によらず毎回同じフレームを描くこと (clear_buffer から描き始める)。
+// 同じ場面が続いたときや、覚えている場面の切り替わりでは描画を省くため。repeat が 2 以上の場面は毎回描く
 
-    // 電源制御
-    ssd1327_send_command(0xb0);
-    ssd1327_send_command(0x0b);
+// フレームごとの処理時間の統計
+typedef struct
+{
+    uint32_t frames;           // 表示したフレーム数
+    uint32_t missed_deadlines; // 次のフレームの描画が表示期限に間に合わなかった回数
+    uint32_t render_skipped;   // 直前のフレームと同じ場面だったか、キャッシュから差分を戻したため描画を省いた回数
+    uint32_t lateness_us;      // 直前のフレームを表示期限からどれだけ遅れて送り始めたか
+    uint32_t wait_us;          // 直前のフレームで、前のフレームの転送完了を待った時間
+    uint32_t render_us;        // 直前のフレームの描画にかかった時間
+    uint32_t render_max_us;    // 描画にかかった時間の最大値
+    uint32_t transfer_us;      // 直前に完了した転送にかかった時間
+    uint32_t transfer_max_us;  // 転送にかかった時間の最大値
+} frame_stats_t;
 
-    // 位相長設定
-    ssd1327_send_command(0xb1);
-    ssd1327_send_command(0xf1);
+frame_stats_t frame_stats;                     // フレームスケジューラの統計
+static volatile bool frame_due = false;        // 表示期限が来たら割り込みで true になる
+static volatile uint64_t transfer_start_us;    // 直前の転送を始めた時刻
+static volatile uint64_t transfer_done_us;     // 直前の転送が完了した時刻 (転送完了の割り込みで記録)
+static scene_render_t frame_scene[LCD_PANEL_COUNT][FRAME_BUFFER_COUNT]; // 各パネルの各面の内容を描いた場面 (毎回内容が変わる場面や、分からなければ NULL)
 
-    // 表示イネーブル (リセット)
-    ssd1327_send_command(0xab);
-    ssd1327_send_command(0x01);
+#ifdef LCD_FRAME_CACHE
+// 覚えておく場面の切り替わり 1 つ分：場面 previous のフレームから場面 scene のフレームへの差分
+typedef struct
+{
+    scene_render_t previous; // 直前のフレームの場面
+    scene_render_t scene;    // このフレームの場面
+    rect_list_t delta;       // 直前のフレームから内容が変わる領域 (実際に違う行だけ)
+    rect_list_t content;     // このフレームで描画済みの領域
+    panel_state_t panel;     // このフレームの表示設定 (スクロールと明るさ)
+    uint32_t offset;         // 変わる領域の表示データを frame_cache_pool に置いた位置
+} frame_delta_t;
 
-    // プリチャージ電流設定
-    ssd1327_send_command(0xbc);
-    ssd1327_send_command(0x3f);
+static frame_delta_t frame_cache[FRAME_CACHE_ENTRIES]; // 覚えている場面の切り替わり
+static int frame_cache_count;                          // frame_cache に入っている数
+static uint8_t frame_cache_pool[FRAME_CACHE_POOL_SIZE]; // 差分の表示データ (各矩形の行を順に詰めたもの)
+static uint32_t frame_cache_used;                      // frame_cache_pool の使用済みバイト数
+#endif
 
-    // VCOMH レベル設定
-    ssd1327_send_command(0xbe);
-    ssd1327_send_command(0x0f);
+// 表示期限のアラーム割り込み：フラグを立ててメインループを起こす
+static int64_t frame_alarm_callback(alarm_id_t id, void *user_data)
+{
+    (void)id;
+    (void)user_data;
+    frame_due = true;
+    __sev(); // __wfe() で待っているメインループを起こす
+    return 0; // 繰り返さない (次の期限は絶対時刻で設定し直す)
+}
 
-    // クロック設定
-    ssd1327_send_command(0xd5); // 表示クロック制御の設定コマンド
-    ssd1327_send_command(0x62); // クロック設定値
+// 転送完了のコールバック (割り込みの中から呼ばれる)：転送時間を記録する (パネルが複数なら、最後に送り終えたパネルまでの時間になる)
+static void frame_transfer_done(ssd1327_t *display, const uint8_t *data)
+{
+    (void)display; // どのパネルの転送でも、最後に終わった時刻を記録する
+    (void)data;
+    transfer_done_us = time_us_64();
+    uint32_t elapsed = transfer_done_us - transfer_start_us;
+    frame_stats.transfer_us = elapsed;
+    frame_stats.transfer_max_us = MAX(frame_stats.transfer_max_us, elapsed);
+}
 
-    // コントラスト微調整
-    ssd1327_send_command(0x87);
-    ssd1327_send_command(0x0f);
+// 表示期限までハードウェアアラームで待つ関数 (待っている間はスリープする)
+// アラームの空きがなければ、スリープせずに期限まで待つ
+static void frame_wait_until(absolute_time_t deadline)
+{
+    frame_due = false;
+    if (add_alarm_at(deadline, frame_alarm_callback, NULL, true) < 0) // 期限を過ぎていればすぐに割り込みが入る
+    {
+        busy_wait_until(deadline);
+        return;
+    }
+    while (!frame_due)
+    {
+        __wfe();
+    }
+}
 
-    ssd1327_send_command(0xAF); // ディスプレイをオンにする (スリープモード OFF)
+// 場面のフレーム数を返す関数
+static uint32_t scene_frames(const scene_t *scene)
+{
+    return scene->image != NULL ? scene->image->frame_count : MAX(scene->repeat, 1);
 }
 
-// バッファの内容を SSD1327 に送信して表示する関数
-static void ssd1327_set_display(uint8_t *data)
+// 場面表の index 行目を repeat 回目まで描いたら次の行へ進める関数 (描いた回数は *repeat に数える)
+static int scene_advance(const scene_t *scenes, int count, int index, uint32_t *repeat)
 {
-    const int32_t data_length = DISPLAY_DATA_SIZE + 1; // 送信するデータ長は、表示データサイズに制御バイト (0x40) の 1 バイトを加えたもの
-    uint8_t buffer[data_length];
-    // 送信するデータを格納するローカルなバッファ
-    buffer[0] = 0x40;
-    // 最初のバイトはデータであることを示す制御バイト (0x40)
-    for (int i = 0; i < DISPLAY_DATA_SIZE; i++)
+    if (++*repeat < scene_frames(&scenes[index]))
     {
-        buffer[i + 1] = data[i];
-        // グローバルな表示バッファの内容を、送信用のバッファにコピー
+        return index; // 同じ場面の次のフレーム
     }
-    ssd1327_set_window(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);   // ディスプレイ全体の書き込み範囲を設定
-    i2c_write_blocking(i2c, SSD1327_ADDR, buffer, data_length, false); // I2C でディスプレイにデータを送信
+    *repeat = 0;
+    return (index + 1) % count;
 }
 
-// 指定した座標のピクセルの明るさを設定する関数 (4ビットグレースケール：0〜15 の値で明るさを指定)
-void set_pixel(uint8_t *buffer, int x, int y, uint8_t brightness)
+#ifdef LCD_FRAME_CACHE
+// 矩形のリストの各行を、フレームバッファとキャッシュの間でコピーする関数 (to_cache が true ならキャッシュへ)
+static void frame_cache_copy(const rect_list_t *rects, uint8_t *pixels, uint8_t *cache, bool to_cache)
 {
-    int index = (y * DISPLAY_WIDTH + x) / 2; // 指定された x, y 座標に対応するバッファ内のインデックスを計算
-                                             // SSD1327 は横方向に 2 ピクセルで 1 バイトを扱うため、インデックスを 2 で割る
-    if (x % 2 == 0)
+    for (int r = 0; r < rects->count; r++)
     {
-        // x が偶数の場合、そのピクセルはバイトの上位 4 ビットに対応
-        buffer[index] = (buffer[index] & 0x0F) | (brightness << 4); // 元の下位 4 ビットを保持し、上位 4 ビットを新しい明るさで更新
+        const rect_t *rect = &rects->rects[r];
+        int row_bytes = (rect->x1 - rect->x0 + 1) / 2;
+        for (int y = rect->y0; y <= rect->y1; y++)
+        {
+            uint8_t *row = pixels + (y * DISPLAY_WIDTH + rect->x0) / 2;
+            memcpy(to_cache ? cache : row, to_cache ? row : cache, row_bytes);
+            cache += row_bytes;
+        }
     }
-    else
+}
+
+// 場面 previous から場面 scene への切り替わりを覚えていれば、差分をパネル display の面 index に書き戻して true を返す関数
+// 面は直前のフレーム (場面 previous) と同じ内容にそろえてあるので、差分を書き戻すと場面 scene を描いたのと同じ内容になる
+// 場面の内容はパネルによらないので、キャッシュはすべてのパネルで共有する (1 枚目で覚えた差分を 2 枚目以降でも使える)
+static bool frame_cache_restore(ssd1327_t *display, scene_render_t previous, scene_render_t scene, int index)
+{
+    for (int i = 0; i < frame_cache_count; i++)
     {
-        // x が奇数の場合、そのピクセルはバイトの下位 4 ビットに対応
-        buffer[index] = (buffer[index] & 0xF0) | (brightness & 0x0F); // 元の上位 4 ビットを保持し、下位 4 ビットを新しい明るさで更新
+        const frame_delta_t *entry = &frame_cache[i];
+        if (entry->previous != previous || entry->scene != scene)
+        {
+            continue;
+        }
+        frame_cache_copy(&entry->delta, display->frame_buffers[index].pixels, frame_cache_pool + entry->offset, false);
+        display->dirty_rects[index] = entry->delta; // 差分は実際に違う行だけなので、そのまま送る領域になる
+        display->content_rects[index] = entry->content;
+        display->frame_panel[index] = entry->panel;
+        return true;
     }
+    return false;
 }
 
-//文字を指定サイズに拡大して描画する関数
-void draw_char_scaled(uint8_t *buffer, int x, int y, int col, int row, uint8_t brightness, int scale)
+// 場面 previous から場面 scene に切り替えて描いたパネル display の面 index の差分を覚える関数
+static void frame_cache_store(ssd1327_t *display, scene_render_t previous, scene_render_t scene, int index)
 {
-    for(int y_offset = 0; y_offset < scale; y_offset++)     // 縦方向の拡大
-    
+    frame_buffer_trim_dirty(display, index); // 覚える差分は実際に違う行だけにする (この後の frame_buffer_submit でもう一度調べるが、すぐ終わる)
+
+    uint32_t size = 0;
+    for (int r = 0; r < display->dirty_rects[index].count; r++)
     {
-        for(int x_offset = 0; x_offset < scale; x_offset++) // 横方向の拡大
-        {   
-            // 拡大された座標を計算して、指定されたピクセルの明るさを設定
-            set_pixel(buffer, (x + col * scale )+ x_offset, (y + row * scale) + y_offset, brightness);  
-        }
+        const rect_t *rect = &display->dirty_rects[index].rects[r];
+        size += (rect->x1 - rect->x0 + 1) / 2 * (rect->y1 - rect->y0 + 1);
+    }
+    if (frame_cache_count == FRAME_CACHE_ENTRIES || frame_cache_used + size > FRAME_CACHE_POOL_SIZE)
+    {
+        frame_cache_count = 0; // いっぱいになったら空にして覚え直す (繰り返す場面の並びなら、一巡で覚え直せる)
+        frame_cache_used = 0;
+    }
+    if (size > FRAME_CACHE_POOL_SIZE)
+    {
+        return; // 差分が大きすぎて覚えられない
     }
+
+    frame_delta_t *entry = &frame_cache[frame_cache_count++];
+    *entry = (frame_delta_t){previous, scene, display->dirty_rects[index], display->content_rects[index], display->frame_panel[index], frame_cache_used};
+    frame_cache_copy(&entry->delta, display->frame_buffers[index].pixels, frame_cache_pool + entry->offset, true);
+    frame_cache_used += size;
 }
+#endif
 
-// 指定した座標に 1 文字を描画する関数
-void draw_char(uint8_t *buffer, char c, int x, int y, uint8_t brightness, int scale)
+// 場面の frame フレーム目を描画先 buffer に描く関数
+// 描画先の面は直前のフレームと同じ内容から始まるので、直前と同じ場面なら何もしなくてよい (変更領域も空なので何も送られない)。
+// LCD_FRAME_CACHE を有効にすると、前に見た場面の切り替わりは描かずに差分を書き戻す
+static void scene_render(const scene_t *scene, uint8_t *buffer, uint32_t frame)
 {
-    int font_index = -1; // フォント配列のインデックスを初期化
+    ssd1327_t *display;
+    int index = frame_buffer_find(buffer, &display);
+    int latest = index >= 0 ? display->latest_frame : -1;
+    bool animated = scene->repeat > 1; // 描くたびに内容が変わる場面
+    scene_render_t *scene_of = index >= 0 ? frame_scene[display->number] : NULL; // そのパネルの各面を描いた場面
+    scene_render_t previous = latest >= 0 ? scene_of[latest] : NULL;
 
-    // 描画する文字が数字かアルファベットかを判定し、フォント配列の対応するインデックスを取得
-    if (c >= '0' && c <= '9')  
+    if (scene->image != NULL)
     {
-        font_index = c - '0'; // 数字をインデックス (0〜9) に変換
+        return; // 画像の場面は描かない (送るときにフラッシュから展開する)
     }
-    else if (c >= 'A' && c <= 'Z')
+    if (index < 0)
     {
-        font_index = c - 'A' + 10; // 大文字アルファベットをインデックス (10〜35) に変換
+        scene->render(buffer, frame); // フレームバッファ以外は内容を記録していない
+        return;
     }
-    else if (c == '\x03') 
+    if (!animated && previous == scene->render)
     {
-        font_index = 36; // ハートマークの文字コード (\x03) の場合、インデックスを 36 に設定
+        frame_stats.render_skipped++;
+        scene_of[index] = scene->render;
+        return;
     }
-    else
+#ifdef LCD_FRAME_CACHE
+    if (!animated && previous != NULL && frame_cache_restore(display, previous, scene->render, index))
     {
-        return; // サポートされていない文字の場合は、何も描画せずに関数を終了
+        frame_stats.render_skipped++;
+        scene_of[index] = scene->render;
+        return;
     }
+#endif
 
-    // フォントデータから文字のパターンを取得して、ピクセル単位で描画
-    for (int row = 0; row < 8; row++) // 8x8 フォントなので、縦に 8 行処理
+    scene->render(buffer, frame);
+    scene_of[index] = animated ? NULL : scene->render;
+#ifdef LCD_FRAME_CACHE
+    if (!animated && previous != NULL)
+    {
+        frame_cache_store(display, previous, scene->render, index);
+    }
+#endif
+}
 
+#if defined(LCD_BENCHMARK) || defined(LCD_HOST_SIM)
+// 各バスの通信速度、エラーと送り直しの回数、実効スループット (送れたバイト数 / 転送にかかった時間) を表示する関数
+// ホスト上では DMA がすぐに終わり time_us_64 はホストの時計なので、転送にかかった時間にはシミュレータが模擬したバス上の時間を使う
+static void ssd1327_print_bus_stats()
+{
+    for (int b = 0; b < SSD1327_BUS_COUNT; b++)
     {
-        uint8_t line = font_8x8[font_index][row]; // フォント配列から、指定された文字の指定された行のデータを取得 (1バイトで 8 ピクセルの情報)
-        for (int col = 0; col < 8; col++)         // 横に 8 列処理 (1バイトの各ビットが 1 ピクセルに対応)
+        const ssd1327_bus_t *bus = &ssd1327_buses[b];
+        if (bus->i2c == NULL)
         {
-            // 各ビットが 1 (点灯) か 0 (消灯) かを判定
-            if (line & (1 << (7 - col))) // 左端から順にビットをチェック (ビット演算で判定)
-            {
-                // 点灯するピクセルの場合、指定された座標に拡大して描画
-                draw_char_scaled(buffer, x, y, col, row, brightness, scale); 
-            }
+            continue;
         }
+        const ssd1327_bus_stats_t *stats = &bus->stats;
+#ifdef LCD_HOST_SIM
+        uint64_t busy_us = ssd1327_sim_bus_total_ns(b) / 1000;
+        const char *busy_source = " (modeled bus time)";
+#else
+        uint64_t busy_us = stats->busy_us;
+        const char *busy_source = "";
+#endif
+        uint32_t throughput = busy_us > 0 ? (uint32_t)(stats->bytes * 1000000 / busy_us) : 0;
+        printf("i2c%d: %lu Hz (best %lu Hz), %lu transfers, %lu errors, %lu retries, %lu bus clears, %lu speed changes, %lu failures, %lu bytes/s%s\n",
+               b, (unsigned long)stats->speed_hz, (unsigned long)ssd1327_speeds[bus->best_level],
+               (unsigned long)stats->transfers, (unsigned long)stats->errors, (unsigned long)stats->retries,
+               (unsigned long)stats->bus_clears, (unsigned long)stats->speed_changes, (unsigned long)stats->failures,
+               (unsigned long)throughput, busy_source);
     }
 }
+#endif
 
-// 指定した座標に文字列を描画する関数
-void draw_string(uint8_t *buffer, const char *str, int x, int y, uint8_t brightness)
+// 1 フレーム分の統計を表示する関数 (ベンチマーク時のみ。送ったバイト数は全パネルの合計)
+static void frame_print_stats()
 {
-    int scale = 2; // 文字を 2 倍に拡大するスケールを設定
+#ifdef LCD_BENCHMARK
+    flush_stats_t flush_stats = {0};
+    for (int d = 0; d < LCD_PANEL_COUNT; d++)
+    {
+        flush_stats.bytes_sent += displays[d].flush_stats.bytes_sent;
+        flush_stats.bytes_skipped += displays[d].flush_stats.bytes_skipped;
+    }
+    printf("frame %lu: late %lu us, wait %lu us, render %lu us (max %lu), transfer %lu us (max %lu), sent %lu / skipped %lu bytes, missed %lu, render skipped %lu\n",
+           (unsigned long)frame_stats.frames, (unsigned long)frame_stats.lateness_us, (unsigned long)frame_stats.wait_us,
+           (unsigned long)frame_stats.render_us, (unsigned long)frame_stats.render_max_us,
+           (unsigned long)frame_stats.transfer_us, (unsigned long)frame_stats.transfer_max_us,
+           (unsigned long)flush_stats.bytes_sent, (unsigned long)flush_stats.bytes_skipped,
+           (unsigned long)frame_stats.missed_deadlines, (unsigned long)frame_stats.render_skipped);
+    ssd1327_print_bus_stats();
+#endif
+}
+
+#ifdef LCD_DUAL_CORE
+/* コア間のフレーム受け渡し (デュアルコア) */
+// コア 1 が場面を描画し、コア 0 が SSD1327 への転送を受け持つ。面はプールから借りて、描き終えたら順番に送る。
+// 受け渡しは「積む側と取り出す側が 1 つずつ」のリングバッファで行うので、ロックも割り込み禁止も要らない
+
+// 1 つのコアだけが積み、もう 1 つのコアだけが取り出すリングバッファ
+typedef struct
+{
+    volatile uint32_t head;                    // 次に積む位置 (積む側だけが書き換える)
+    volatile uint32_t tail;                    // 次に取り出す位置 (取り出す側だけが書き換える)
+    volatile uint32_t items[FRAME_QUEUE_SIZE]; // 積まれた値
+} frame_queue_t;
+
+static frame_queue_t free_frames[LCD_PANEL_COUNT]; // 各パネルの描画に使える面の番号 (コア 0 → コア 1。転送完了の割り込みで積む)
+static frame_queue_t ready_frames;      // 描き終えたフレーム (コア 1 → コア 0)。下位 4 ビットが面の番号、次の 4 ビットがパネルの番号、次の 8 ビットが場面の番号、その上が場面の中のフレーム番号
+static const scene_t *render_scenes;    // コア 1 が描画する場面表
+static int render_scene_count;          // 場面表の行数
 
-    while (*str) // 文字列の終端 ('\0') まで繰り返す
+// キューに値を積む関数。いっぱいなら false を返す
+static bool frame_queue_push(frame_queue_t *queue, uint32_t item)
+{
+    uint32_t head = queue->head;
+    if (head - queue->tail == FRAME_QUEUE_SIZE)
     {
-        draw_char(buffer, *str, x, y, brightness, scale); // 現在の文字を描画
-        x += 8 * scale + 4;
-        // 次の文字を描画する X 座標を 8×scale分、右に移動 (8x8 フォントの幅)
-        // 文字間のスペースを4ピクセル分確保
-        str++;
-        // 文字列の次の文字を指すようにポインタをインクリメント
+        return false;
     }
+    queue->items[head % FRAME_QUEUE_SIZE] = item;
+    __dmb(); // 値を書き終えてから head を進める (フレームバッファへの書き込みもここまでに見えるようになる)
+    queue->head = head + 1;
+    __sev(); // 取り出す側のコアが __wfe() で待っていれば起こす
+    return true;
 }
 
-void draw_countdown(char c)
+// キューから値を取り出す関数。空なら false を返す
+static bool frame_queue_pop(frame_queue_t *queue, uint32_t *item)
 {
-   // 表示バッファを毎回クリア
-    for (int i = 0; i < DISPLAY_DATA_SIZE; i++)
+    uint32_t tail = queue->tail;
+    if (queue->head == tail)
     {
-        buffer[i] = 0; // バッファの各バイトを 0 でクリア
+        return false;
     }
+    __dmb(); // head を読んでから値を読む
+    *item = queue->items[tail % FRAME_QUEUE_SIZE];
+    __dmb(); // 値を読み終えてから tail を進める
+    queue->tail = tail + 1;
+    __sev();
+    return true;
+}
 
-    int scale = 8; //　文字を8倍に拡大
-    draw_char(buffer, c, 32, 32, 15, scale); // 指定された文字をバッファに描画。指定座標 (32, 32) に、明るさ 15 で描画
-    
+// 転送完了のコールバック (コア 0 の割り込みの中から呼ばれる)：送り終えた面を描画側に返す
+static void frame_released(ssd1327_t *display, const uint8_t *data)
+{
+    frame_transfer_done(display, data);
+    frame_queue_push(&free_frames[display->number], frame_buffer_index(display, data)); // 面の数よりキューが大きいので溢れない
 }
 
-int main()
+// コア 1 の処理：空いた面を受け取り、場面表の次の場面を描いてコア 0 に渡すことを繰り返す (1 フレームごとに全パネルの分を描く)
+static void render_core_entry()
 {
-    stdio_init_all(); // 標準入出力 (USB シリアルなど) を初期化。デバッグなどに使用可能
+    int index = 0;
+    uint32_t repeat = 0;
+    while (true)
+    {
+        uint32_t render_us = 0;
+        for (int d = 0; d < LCD_PANEL_COUNT; d++)
+        {
+            ssd1327_t *display = &displays[d];
+            uint32_t frame = FRAME_QUEUE_IMAGE; // 画像の場面は描画せず面も使わないので、送るフレームの番号だけを渡す
+            if (render_scenes[index].image == NULL)
+            {
+                while (!frame_queue_pop(&free_frames[d], &frame))
+                {
+                    __wfe(); // すべての面が送信待ちか送信中なので、転送が終わるまで待つ
+                }
+                frame_buffer_acquire(display, frame); // 直前に描いたフレームと同じ内容にそろえてから描き始める
+
+                uint64_t render_start = time_us_64();
+                scene_render(&render_scenes[index], display->frame_buffers[frame].pixels, repeat);
+                render_us += time_us_64() - render_start;
+
+                frame_buffer_submit(display, frame);
+            }
+            while (!frame_queue_push(&ready_frames, frame | (uint32_t)d << 4 | (uint32_t)index << 8 | repeat << 16))
+            {
+                __wfe(); // 画像の場面のフレームが先に積まれていると、面の数より多く溜まることがある
+            }
+        }
+        if (render_scenes[index].image == NULL)
+        {
+            frame_stats.render_us = render_us;
+            frame_stats.render_max_us = MAX(frame_stats.render_max_us, render_us);
+        }
+        index = scene_advance(render_scenes, render_scene_count, index, &repeat);
+    }
+}
+
+// 場面表を順に表示し続ける関数 (戻らない)
+// 描画はコア 1 が先回りして進め、コア 0 は表示期限ごとに描き終えたフレームを送るだけにする。
+// 期限を待つ間コア 0 はスリープしているので、センサーやボタンの処理をここに加えられる
+static void run_scenes(const scene_t *scenes, int count)
+{
+    render_scenes = scenes;
+    render_scene_count = count;
+    for (int d = 0; d < LCD_PANEL_COUNT; d++)
+    {
+        for (int i = 0; i < FRAME_BUFFER_COUNT; i++)
+        {
+            frame_queue_push(&free_frames[d], i); // 最初はすべての面が空いている
+        }
+    }
+    multicore_launch_core1(render_core_entry);
 
-    // I2C の初期化
-    i2c_init_pico(); // I2C 通信に必要な設定 (ピン、速度など) を行う
+    absolute_time_t deadline = get_absolute_time();
+    while (true)
+    {
+        frame_wait_until(deadline);
+
+        // 全パネルの描き終えたフレームを受け取る (描画が間に合っていなければ届くまで待つ)。コア 1 はパネルの順に積む
+        uint32_t frames[LCD_PANEL_COUNT];
+        bool missed = false;
+        for (int d = 0; d < LCD_PANEL_COUNT; d++)
+        {
+            while (!frame_queue_pop(&ready_frames, &frames[d]))
+            {
+                missed = true;
+                __wfe();
+            }
+        }
+        frame_stats.missed_deadlines += missed;
+        int index = (frames[0] >> 8) & 0xFF;
+
+        // フレームを送り始める (前のフレームの転送が終わっていなければ待つ)
+        // 別のバスのパネルへは同時に送られ、同じバスのパネルへは先に送り始めたパネルの転送が終わると続けて送られる
+        uint64_t present_us = time_us_64();
+        frame_stats.lateness_us = MAX(0, absolute_time_diff_us(deadline, get_absolute_time()));
+        for (int d = 0; d < LCD_PANEL_COUNT; d++)
+        {
+            ssd1327_wait_flush(&displays[d]);
+        }
+        frame_stats.wait_us = time_us_64() - present_us;
+        transfer_start_us = time_us_64();
+        for (int d = 0; d < LCD_PANEL_COUNT; d++)
+        {
+            ssd1327_t *display = &displays[(frames[d] >> 4) & 0x0F];
+            int face = frames[d] & 0x0F;
+            if (face == FRAME_QUEUE_IMAGE)
+            {
+                ssd1327_show_image_async(display, scenes[index].image, frames[d] >> 16, frame_transfer_done); // 面を使っていないので返すものはない
+            }
+            else
+            {
+                ssd1327_flush_dirty_async(display, display->frame_buffers[face].pixels, frame_released); // 送り終えると面がコア 1 に返る
+            }
+        }
+        frame_stats.frames++;
 
-    // SSD1327 OLED ディスプレイの初期化
-    ssd1327_init(); // SSD1327 に初期設定コマンドを送信し、使用できる状態にする
+        // 次の表示期限は今回の期限から数える。1 フレーム以上遅れたら今から数え直す
+        deadline = delayed_by_ms(deadline, scenes[index].duration_ms);
+        if (absolute_time_diff_us(deadline, get_absolute_time()) > 0)
+        {
+            deadline = get_absolute_time();
+        }
 
-    int state = 1;
+        frame_print_stats();
+    }
+}
+#else
+// 場面表を順に表示し続ける関数 (戻らない)
+// 表示期限は起動時からの絶対時刻で決めるので、描画や転送の時間があっても周期がずれていかない。
+// フレーム N を期限ちょうどに送り始めたら、転送中にフレーム N+1 を描画し、次の期限までスリープする
+static void run_scenes(const scene_t *scenes, int count)
+{
+    int index = 0;
+    uint32_t repeat = 0;
+    for (int d = 0; d < LCD_PANEL_COUNT; d++)
+    {
+        scene_render(&scenes[index], displays[d].buffer, repeat); // 最初のフレームを描画しておく
+    }
+    absolute_time_t deadline = get_absolute_time();
 
-    while (true) // メインループ：無限に繰り返して、顔の表情をアニメーション表示する
+    while (true)
     {
-        if(state == 1)
+        frame_wait_until(deadline);
+
+        // フレーム N を全パネルに送り始める (前のフレームの転送が終わっていなければ待つ)
+        // 別のバスのパネルへは同時に送られ、同じバスのパネルへは先に送り始めたパネルの転送が終わると続けて送られる
+        uint64_t present_us = time_us_64();
+        frame_stats.lateness_us = MAX(0, absolute_time_diff_us(deadline, get_absolute_time()));
+        for (int d = 0; d < LCD_PANEL_COUNT; d++)
+        {
+            ssd1327_wait_flush(&displays[d]);
+        }
+        frame_stats.wait_us = time_us_64() - present_us;
+        transfer_start_us = time_us_64();
+        for (int d = 0; d < LCD_PANEL_COUNT; d++)
         {
-             // 画面表示バッファをクリア (黒で塗りつぶし)
-            for (int i = 0; i < DISPLAY_DATA_SIZE; i++)
+            if (scenes[index].image != NULL)
+            {
+                ssd1327_show_image_async(&displays[d], scenes[index].image, repeat, frame_transfer_done); // 画像はバックバッファを使わずに送る
+            }
+            else
             {
-                buffer[i] = 0; // バッファの各バイトを 0 でクリア (4 ビットグレースケールで 0 は最も暗い状態)
+                ssd1327_swap_buffers(&displays[d], frame_transfer_done);
             }
-                ssd1327_set_display(buffer); // クリアしたバッファの内容をディスプレイに送信し、画面を黒で初期化
-                sleep_ms(1000);
         }
-        else if(state == 2)
+        frame_stats.frames++;
+
+        // 次の表示期限は今回の期限から数える (現在時刻から数えると少しずつ遅れていく)
+        deadline = delayed_by_ms(deadline, scenes[index].duration_ms);
+        index = scene_advance(scenes, count, index, &repeat);
+
+        // 転送中にフレーム N+1 を描画する
+        uint64_t render_start = time_us_64();
+        for (int d = 0; d < LCD_PANEL_COUNT; d++)
         {
-            draw_countdown('3'); // カウントダウンの数字 '3' を表示
-            ssd1327_set_display(buffer); // バッファの内容をディスプレイに送信
-            sleep_ms(1000); // 1 秒待機
+            scene_render(&scenes[index], displays[d].buffer, repeat);
         }
-        else if(state == 3)
+        frame_stats.render_us = time_us_64() - render_start;
+        frame_stats.render_max_us = MAX(frame_stats.render_max_us, frame_stats.render_us);
+
+        if (absolute_time_diff_us(get_absolute_time(), deadline) < 0)
         {
-            draw_countdown('2');
-            ssd1327_set_display(buffer); // バッファの内容をディスプレイに送信
-            sleep_ms(1000); // 1 秒待機
+            frame_stats.missed_deadlines++; // 描画が終わった時点で次の期限を過ぎている
+            if (absolute_time_diff_us(deadline, get_absolute_time()) > (int64_t)scenes[index].duration_ms * 1000)
+            {
+                deadline = get_absolute_time(); // 1 フレーム以上遅れたら、遅れを取り戻そうとせず今から数え直す
+            }
         }
-        else if(state == 4)
+
+        frame_print_stats();
+    }
+}
+#endif
+
+/* 場面 (シーン) */
+
+// 画面を黒にする場面
+static void scene_blank(uint8_t *buffer, uint32_t frame)
+{
+    (void)frame; // 1 フレームだけの場面は、何フレーム目かによらず同じ絵を描く
+    clear_buffer(buffer); // バッファの各バイトを 0 でクリア (4 ビットグレースケールで 0 は最も暗い状態)
+}
+
+// カウントダウンの数字を大きく表示する場面
+static void scene_countdown_3(uint8_t *buffer, uint32_t frame) { (void)frame; draw_countdown(buffer, '3'); }
+static void scene_countdown_2(uint8_t *buffer, uint32_t frame) { (void)frame; draw_countdown(buffer, '2'); }
+static void scene_countdown_1(uint8_t *buffer, uint32_t frame) { (void)frame; draw_countdown(buffer, '1'); }
+
+// "HAPPY BIRTH DAY♥" を表示する場面
+static void scene_happy_birthday(uint8_t *buffer, uint32_t frame)
+{
+    (void)frame;
+    clear_buffer(buffer);
+    draw_string(buffer, "HAPPY", 14, 18, 15);
+    draw_string(buffer, "BIRTH", 14, 56, 15);
+    draw_string(buffer, "DAY\x03", 26, 94, 15);
+}
+
+// カウントダウンの "1" を消していく場面と、"HAPPY BIRTH DAY♥" を浮かび上がらせる場面 (それぞれ FADE_STEPS フレーム)
+// 絵は変わらないので、2 フレーム目からはコントラストのコマンドだけが送られる
+// (コントラスト 0 でもパネルはわずかに光るので、真っ暗にはならない)
+#define FADE_STEPS 16
+#define FADE_CONTRAST 0x80 // フェードし終えたときのコントラスト (初期化シーケンスと同じ)
+
+static void scene_fade_out_countdown_1(uint8_t *buffer, uint32_t frame)
+{
+    uint32_t step = frame + 1; // 1〜FADE_STEPS
+    draw_countdown(buffer, '1');
+    display_set_contrast(buffer, fade_contrast(FADE_CONTRAST, 0, step, FADE_STEPS));
+}
+
+static void scene_fade_in_happy_birthday(uint8_t *buffer, uint32_t frame)
+{
+    uint32_t step = frame + 1;
+    scene_happy_birthday(buffer, frame);
+    display_set_contrast(buffer, fade_contrast(0, FADE_CONTRAST, step, FADE_STEPS));
+}
+
+// "NAGOMI" を表示する場面
+static void scene_nagomi(uint8_t *buffer, uint32_t frame)
+{
+    (void)frame;
+    clear_buffer(buffer);
+    draw_string(buffer, "NAGOMI", 6, 56, 15);
+}
+
+#ifdef LCD_DEMO_SCENES
+// 文字の行が下から上へ流れていくティッカー (エンドロール)。1 フレームごとに TICKER_STEP 行ずつ流す
+// 開始ラインを動かして画面全体を流し、新しく現れた行だけを描くので、1 フレームで送るのは TICKER_STEP 行分と数バイトのコマンドになる
+#define TICKER_STEP 2         // 1 フレームで流す行数
+#define TICKER_LINE_HEIGHT 24 // 文字の 1 行の高さ (2 倍に拡大した文字 16 行 + 行間 8 行)
+static const char *const ticker_lines[] = {"HAPPY", "BIRTH", "DAY\x03", "", "NAGOMI", "", "", ""};
+
+static void scene_ticker(uint8_t *buffer, uint32_t frame)
+{
+    static uint8_t line_image[TICKER_LINE_HEIGHT * (DISPLAY_WIDTH / 2)]; // 流している文字の行を 1 行だけ描いておく画像 (幅は画面と同じで、高さは TICKER_LINE_HEIGHT 行)
+    static int line_in_image = -1;                                        // line_image に描いてある行の番号 (どのパネルでも同じ内容になるので共有する)
+    uint32_t position = frame * TICKER_STEP;                              // これまでに流した行数
+
+    scroll_vertical(buffer, TICKER_STEP, 0);
+    for (int i = 0; i < TICKER_STEP; i++)
+    {
+        // 画面の一番下付近に新しく現れた行が、文字の行のどの部分にあたるか
+        uint32_t tape_y = position + DISPLAY_HEIGHT - TICKER_STEP + i;
+        int line = (tape_y / TICKER_LINE_HEIGHT) % count_of(ticker_lines);
+        int line_y = tape_y % TICKER_LINE_HEIGHT;
+        if (line != line_in_image)
         {
-            draw_countdown('1');
-            ssd1327_set_display(buffer); // バッファの内容をディスプレイに送信
-            sleep_ms(1000); // 1 秒待機
+            const char *text = ticker_lines[line];
+            memset(line_image, 0, sizeof(line_image));
+            draw_string(line_image, text, (DISPLAY_WIDTH - (int)strlen(text) * 20 + 4) / 2, 0, 15); // 中央にそろえる (1 文字 20 ピクセル)
+            line_in_image = line;
         }
-        else if(state == 5 || state == 7 || state == 9)
+        draw_bitmap(buffer, 0, scroll_row(buffer, DISPLAY_HEIGHT - TICKER_STEP + i), DISPLAY_WIDTH, 1,
+                    line_image + line_y * (DISPLAY_WIDTH / 2));
+    }
+}
+
+// "NAGOMI" の帯をパネルの水平スクロールで左へ流し続ける場面 (最初のフレームを送った後は何も送らない)
+static void scene_marquee(uint8_t *buffer, uint32_t frame)
+{
+    (void)frame;
+    clear_buffer(buffer);
+    draw_string(buffer, "NAGOMI", 6, 56, 15);
+    scroll_horizontal_start(buffer, 56, 71, true, 0);
+}
+#endif
+
+// 表示する場面の並び (上から順に表示し、最後まで行ったら先頭に戻る)
+static const scene_t scenes[] = {
+    {scene_blank, 1000, 1, NULL},
+    {scene_countdown_3, 1000, 1, NULL},
+    {scene_countdown_2, 1000, 1, NULL},
+    {scene_countdown_1, 1000, 1, NULL},
+    {scene_fade_out_countdown_1, 30, FADE_STEPS, NULL},
+    {scene_fade_in_happy_birthday, 30, FADE_STEPS, NULL},
+    {scene_happy_birthday, 1000, 1, NULL},
+    {scene_nagomi, 1000, 1, NULL},
+    {scene_happy_birthday, 1000, 1, NULL},
+    {scene_nagomi, 1000, 1, NULL},
+    {scene_happy_birthday, 1000, 1, NULL},
+    {scene_nagomi, 1000, 1, NULL},
+#ifdef LCD_DEMO_SCENES
+    {scene_ticker, 40, 200, NULL},  // スクロールの動作確認用 (LCD_DEMO_SCENES を有効にしたときだけ)
+    {scene_marquee, 3000, 1, NULL},
+#endif
+#ifdef LCD_ANIMATION_SCENE
+    {NULL, 40, 0, &animation}, // ビルド時に生成したアニメーション (LCD_ANIMATION_FRAMES を指定せず LCD_DEMO_SCENES を有効にすると、グラデーションの上を玉が跳ねる)
+#endif
+};
+
+#ifdef LCD_HOST_SIM
+#define HOST_BENCH_REPEAT 100 // 描画時間を測るときに同じ場面を描く回数 (1 回では短すぎて測れない)
+
+// 場面表の各場面を描画して送信し、1 フレームあたりの描画時間とバスの負荷を表示する関数 (ホスト上のシミュレータ用)
+// repeat が 2 以上の場面は repeat フレームを続けて送り、1 フレームあたりの平均を表示する
+// 画像の場面は全フレームを順に送り、描画時間の代わりに 1 フレームの展開にかかる時間を表示する
+// 送信後に各パネルに出ている内容が送ったフレーム (開始ラインの分だけ回した内容) と一致するかも確かめ、各場面の最後のフレームを frame_NN.pgm
+// (2 枚目以降のパネルは frame_NN_pD.pgm) に書き出す。パネルが複数なら全パネルの分を描いて送り、busiest_us に最も混んだバスの所要時間を表示する
+static void benchmark_scenes(const scene_t *scenes, int count)
+{
+    ssd1327_sim_stats_t total = {0};
+    double render_total_us = 0;
+    int mismatches = 0;
+
+    printf("scene  render_us  transactions  bytes  data_bytes  bus_us  busiest_us  match\n");
+    for (int index = 0; index < count; index++)
+    {
+        uint32_t frames = scene_frames(&scenes[index]);
+        ssd1327_sim_stats_t stats = {0};
+        double render_us = 0;
+        bool match = true;
+
+        for (uint32_t frame = 0; frame < frames; frame++)
         {
-            // 画面表示バッファをクリア (黒で塗りつぶし)
-            for (int i = 0; i < DISPLAY_DATA_SIZE; i++)
+            // 1 フレームだけの場面は、描画の速さを別のバッファに繰り返し描いて測り、フレームは scene_render で用意する
+            // (同じ場面が続いたときやキャッシュにあるときは描画が省かれる)
+            static uint8_t scratch[DISPLAY_DATA_SIZE];
+            static uint8_t expected[DISPLAY_DATA_SIZE]; // 画像の場面で、パネルに出ているはずの内容
+            const uint8_t *sent[LCD_PANEL_COUNT];
+            for (int d = 0; d < LCD_PANEL_COUNT; d++)
             {
-                buffer[i] = 0; // バッファの各バイトを 0 でクリア
+                sent[d] = displays[d].buffer;
             }
-    
-            draw_string(buffer, "HAPPY", 14, 18, 15);
-            draw_string(buffer, "BIRTH", 14, 56, 15);
-            draw_string(buffer, "DAY\x03", 26 , 94, 15);
+            if (scenes[index].image != NULL)
+            {
+                // 画像の場面は、展開の速さを別のバッファに繰り返し展開して測り、フレームバッファを使わずに送る
+                uint64_t render_start = time_us_64();
+                for (int i = 0; i < HOST_BENCH_REPEAT; i++)
+                {
+                    image_draw(scratch, scenes[index].image, frame);
+                }
+                render_us += (double)(time_us_64() - render_start) / HOST_BENCH_REPEAT;
+                image_draw(expected, scenes[index].image, frame);
+                for (int d = 0; d < LCD_PANEL_COUNT; d++)
+                {
+                    sent[d] = expected;
+                }
+            }
+            else if (frames == 1)
+            {
+                uint64_t render_start = time_us_64();
+                for (int i = 0; i < HOST_BENCH_REPEAT; i++)
+                {
+                    scenes[index].render(scratch, frame);
+                }
+                render_us += (double)(time_us_64() - render_start) / HOST_BENCH_REPEAT * LCD_PANEL_COUNT;
+                for (int d = 0; d < LCD_PANEL_COUNT; d++)
+                {
+                    scene_render(&scenes[index], displays[d].buffer, frame);
+                }
+            }
+            else
+            {
+                uint64_t render_start = time_us_64();
+                for (int d = 0; d < LCD_PANEL_COUNT; d++)
+                {
+                    scene_render(&scenes[index], displays[d].buffer, frame);
+                }
+                render_us += (double)(time_us_64() - render_start);
+            }
+
+            ssd1327_sim_reset_stats();
+            for (int d = 0; d < LCD_PANEL_COUNT; d++)
+            {
+                if (scenes[index].image != NULL)
+                {
+                    ssd1327_show_image_async(&displays[d], scenes[index].image, frame, NULL);
+                }
+                else
+                {
+                    ssd1327_swap_buffers(&displays[d], NULL);
+                }
+            }
+            for (int d = 0; d < LCD_PANEL_COUNT; d++)
+            {
+                ssd1327_wait_flush(&displays[d]);
+            }
+            ssd1327_sim_stats_t step = ssd1327_sim_get_stats();
+            stats.transactions += step.transactions;
+            stats.bytes += step.bytes;
+            stats.data_bytes += step.data_bytes;
+            stats.bus_ns += step.bus_ns;
+            stats.busiest_ns += step.busiest_ns;
 
-            ssd1327_set_display(buffer); // バッファの内容をディスプレイに送信
-            sleep_ms(1000); // 1 秒待機
+            for (int d = 0; d < LCD_PANEL_COUNT; d++)
+            {
+                static uint8_t panel[DISPLAY_DATA_SIZE];
+                if (displays[d].flush_failed)
+                {
+                    continue; // 故障を起こしているときに送るのをあきらめたフレームは、次のフレームで全体が送られる
+                }
+                ssd1327_sim_read_panel(i2c_get_index(displays[d].bus->i2c), displays[d].address, panel);
+                for (int y = 0; y < DISPLAY_HEIGHT; y++)
+                {
+                    const uint8_t *row = sent[d] + scroll_row(sent[d], y) * (DISPLAY_WIDTH / 2); // 画面の y 行目に出ているはずの RAM の行
+                    match = match && memcmp(panel + y * (DISPLAY_WIDTH / 2), row, DISPLAY_WIDTH / 2) == 0;
+                }
+            }
         }
-        else if(state == 6 || state == 8 || state == 10)
+        mismatches += !match;
+        render_us /= frames;
+        stats.transactions /= frames;
+        stats.bytes /= frames;
+        stats.data_bytes /= frames;
+        stats.bus_ns /= frames;
+        stats.busiest_ns /= frames;
+
+        for (int d = 0; d < LCD_PANEL_COUNT; d++)
         {
-            // 画面表示バッファをクリア (黒で塗りつぶし)
-            for (int i = 0; i < DISPLAY_DATA_SIZE; i++)
+            char path[32];
+            if (d == 0)
             {
-                buffer[i] = 0; // バッファの各バイトを 0 でクリア
+                snprintf(path, sizeof(path), "frame_%02d.pgm", index);
             }
-    
-            draw_string(buffer, "NAGOMI", 6, 56, 15);
-            ssd1327_set_display(buffer); // バッファの内容をディスプレイに送信
-            sleep_ms(1000); // 1 秒待機
+            else
+            {
+                snprintf(path, sizeof(path), "frame_%02d_p%d.pgm", index, d);
+            }
+            ssd1327_sim_write_pgm(i2c_get_index(displays[d].bus->i2c), displays[d].address, path);
         }
 
-        if(state < 10)     // 状態が 10 未満の場合
+        printf("%5d  %9.2f  %12lu  %5lu  %10lu  %6lu  %10lu  %s\n", index, render_us,
+               (unsigned long)stats.transactions, (unsigned long)stats.bytes, (unsigned long)stats.data_bytes,
+               (unsigned long)(stats.bus_ns / 1000), (unsigned long)(stats.busiest_ns / 1000), match ? "ok" : "MISMATCH");
+
+        render_total_us += render_us;
+        total.transactions += stats.transactions;
+        total.bytes += stats.bytes;
+        total.data_bytes += stats.data_bytes;
+        total.bus_ns += stats.bus_ns;
+        total.busiest_ns += stats.busiest_ns;
+    }
+    printf("total  %9.2f  %12lu  %5lu  %10lu  %6lu  %10lu  %d mismatch(es), %lu render(s) skipped\n", render_total_us,
+           (unsigned long)total.transactions, (unsigned long)total.bytes, (unsigned long)total.data_bytes,
+           (unsigned long)(total.bus_ns / 1000), (unsigned long)(total.busiest_ns / 1000), mismatches, (unsigned long)frame_stats.render_skipped);
+    ssd1327_print_bus_stats();
+}
+
+// 圧縮画像の場面を、バスの故障 (通信速度の限界、ノイズによる NAK、止まるスレーブ) を起こしながら全パネルに送り、
+// 転送をあきらめた後や、フレームを飛ばした後もパネルの内容が送ったフレームと一致するかを確かめる関数 (ホスト上のシミュレータ用)
+// 故障の設定は戻さないので、最後に呼ぶこと
+static void benchmark_image_faults(const scene_t *scenes, int count)
+{
+    static uint8_t expected[DISPLAY_DATA_SIZE];
+    static uint8_t panel[DISPLAY_DATA_SIZE];
+    int frames_sent = 0;
+    int mismatches = 0;
+    uint32_t failures = 0;
+
+    for (int b = 0; b < SSD1327_BUS_COUNT; b++)
+    {
+        failures -= ssd1327_buses[b].stats.failures;
+    }
+    ssd1327_sim_set_faults(400000, 5000, 300);
+    for (int index = 0; index < count; index++)
+    {
+        const image_t *image = scenes[index].image;
+        if (image == NULL)
         {
-            state++;    // 状態を 1 つ進める
+            continue;
         }
-        else
+        // 順に全フレームを送った後、途中のフレームへ戻って送る (直前のフレームが出ていないので 1 フレーム目から送り直される)
+        for (int step = 0; step <= image->frame_count; step++)
         {
-            state = 1;   // 状態が 10 以上の場合は、状態を 1 にリセット
+            int frame = (step < image->frame_count) ? step : image->frame_count / 2;
+            for (int d = 0; d < LCD_PANEL_COUNT; d++)
+            {
+                ssd1327_show_image_async(&displays[d], image, frame, NULL);
+            }
+            for (int d = 0; d < LCD_PANEL_COUNT; d++)
+            {
+                ssd1327_wait_flush(&displays[d]);
+            }
+            for (int k = (step < image->frame_count) ? frame : 0; k <= frame; k++)
+            {
+                image_draw(expected, image, k);
+            }
+            for (int d = 0; d < LCD_PANEL_COUNT; d++)
+            {
+                if (displays[d].flush_failed)
+                {
+                    continue; // このフレームはあきらめたので、次のフレームで送り直されるかを見る
+                }
+                ssd1327_sim_read_panel(i2c_get_index(displays[d].bus->i2c), displays[d].address, panel);
+                mismatches += memcmp(panel, expected, DISPLAY_DATA_SIZE) != 0;
+            }
+            frames_sent++;
         }
     }
-        
-}
\ No newline at end of file
+    for (int b = 0; b < SSD1327_BUS_COUNT; b++)
+    {
+        failures += ssd1327_buses[b].stats.failures;
+    }
+    printf("image faults: %d frame(s), %lu failure(s), %d mismatch(es)\n", frames_sent, (unsigned long)failures, mismatches);
+}
+#endif
+
+int main()
+{
+    stdio_init_all(); // 標準入出力 (USB シリアルなど) を初期化。デバッグなどに使用可能
+
+    // SSD1327 OLED ディスプレイの初期化 (I2C と DMA による非同期転送も、そのバスを初めて使うときに初期化される)
+    for (int d = 0; d < LCD_PANEL_COUNT; d++)
+    {
+        ssd1327_init(&displays[d], &ssd1327_configs[d]); // SSD1327 に初期設定コマンドを送信し、使用できる状態にする
+    }
+
+#ifdef LCD_BENCHMARK
+    sleep_ms(3000);            // USB シリアルが接続されるのを待つ
+    benchmark_glyph_blitter(); // 文字描画の速度を測って表示する
+    benchmark_primitives();    // 図形描画の速度を測って表示する
+    benchmark_dither();        // ディザリングの速度を測って表示する
+#endif
+
+#ifdef LCD_HOST_SIM
+    benchmark_scenes(scenes, count_of(scenes)); // 実機の代わりにシミュレータ上で各場面の描画時間とバスの負荷を測る
+    benchmark_image_faults(scenes, count_of(scenes)); // バスの故障を起こしても画像の場面が正しく出るかを確かめる
+    return 0;
+#endif
+
+    run_scenes(scenes, count_of(scenes)); // 場面表を一定の周期で表示し続ける
+}
@@ -1,76 +1,104 @@
-const uint8_t font_8x8[37][8] = {
-    // '0'
-    {0x3C, 0x42, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C},
-    // '1'
-    {0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x7E},
-    // '2'
-    {0x3C, 0x42, 0x01, 0x01, 0x3E, 0x40, 0x40, 0x7F},
-    // '3'
-    {0x3C, 0x42, 0x01, 0x01, 0x1E, 0x01, 0x42, 0x3C},
-    // '4'
-    {0x04, 0x0C, 0x14, 0x24, 0x44, 0x7F, 0x04, 0x04},
-    // '5'
-    {0x7F, 0x40, 0x40, 0x7C, 0x02, 0x01, 0x42, 0x3C},
-    // '6'
-    {0x3C, 0x42, 0x80, 0xFC, 0x82, 0x81, 0x42, 0x3C},
-    // '7'
-    {0x7F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40},
-    // '8'
-    {0x3C, 0x42, 0x81, 0x42, 0x3C, 0x42, 0x81, 0x3C},
-    // '9'
-    {0x3C, 0x42, 0x81, 0x43, 0x3D, 0x01, 0x42, 0x3C},
-    // 'A'
-    {0x3C, 0x42, 0x81, 0x81, 0xFF, 0x81, 0x81, 0x81},
-    // 'B'
-    {0xFC, 0x82, 0x81, 0x82, 0xFC, 0x82, 0x81, 0xFC},
-    // 'C'
-    {0x3C, 0x42, 0x81, 0x80, 0x80, 0x81, 0x42, 0x3C},
-    // 'D'
-    {0xFC, 0x82, 0x81, 0x81, 0x81, 0x81, 0x82, 0xFC},
-    // 'E'
-    {0xFF, 0x80, 0x80, 0xFC, 0x80, 0x80, 0x80, 0xFF},
-    // 'F'
-    {0xFF, 0x80, 0x80, 0xFC, 0x80, 0x80, 0x80, 0x80},
-    // 'G'
-    {0x3C, 0x42, 0x81, 0x80, 0x87, 0x81, 0x42, 0x3C},
-    // 'H'
-    {0x81, 0x81, 0x81, 0xFF, 0x81, 0x81, 0x81, 0x81},
-    // 'I'
-    {0x7E, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x7E},
-    // 'J'
-    {0x01, 0x01, 0x01, 0x01, 0x01, 0x81, 0x42, 0x3C},
-    // 'K'
-    {0x81, 0x82, 0x84, 0xF8, 0x84, 0x82, 0x81, 0x81},
-    // 'L'
-    {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0xFF},
-    // 'M'
-    {0x81, 0xC3, 0xA5, 0x99, 0x81, 0x81, 0x81, 0x81},
-    // 'N'
-    {0x81, 0xC1, 0xA1, 0x91, 0x89, 0x85, 0x83, 0x81},
-    // 'O'
-    {0x3C, 0x42, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C},
-    // 'P'
-    {0xFC, 0x82, 0x81, 0x82, 0xFC, 0x80, 0x80, 0x80},
-    // 'Q'
-    {0x3C, 0x42, 0x81, 0x81, 0x81, 0xA1, 0x42, 0x3D},
-    // 'R'
-    {0xFC, 0x82, 0x81, 0x82, 0xFC, 0x84, 0x82, 0x81},
-    // 'S'
-    {0x3C, 0x42, 0x80, 0x3C, 0x02, 0x01, 0x42, 0x3C},
-    // 'T'
-    {0xFF, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10},
-    // 'U'
-    {0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C},
-    // 'V'
-    {0x81, 0x81, 0x81, 0x81, 0x42, 0x42, 0x24, 0x18},
-    // 'W'
-    {0x81, 0x81, 0x81, 0x81, 0x99, 0xA5, 0xC3, 0x81},
-    // 'X'
-    {0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81},
-    // 'Y'
-    {0x81, 0x42, 0x24, 0x18, 0x10, 0x10, 0x10, 0x10},
-    // 'Z'
-    {0xFF, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0xFF},
-    // '\x03' ハートマークの文字コード
-    {0x00, 0x66, 0xFF, 0xFF, 0xFF, 0x7E, 0x3C, 0x18},
-};
\ No newline at end of file
+// 8x8 ドットフォント。1 バイトが横 1 行 (最上位ビットが左端のピクセル)、8 バイトで 1 文字
+// 添字は文字コード。ビルド時に tools/gen_glyphs.py がこの表から、文字コード → 字形番号の索引と、
+// 同じ形の字形を 1 つにまとめた字形の表を生成する (LCD_program.c はそちらを使う)
+const uint8_t font_8x8[128][8] = {
+    // ハートマークの文字コード
+    ['\x03'] = {0x00, 0x66, 0xFF, 0xFF, 0xFF, 0x7E, 0x3C, 0x18},
+    [' '] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    ['!'] = {0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x18},
+    ['"'] = {0x24, 0x24, 0x24, 0x00, 0x00, 0x00, 0x00, 0x00},
+    ['#'] = {0x24, 0x24, 0xFF, 0x24, 0x24, 0xFF, 0x24, 0x24},
+    ['$'] = {0x10, 0x7E, 0x90, 0x7C, 0x12, 0x12, 0xFC, 0x10},
+    ['%'] = {0xC1, 0xC2, 0x04, 0x08, 0x10, 0x20, 0x43, 0x83},
+    ['&'] = {0x38, 0x44, 0x44, 0x38, 0x51, 0x8A, 0x84, 0x7B},
+    ['\''] = {0x18, 0x18, 0x08, 0x10, 0x00, 0x00, 0x00, 0x00},
+    ['('] = {0x0C, 0x10, 0x20, 0x20, 0x20, 0x20, 0x10, 0x0C},
+    [')'] = {0x30, 0x08, 0x04, 0x04, 0x04, 0x04, 0x08, 0x30},
+    ['*'] = {0x00, 0x5A, 0x3C, 0xFF, 0x3C, 0x5A, 0x00, 0x00},
+    ['+'] = {0x00, 0x18, 0x18, 0x7E, 0x7E, 0x18, 0x18, 0x00},
+    [','] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x20},
+    ['-'] = {0x00, 0x00, 0x00, 0x7E, 0x7E, 0x00, 0x00, 0x00},
+    ['.'] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18},
+    ['/'] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80},
+    ['0'] = {0x3C, 0x42, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C},
+    ['1'] = {0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x7E},
+    ['2'] = {0x3C, 0x42, 0x01, 0x01, 0x3E, 0x40, 0x40, 0x7F},
+    ['3'] = {0x3C, 0x42, 0x01, 0x01, 0x1E, 0x01, 0x42, 0x3C},
+    ['4'] = {0x04, 0x0C, 0x14, 0x24, 0x44, 0x7F, 0x04, 0x04},
+    ['5'] = {0x7F, 0x40, 0x40, 0x7C, 0x02, 0x01, 0x42, 0x3C},
+    ['6'] = {0x3C, 0x42, 0x80, 0xFC, 0x82, 0x81, 0x42, 0x3C},
+    ['7'] = {0x7F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40},
+    ['8'] = {0x3C, 0x42, 0x81, 0x42, 0x3C, 0x42, 0x81, 0x3C},
+    ['9'] = {0x3C, 0x42, 0x81, 0x43, 0x3D, 0x01, 0x42, 0x3C},
+    [':'] = {0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x18, 0x18},
+    [';'] = {0x00, 0x18, 0x18, 0x00, 0x00, 0x18, 0x18, 0x20},
+    ['<'] = {0x00, 0x00, 0x06, 0x18, 0x60, 0x18, 0x06, 0x00},
+    ['='] = {0x00, 0x00, 0x7E, 0x00, 0x00, 0x7E, 0x00, 0x00},
+    ['>'] = {0x00, 0x00, 0x60, 0x18, 0x06, 0x18, 0x60, 0x00},
+    ['?'] = {0x3C, 0x42, 0x02, 0x04, 0x08, 0x10, 0x00, 0x10},
+    ['@'] = {0x3C, 0x42, 0x99, 0xA5, 0xA5, 0x9E, 0x40, 0x3E},
+    ['A'] = {0x3C, 0x42, 0x81, 0x81, 0xFF, 0x81, 0x81, 0x81},
+    ['B'] = {0xFC, 0x82, 0x81, 0x82, 0xFC, 0x82, 0x81, 0xFC},
+    ['C'] = {0x3C, 0x42, 0x81, 0x80, 0x80, 0x81, 0x42, 0x3C},
+    ['D'] = {0xFC, 0x82, 0x81, 0x81, 0x81, 0x81, 0x82, 0xFC},
+    ['E'] = {0xFF, 0x80, 0x80, 0xFC, 0x80, 0x80, 0x80, 0xFF},
+    ['F'] = {0xFF, 0x80, 0x80, 0xFC, 0x80, 0x80, 0x80, 0x80},
+    ['G'] = {0x3C, 0x42, 0x81, 0x80, 0x87, 0x81, 0x42, 0x3C},
+    ['H'] = {0x81, 0x81, 0x81, 0xFF, 0x81, 0x81, 0x81, 0x81},
+    ['I'] = {0x7E, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x7E},
+    ['J'] = {0x01, 0x01, 0x01, 0x01, 0x01, 0x81, 0x42, 0x3C},
+    ['K'] = {0x81, 0x82, 0x84, 0xF8, 0x84, 0x82, 0x81, 0x81},
+    ['L'] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0xFF},
+    ['M'] = {0x81, 0xC3, 0xA5, 0x99, 0x81, 0x81, 0x81, 0x81},
+    ['N'] = {0x81, 0xC1, 0xA1, 0x91, 0x89, 0x85, 0x83, 0x81},
+    ['O'] = {0x3C, 0x42, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C},
+    ['P'] = {0xFC, 0x82, 0x81, 0x82, 0xFC, 0x80, 0x80, 0x80},
+    ['Q'] = {0x3C, 0x42, 0x81, 0x81, 0x81, 0xA1, 0x42, 0x3D},
+    ['R'] = {0xFC, 0x82, 0x81, 0x82, 0xFC, 0x84, 0x82, 0x81},
+    ['S'] = {0x3C, 0x42, 0x80, 0x3C, 0x02, 0x01, 0x42, 0x3C},
+    ['T'] = {0xFF, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10},
+    ['U'] = {0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C},
+    ['V'] = {0x81, 0x81, 0x81, 0x81, 0x42, 0x42, 0x24, 0x18},
+    ['W'] = {0x81, 0x81, 0x81, 0x81, 0x99, 0xA5, 0xC3, 0x81},
+    ['X'] = {0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81},
+    ['Y'] = {0x81, 0x42, 0x24, 0x18, 0x10, 0x10, 0x10, 0x10},
+    ['Z'] = {0xFF, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0xFF},
+    ['['] = {0x3C, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3C},
+    ['\\'] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01},
+    [']'] = {0x3C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x3C},
+    ['^'] = {0x18, 0x24, 0x42, 0x00, 0x00, 0x00, 0x00, 0x00},
+    ['_'] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF},
+    ['`'] = {0x30, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    ['a'] = {0x00, 0x00, 0x00, 0x3C, 0x02, 0x3E, 0x42, 0x3E},
+    ['b'] = {0x40, 0x40, 0x40, 0x7C, 0x42, 0x42, 0x42, 0x7C},
+    ['c'] = {0x00, 0x00, 0x00, 0x3C, 0x42, 0x40, 0x42, 0x3C},
+    ['d'] = {0x02, 0x02, 0x02, 0x3E, 0x42, 0x42, 0x42, 0x3E},
+    ['e'] = {0x00, 0x00, 0x00, 0x3C, 0x42, 0x7E, 0x40, 0x3E},
+    ['f'] = {0x1C, 0x20, 0x20, 0x7C, 0x20, 0x20, 0x20, 0x20},
+    ['g'] = {0x00, 0x00, 0x3E, 0x42, 0x42, 0x3E, 0x02, 0x7C},
+    ['h'] = {0x40, 0x40, 0x40, 0x7C, 0x42, 0x42, 0x42, 0x42},
+    ['i'] = {0x00, 0x10, 0x00, 0x30, 0x10, 0x10, 0x10, 0x38},
+    ['j'] = {0x00, 0x04, 0x00, 0x0C, 0x04, 0x04, 0x44, 0x38},
+    ['k'] = {0x40, 0x40, 0x40, 0x44, 0x48, 0x70, 0x48, 0x44},
+    ['l'] = {0x30, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x38},
+    ['m'] = {0x00, 0x00, 0x00, 0x6C, 0x92, 0x92, 0x92, 0x92},
+    ['n'] = {0x00, 0x00, 0x00, 0x5C, 0x62, 0x42, 0x42, 0x42},
+    ['o'] = {0x00, 0x00, 0x00, 0x3C, 0x42, 0x42, 0x42, 0x3C},
+    ['p'] = {0x00, 0x00, 0x7C, 0x42, 0x42, 0x7C, 0x40, 0x40},
+    ['q'] = {0x00, 0x00, 0x3E, 0x42, 0x42, 0x3E, 0x02, 0x02},
+    ['r'] = {0x00, 0x00, 0x00, 0x5C, 0x62, 0x40, 0x40, 0x40},
+    ['s'] = {0x00, 0x00, 0x00, 0x3E, 0x40, 0x3C, 0x02, 0x7C},
+    ['t'] = {0x00, 0x20, 0x20, 0x7C, 0x20, 0x20, 0x22, 0x1C},
+    ['u'] = {0x00, 0x00, 0x00, 0x42, 0x42, 0x42, 0x46, 0x3A},
+    ['v'] = {0x00, 0x00, 0x00, 0x42, 0x42, 0x24, 0x24, 0x18},
+    ['w'] = {0x00, 0x00, 0x00, 0x82, 0x82, 0x92, 0x92, 0x6C},
+    ['x'] = {0x00, 0x00, 0x00, 0x42, 0x24, 0x18, 0x24, 0x42},
+    ['y'] = {0x00, 0x00, 0x42, 0x42, 0x42, 0x3E, 0x02, 0x7C},
+    ['z'] = {0x00, 0x00, 0x00, 0x7E, 0x04, 0x18, 0x20, 0x7E},
+    ['{'] = {0x0C, 0x10, 0x10, 0x60, 0x10, 0x10, 0x10, 0x0C},
+    ['|'] = {0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18},
+    ['}'] = {0x30, 0x08, 0x08, 0x06, 0x08, 0x08, 0x08, 0x30},
+    ['~'] = {0x00, 0x00, 0x00, 0x71, 0x8E, 0x00, 0x00, 0x00},
+    // 0x7F (DEL): この表にない文字の代わりに表示する四角
+    [0x7F] = {0xFF, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0xFF},
+};
@@ -0,0 +1,26 @@
+// ホストビルド用の hardware/gpio.h の代わり (ピンの設定は何もしない)
+// SIO で動かしたピンは、シミュレータの I2C バスの SDA/SCL として扱う (バスを解放する手順を模擬するため)
+#ifndef HOST_HARDWARE_GPIO_H
+#define HOST_HARDWARE_GPIO_H
+
+#include "pico/stdlib.h"
+
+enum gpio_function
+{
+    GPIO_FUNC_I2C = 3,
+};
+
+enum gpio_dir
+{
+    GPIO_OUT = 1u,
+    GPIO_IN = 0u,
+};
+
+void gpio_set_function(uint gpio, uint fn);
+void gpio_pull_up(uint gpio);
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+
+#endif
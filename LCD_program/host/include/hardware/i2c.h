@@ -0,0 +1,47 @@
+// ホストビルド用の hardware/i2c.h の代わり
+// data_cmd への書き込みは DMA (ssd1327_sim.c) からしか行われないので、レジスタは普通の構造体として持つ
+// (clr_* の読み出しでは何も起きない。中断フラグはシミュレータが割り込みを届けるときに消す)
+#ifndef HOST_HARDWARE_I2C_H
+#define HOST_HARDWARE_I2C_H
+
+#include "pico/stdlib.h"
+
+// DW_apb_i2c のレジスタ配置 (LCD_program.c が触るものを含む先頭部分)
+typedef struct
+{
+    volatile uint32_t con, tar, sar, _pad0, data_cmd;
+    volatile uint32_t ss_scl_hcnt, ss_scl_lcnt, fs_scl_hcnt, fs_scl_lcnt, _pad1[2];
+    volatile uint32_t intr_stat, intr_mask, raw_intr_stat, rx_tl, tx_tl;
+    volatile uint32_t clr_intr, clr_rx_under, clr_rx_over, clr_tx_over, clr_rd_req, clr_tx_abrt, clr_rx_done;
+    volatile uint32_t clr_activity, clr_stop_det, clr_start_det, clr_gen_call, enable, status;
+} i2c_hw_t;
+
+typedef struct i2c_inst
+{
+    i2c_hw_t *hw;
+    bool restart_on_next;
+} i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst, i2c1_inst;
+#define i2c0 (&i2c0_inst)
+#define i2c1 (&i2c1_inst)
+
+#define I2C_IC_DATA_CMD_STOP_BITS 0x200u
+#define I2C_IC_DATA_CMD_RESTART_BITS 0x400u
+#define I2C_IC_INTR_MASK_M_STOP_DET_BITS 0x200u
+#define I2C_IC_INTR_MASK_M_TX_ABRT_BITS 0x40u
+#define I2C_IC_INTR_STAT_R_TX_ABRT_BITS 0x40u
+#define I2C_IC_RAW_INTR_STAT_STOP_DET_BITS 0x200u
+#define I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS 0x40u
+#define I2C_IC_STATUS_TFE_BITS 0x4u
+#define I2C_IC_STATUS_MST_ACTIVITY_BITS 0x20u
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate);
+int i2c_write_timeout_us(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop, uint timeout_us);
+
+static inline i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c) { return i2c->hw; }
+static inline uint i2c_get_index(i2c_inst_t *i2c) { return i2c == i2c1 ? 1 : 0; }
+static inline uint i2c_get_dreq(i2c_inst_t *i2c, bool is_tx) { return 44 + 2 * i2c_get_index(i2c) + (is_tx ? 0 : 1); }
+
+#endif
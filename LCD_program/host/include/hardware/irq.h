@@ -0,0 +1,19 @@
+// ホストビルド用の hardware/irq.h の代わり (登録したハンドラは sim_service_interrupts() から呼ばれる)
+#ifndef HOST_HARDWARE_IRQ_H
+#define HOST_HARDWARE_IRQ_H
+
+#include "pico/stdlib.h"
+
+typedef void (*irq_handler_t)(void);
+
+enum
+{
+    DMA_IRQ_0 = 10,
+    I2C0_IRQ = 36,
+    I2C1_IRQ = 37,
+};
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+#endif
@@ -0,0 +1,18 @@
+// ホストビルド用の hardware/sync.h の代わり
+// __wfe() はスリープせず、保留中の割り込み (DMA 完了、I2C の STOP 検出、アラーム) を処理して戻る
+// 割り込みは待ちループの中でしか処理しないので、割り込みの禁止と復帰は何もしない
+#ifndef HOST_HARDWARE_SYNC_H
+#define HOST_HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+void sim_service_interrupts(void);
+
+static inline void __wfe(void) { sim_service_interrupts(); }
+static inline void __wfi(void) { sim_service_interrupts(); }
+static inline void __sev(void) {}
+static inline void __dmb(void) { __sync_synchronize(); }
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void)status; }
+
+#endif
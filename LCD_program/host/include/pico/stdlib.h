@@ -0,0 +1,42 @@
+// ホスト (Linux) ビルド用の pico/stdlib.h の代わり。LCD_program.c が使う分だけを宣言する
+// 実体は ssd1327_sim.c にあり、I2C・DMA・割り込みはシミュレータの上で動く
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t; // 起動からの時間 (us)
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+#define PICO_ERROR_GENERIC (-1) // NAK などで送れなかった
+#define PICO_ERROR_TIMEOUT (-2) // 時間内に送り終わらなかった
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+
+bool stdio_init_all(void);
+void tight_loop_contents(void); // 待ちループの中で呼ばれるので、ここで保留中の割り込みを処理する
+void sleep_ms(uint32_t ms);
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void busy_wait_us(uint64_t delay_us);
+void busy_wait_until(absolute_time_t t);
+absolute_time_t get_absolute_time(void);
+absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms);
+absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us);
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to);
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void *user_data, bool fire_if_past);
+
+#endif
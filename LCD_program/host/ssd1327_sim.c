@@ -0,0 +1,822 @@
+#include <stdio.h>  // PGM の書き出しに使うためにインクルード
+#include <stdlib.h> // 故障の設定 (環境変数) を読むためにインクルード
+#include <string.h> // memset などを使うためにインクルード
+#include <time.h>   // ホストの時計 (clock_gettime, nanosleep) を使うためにインクルード
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/gpio.h"
+#include "ssd1327_sim.h"
+
+/* 定義 (マクロ) */
+#define SIM_DMA_CHANNELS 16       // 模擬する DMA チャネルの数
+#define SIM_IRQ_COUNT 64          // 模擬する割り込み番号の数
+#define SIM_COMMAND_MAX 16        // 1 つのコマンドの最大バイト数 (0xB8 グレースケール表 = コマンド + 15 バイト)
+#define SIM_START_STOP_BITS 2     // トランザクションごとの START と STOP 条件 (それぞれ 1 ビット分として数える)
+#define SIM_BITS_PER_BYTE 9       // 1 バイトあたりのビット数 (8 ビット + ACK)
+#define SIM_PANEL_MAX 4           // 模擬するパネルの数 (各 I2C に 2 つのアドレス)
+#define SIM_OVERSPEED_NAK_INTERVAL 97 // 配線が耐えられる速度を超えたときに NAK になるバイトの間隔
+#define SIM_STALL_PULSES 3        // SDA を Low に保ったまま止まったスレーブが、SDA を放すまでに必要な SCL のパルス数
+
+/* 型定義 */
+
+// 制御バイトを受け取った後の解釈のしかた
+typedef enum
+{
+    SIM_EXPECT_CONTROL,   // 次のバイトは制御バイト
+    SIM_COMMAND_ONE,      // Co=1, D/C#=0：次の 1 バイトはコマンド、その後にまた制御バイトが来る
+    SIM_DATA_ONE,         // Co=1, D/C#=1：次の 1 バイトはデータ、その後にまた制御バイトが来る
+    SIM_COMMAND_STREAM,   // Co=0, D/C#=0：STOP までのバイトはすべてコマンド
+    SIM_DATA_STREAM,      // Co=0, D/C#=1：STOP までのバイトはすべてデータ
+} sim_parse_state_t;
+
+// SSD1327 の内部状態
+typedef struct
+{
+    uint8_t gddram[SSD1327_SIM_HEIGHT][SSD1327_SIM_WIDTH / 2]; // 表示 RAM (1 バイトに横 2 ピクセル)
+    uint8_t column_start, column_end;                          // コラムアドレスの範囲 (2 ピクセル単位)
+    uint8_t row_start, row_end;                                // ロウアドレスの範囲
+    uint8_t column, row;                                       // 次に書き込むアドレス
+    uint8_t start_line;                                        // 表示開始ライン (0xA1)
+    uint8_t display_offset;                                    // 表示オフセット (0xA2)
+    uint8_t contrast;                                          // コントラスト (0x81)
+    uint8_t mode;                                              // 表示モード (0xA4 通常, 0xA5 全点灯, 0xA6 全消灯, 0xA7 反転)
+    bool display_on;                                           // 0xAF でオン、0xAE でオフ
+    uint8_t hscroll[8];                                        // 水平スクロールの設定 (0x26/0x27 とその引数)
+    bool hscroll_active;                                       // 0x2F で水平スクロール中、0x2E で停止
+    uint8_t command[SIM_COMMAND_MAX];                          // 受け取り途中のコマンド
+    int command_length;                                        // command に溜めたバイト数
+    bool connected;                                            // このパネルに一度でも送られたか
+    uint bus;                                                  // つながっている I2C の番号
+    uint8_t address;                                           // I2C アドレス
+} ssd1327_sim_t;
+
+/* グローバル変数 */
+static i2c_hw_t sim_i2c_hw[2];
+i2c_inst_t i2c0_inst = {&sim_i2c_hw[0], false};
+i2c_inst_t i2c1_inst = {&sim_i2c_hw[1], false};
+static uint sim_i2c_baudrate[2] = {100000, 100000}; // 各 I2C の通信速度 (バス時間の計算に使う)
+static bool sim_in_transaction[2];                  // START を送ってまだ STOP を送っていないか
+static bool sim_stop_pending[2];                    // STOP 検出割り込みをまだ届けていないか
+static sim_parse_state_t parse_state[2];            // 各 I2C のトランザクションの解釈の状態
+static ssd1327_sim_t *sim_target[2];                // 各 I2C のトランザクションの送り先のパネル
+static uint64_t sim_bus_ns[2];                      // 各 I2C のバス上の所要時間 (ns)
+static uint64_t sim_bus_total_ns[2];                // 各 I2C のバス上の所要時間の起動時からの合計 (ns。統計をリセットしても戻さない)
+static bool sim_aborted[2];                         // NAK で中断して、まだ中断割り込みを届けていないか (その間 data_cmd への書き込みは捨てる)
+static bool sim_stalled[2];                         // スレーブが SDA を Low に保ったまま止まっているか (その間は何も送れない)
+static int sim_stall_pulses[2];                     // 止まってから SCL を手で動かした回数
+
+// 故障の設定 (環境変数で与える。0 なら起こさない)
+static struct
+{
+    bool loaded;
+    uint max_hz;        // SSD1327_SIM_MAX_HZ：これより速い通信速度では SIM_OVERSPEED_NAK_INTERVAL バイトごとに NAK になる (配線の限界)
+    uint nak_every;     // SSD1327_SIM_NAK_EVERY：通信速度によらず、このバイト数ごとに NAK になる (ノイズ)
+    uint stall_every;   // SSD1327_SIM_STALL_EVERY：このトランザクション数ごとに、スレーブが SDA を Low に保ったまま止まる
+    uint32_t overspeed_bytes[2], bytes[2], transactions[2];
+} sim_faults;
+
+static ssd1327_sim_t panels[SIM_PANEL_MAX]; // (I2C, アドレス) ごとのパネル。最初に送られたときにつながったことにする
+static const ssd1327_sim_t panel_reset = {  // リセット直後のパネルの状態
+    .column_end = 63,
+    .row_end = 127,
+    .contrast = 0x7f,
+    .mode = 0xa4,
+};
+static ssd1327_sim_stats_t sim_stats;
+
+// DMA チャネルの状態
+static struct
+{
+    bool claimed;
+    volatile void *write_addr;
+    enum dma_channel_transfer_size size;
+    bool irq0_enabled;
+    bool irq0_pending;
+} sim_dma[SIM_DMA_CHANNELS];
+
+static irq_handler_t sim_irq_handlers[SIM_IRQ_COUNT];
+static bool sim_irq_enabled[SIM_IRQ_COUNT];
+static bool sim_in_interrupt = false; // 割り込みハンドラの中から再び割り込みを処理しないようにする
+
+// アラーム (同時に 1 つだけ)
+static alarm_callback_t sim_alarm_callback;
+static void *sim_alarm_user_data;
+static absolute_time_t sim_alarm_time;
+
+/* 故障の模擬 */
+
+// 環境変数から故障の設定を読む関数 (最初の I2C の初期化で 1 回だけ)
+static void sim_load_faults(void)
+{
+    if (sim_faults.loaded)
+    {
+        return;
+    }
+    sim_faults.loaded = true;
+    const char *value;
+    if ((value = getenv("SSD1327_SIM_MAX_HZ")) != NULL)
+    {
+        sim_faults.max_hz = (uint)strtoul(value, NULL, 10);
+    }
+    if ((value = getenv("SSD1327_SIM_NAK_EVERY")) != NULL)
+    {
+        sim_faults.nak_every = (uint)strtoul(value, NULL, 10);
+    }
+    if ((value = getenv("SSD1327_SIM_STALL_EVERY")) != NULL)
+    {
+        sim_faults.stall_every = (uint)strtoul(value, NULL, 10);
+    }
+}
+
+// I2C index で次に送るバイトが NAK になるかを返す関数
+static bool sim_fault_nak(uint index)
+{
+    if (sim_faults.max_hz != 0 && sim_i2c_baudrate[index] > sim_faults.max_hz &&
+        ++sim_faults.overspeed_bytes[index] % SIM_OVERSPEED_NAK_INTERVAL == 0)
+    {
+        return true;
+    }
+    return sim_faults.nak_every != 0 && ++sim_faults.bytes[index] % sim_faults.nak_every == 0;
+}
+
+// I2C index で次に始めるトランザクションで、スレーブが止まるかを返す関数
+static bool sim_fault_stall(uint index)
+{
+    return sim_faults.stall_every != 0 && ++sim_faults.transactions[index] % sim_faults.stall_every == 0;
+}
+
+/* SSD1327 の模擬 */
+
+// I2C bus のアドレス address のパネルを返す関数 (create が true なら、まだなければつなぐ。つなげなければ NULL)
+static ssd1327_sim_t *sim_panel_at(uint bus, uint8_t address, bool create)
+{
+    for (int i = 0; i < SIM_PANEL_MAX; i++)
+    {
+        if (panels[i].connected && panels[i].bus == bus && panels[i].address == address)
+        {
+            return &panels[i];
+        }
+    }
+    for (int i = 0; create && i < SIM_PANEL_MAX; i++)
+    {
+        if (!panels[i].connected)
+        {
+            panels[i] = panel_reset;
+            panels[i].connected = true;
+            panels[i].bus = bus;
+            panels[i].address = address;
+            return &panels[i];
+        }
+    }
+    return NULL;
+}
+
+// コマンドの先頭バイトから、引数を含めたコマンド全体のバイト数を返す関数
+static int sim_command_length(uint8_t command)
+{
+    switch (command)
+    {
+    case 0x15: // コラムアドレス設定
+    case 0x75: // ロウアドレス設定
+        return 3;
+    case 0x26: // 右方向の水平スクロール設定
+    case 0x27: // 左方向の水平スクロール設定
+        return 8;
+    case 0xb8: // グレースケール表の設定
+        return 16;
+    case 0x81: case 0x87: case 0xa0: case 0xa1: case 0xa2: case 0xa8: case 0xab: case 0xad:
+    case 0xb0: case 0xb1: case 0xb3: case 0xb6: case 0xbc: case 0xbe: case 0xd5: case 0xfd:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// 水平スクロールで GDDRAM の内容がずれたことを模擬する関数 (止めたときに、流れた分として 1 コラム回す)
+// 実機ではスクロールした行の RAM の内容が動いているので、止めた後はその行を送り直さないと元の表示に戻らない
+static void sim_hscroll_displace(ssd1327_sim_t *panel)
+{
+    int row0 = panel->hscroll[2] & 0x7f;
+    int row1 = panel->hscroll[4] & 0x7f;
+    int column0 = panel->hscroll[5] & 0x3f;
+    int column1 = panel->hscroll[6] & 0x3f;
+    bool left = panel->hscroll[0] == 0x27;
+    for (int row = row0; row <= row1 && column0 < column1; row++)
+    {
+        uint8_t *line = panel->gddram[row];
+        if (left)
+        {
+            uint8_t first = line[column0];
+            memmove(line + column0, line + column0 + 1, column1 - column0);
+            line[column1] = first;
+        }
+        else
+        {
+            uint8_t last = line[column1];
+            memmove(line + column0 + 1, line + column0, column1 - column0);
+            line[column0] = last;
+        }
+    }
+}
+
+// 受け取り終えたコマンドを実行する関数
+static void sim_execute_command(ssd1327_sim_t *panel, const uint8_t *command)
+{
+    switch (command[0])
+    {
+    case 0x15:
+        panel->column_start = command[1] & 0x3f;
+        panel->column_end = command[2] & 0x3f;
+        panel->column = panel->column_start;
+        break;
+    case 0x75:
+        panel->row_start = command[1] & 0x7f;
+        panel->row_end = command[2] & 0x7f;
+        panel->row = panel->row_start;
+        break;
+    case 0x81:
+        panel->contrast = command[1];
+        break;
+    case 0xa1:
+        panel->start_line = command[1] & 0x7f;
+        break;
+    case 0xa2:
+        panel->display_offset = command[1] & 0x7f;
+        break;
+    case 0xa4: case 0xa5: case 0xa6: case 0xa7:
+        panel->mode = command[0];
+        break;
+    case 0xae:
+        panel->display_on = false;
+        break;
+    case 0x26: case 0x27:
+        memcpy(panel->hscroll, command, sizeof(panel->hscroll));
+        break;
+    case 0x2f:
+        panel->hscroll_active = true;
+        break;
+    case 0x2e:
+        if (panel->hscroll_active)
+        {
+            sim_hscroll_displace(panel);
+        }
+        panel->hscroll_active = false;
+        break;
+    case 0xaf:
+        panel->display_on = true;
+        break;
+    default:
+        break; // 表示内容に関係しないコマンドは読み捨てる
+    }
+}
+
+// コマンドのバイトを 1 つ受け取る関数
+static void sim_command_byte(ssd1327_sim_t *panel, uint8_t value)
+{
+    sim_stats.command_bytes++;
+    panel->command[panel->command_length++] = value;
+    if (panel->command_length == sim_command_length(panel->command[0]))
+    {
+        sim_execute_command(panel, panel->command);
+        panel->command_length = 0;
+    }
+}
+
+// 表示データのバイトを 1 つ受け取り、GDDRAM に書き込んでアドレスを進める関数
+static void sim_data_byte(ssd1327_sim_t *panel, uint8_t value)
+{
+    sim_stats.data_bytes++;
+    panel->gddram[panel->row][panel->column] = value;
+    if (panel->column++ >= panel->column_end)
+    {
+        panel->column = panel->column_start;
+        if (panel->row++ >= panel->row_end)
+        {
+            panel->row = panel->row_start;
+        }
+    }
+}
+
+// I2C index のバス上の所要時間に、bits ビットをその時点の通信速度で送る時間を加える関数
+static void sim_bus_time(uint index, uint bits)
+{
+    uint64_t ns = (uint64_t)bits * 1000000000u / sim_i2c_baudrate[index];
+    sim_bus_ns[index] += ns;
+    sim_bus_total_ns[index] += ns;
+}
+
+// I2C のバスに流れた 1 バイトを解釈する関数 (送り先のパネルがなければ数えるだけ)
+static void sim_bus_byte(uint index, uint8_t value)
+{
+    sim_stats.bytes++;
+    sim_bus_time(index, SIM_BITS_PER_BYTE);
+
+    ssd1327_sim_t *panel = sim_target[index];
+    if (panel == NULL)
+    {
+        return;
+    }
+    sim_parse_state_t *parse = &parse_state[index];
+    switch (*parse)
+    {
+    case SIM_EXPECT_CONTROL:
+        if (value & 0x80)
+        {
+            *parse = (value & 0x40) ? SIM_DATA_ONE : SIM_COMMAND_ONE;
+        }
+        else
+        {
+            *parse = (value & 0x40) ? SIM_DATA_STREAM : SIM_COMMAND_STREAM;
+        }
+        break;
+    case SIM_COMMAND_ONE:
+        sim_command_byte(panel, value);
+        *parse = SIM_EXPECT_CONTROL;
+        break;
+    case SIM_DATA_ONE:
+        sim_data_byte(panel, value);
+        *parse = SIM_EXPECT_CONTROL;
+        break;
+    case SIM_COMMAND_STREAM:
+        sim_command_byte(panel, value);
+        break;
+    case SIM_DATA_STREAM:
+        sim_data_byte(panel, value);
+        break;
+    }
+}
+
+// START 条件とアドレスバイトを送る
+static void sim_bus_start(uint index, uint8_t address)
+{
+    sim_in_transaction[index] = true;
+    sim_stats.transactions++;
+    sim_bus_time(index, SIM_BITS_PER_BYTE + SIM_START_STOP_BITS);
+    parse_state[index] = SIM_EXPECT_CONTROL; // トランザクションの先頭は制御バイト
+    sim_target[index] = sim_panel_at(index, address, true);
+    if (sim_target[index] != NULL)
+    {
+        sim_target[index]->command_length = 0;
+    }
+
+    i2c_hw_t *hw = &sim_i2c_hw[index];
+    hw->raw_intr_stat &= ~I2C_IC_RAW_INTR_STAT_STOP_DET_BITS;
+    hw->status = I2C_IC_STATUS_MST_ACTIVITY_BITS;
+}
+
+// STOP 条件を送る
+static void sim_bus_stop(uint index)
+{
+    sim_in_transaction[index] = false;
+    i2c_hw_t *hw = &sim_i2c_hw[index];
+    hw->raw_intr_stat |= I2C_IC_RAW_INTR_STAT_STOP_DET_BITS;
+    hw->status = I2C_IC_STATUS_TFE_BITS; // FIFO は空で、バスも空いている
+    sim_stop_pending[index] = true;
+}
+
+// NAK でトランザクションを中断する (I2C は FIFO の残りを捨てて STOP を出し、中断フラグを立てる)
+static void sim_bus_abort(uint index)
+{
+    sim_in_transaction[index] = false;
+    sim_aborted[index] = true;
+    i2c_hw_t *hw = &sim_i2c_hw[index];
+    hw->raw_intr_stat |= I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS;
+    hw->status = I2C_IC_STATUS_TFE_BITS;
+}
+
+// data_cmd レジスタに書き込まれた語を処理する関数 (下位 8 ビットがデータ、STOP ビットでトランザクションを終える)
+// 中断したままか、スレーブが止まっていて、バスに流れなければ false を返す
+static bool sim_i2c_data_cmd(uint index, uint8_t address, uint32_t word)
+{
+    if (sim_aborted[index] || sim_stalled[index])
+    {
+        return false;
+    }
+    if (!sim_in_transaction[index])
+    {
+        if (sim_fault_stall(index))
+        {
+            sim_stalled[index] = true; // START を出せないまま FIFO が詰まる
+            sim_stall_pulses[index] = 0;
+            return false;
+        }
+        sim_bus_start(index, address); // FIFO にデータが入ると I2C は自動で START を発行する
+    }
+    if (sim_fault_nak(index))
+    {
+        sim_bus_abort(index);
+        return false;
+    }
+    sim_bus_byte(index, word & 0xff);
+    if (word & I2C_IC_DATA_CMD_STOP_BITS)
+    {
+        sim_bus_stop(index);
+    }
+    return true;
+}
+
+void ssd1327_sim_set_faults(uint max_hz, uint nak_every, uint stall_every)
+{
+    sim_load_faults(); // 後から最初の I2C の初期化が来ても、環境変数で上書きされないようにする
+    sim_faults.max_hz = max_hz;
+    sim_faults.nak_every = nak_every;
+    sim_faults.stall_every = stall_every;
+}
+
+void ssd1327_sim_reset_stats(void)
+{
+    memset(&sim_stats, 0, sizeof(sim_stats));
+    memset(sim_bus_ns, 0, sizeof(sim_bus_ns));
+}
+
+ssd1327_sim_stats_t ssd1327_sim_get_stats(void)
+{
+    ssd1327_sim_stats_t stats = sim_stats;
+    stats.bus_ns = sim_bus_ns[0] + sim_bus_ns[1];
+    stats.busiest_ns = MAX(sim_bus_ns[0], sim_bus_ns[1]);
+    return stats;
+}
+
+uint64_t ssd1327_sim_bus_total_ns(uint bus)
+{
+    return sim_bus_total_ns[bus];
+}
+
+// 表示ライン y に出る GDDRAM のロウを返す関数 (開始ラインと表示オフセットの分だけずれる)
+static int sim_display_row(const ssd1327_sim_t *panel, int y)
+{
+    return (y + panel->start_line + panel->display_offset) % SSD1327_SIM_HEIGHT;
+}
+
+void ssd1327_sim_read_panel(uint bus, uint8_t address, uint8_t *pixels)
+{
+    const ssd1327_sim_t *panel = sim_panel_at(bus, address, false);
+    if (panel == NULL)
+    {
+        panel = &panel_reset; // 何も送られていないパネルは表示オフのまま
+    }
+    for (int y = 0; y < SSD1327_SIM_HEIGHT; y++)
+    {
+        const uint8_t *row = panel->gddram[sim_display_row(panel, y)];
+        uint8_t *out = pixels + y * (SSD1327_SIM_WIDTH / 2);
+        for (int x = 0; x < SSD1327_SIM_WIDTH / 2; x++)
+        {
+            uint8_t value = row[x];
+            if (!panel->display_on || panel->mode == 0xa6)
+            {
+                value = 0x00; // 表示オフ、または全消灯
+            }
+            else if (panel->mode == 0xa5)
+            {
+                value = 0xff; // 全点灯
+            }
+            else if (panel->mode == 0xa7)
+            {
+                value = ~value; // 反転表示
+            }
+            out[x] = value;
+        }
+    }
+}
+
+bool ssd1327_sim_write_pgm(uint bus, uint8_t address, const char *path)
+{
+    uint8_t pixels[SSD1327_SIM_WIDTH * SSD1327_SIM_HEIGHT / 2];
+    ssd1327_sim_read_panel(bus, address, pixels);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    fprintf(file, "P5\n%d %d\n255\n", SSD1327_SIM_WIDTH, SSD1327_SIM_HEIGHT);
+    for (int i = 0; i < SSD1327_SIM_WIDTH * SSD1327_SIM_HEIGHT / 2; i++)
+    {
+        uint8_t gray[2] = {(pixels[i] >> 4) * 17, (pixels[i] & 0x0f) * 17}; // 4 ビットの階調 (0〜15) を 0〜255 に広げる。上位 4 ビットが左のピクセル
+        fwrite(gray, 1, 2, file);
+    }
+    return fclose(file) == 0;
+}
+
+/* I2C */
+
+// I2C をリセットして初期化する (送信途中のトランザクションと中断フラグは消えるが、止まったスレーブはそのまま)
+uint i2c_init(i2c_inst_t *i2c, uint baudrate)
+{
+    uint index = i2c_get_index(i2c);
+    sim_load_faults();
+    sim_in_transaction[index] = false;
+    sim_aborted[index] = false;
+    sim_i2c_hw[index].raw_intr_stat = 0;
+    sim_i2c_hw[index].status = I2C_IC_STATUS_TFE_BITS;
+    sim_i2c_baudrate[index] = baudrate;
+    return baudrate;
+}
+
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate)
+{
+    sim_i2c_baudrate[i2c_get_index(i2c)] = baudrate;
+    return baudrate;
+}
+
+// NAK なら PICO_ERROR_GENERIC、スレーブが止まっていれば (時間切れまで待ったことにして) PICO_ERROR_TIMEOUT を返す
+int i2c_write_timeout_us(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop, uint timeout_us)
+{
+    (void)timeout_us; // 時間は進めないので、止まったスレーブはすぐに時間切れにする
+    uint index = i2c_get_index(i2c);
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!sim_i2c_data_cmd(index, addr, src[i] | (i + 1 == len && !nostop ? I2C_IC_DATA_CMD_STOP_BITS : 0)))
+        {
+            if (sim_stalled[index])
+            {
+                return PICO_ERROR_TIMEOUT;
+            }
+            sim_aborted[index] = false; // SDK は中断フラグを消してから戻る
+            sim_i2c_hw[index].raw_intr_stat &= ~I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS;
+            return PICO_ERROR_GENERIC;
+        }
+    }
+    return (int)len;
+}
+
+/* DMA */
+
+int dma_claim_unused_channel(bool required)
+{
+    (void)required; // 空きがなければ -1 を返す (SDK のように panic はしない)
+    for (int i = 0; i < SIM_DMA_CHANNELS; i++)
+    {
+        if (!sim_dma[i].claimed)
+        {
+            sim_dma[i].claimed = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    (void)channel;
+    return (dma_channel_config){DMA_SIZE_32};
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size)
+{
+    c->size = size;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) { (void)c, (void)incr; }
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) { (void)c, (void)incr; }
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) { (void)c, (void)dreq; }
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    sim_dma[channel].write_addr = write_addr;
+    sim_dma[channel].size = config->size;
+    if (trigger)
+    {
+        dma_channel_transfer_from_buffer_now(channel, read_addr, transfer_count);
+    }
+}
+
+// 転送は呼んだ時点で全部書き込み先に届ける。書き込み先が I2C の data_cmd ならバスに流す
+// スレーブが止まっていると FIFO が空かないので、転送は終わらない (完了割り込みも入らない)
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count)
+{
+    bool stalled = false;
+    for (uint32_t i = 0; i < transfer_count; i++)
+    {
+        uint32_t word;
+        switch (sim_dma[channel].size)
+        {
+        case DMA_SIZE_8:
+            word = ((const volatile uint8_t *)read_addr)[i];
+            break;
+        case DMA_SIZE_16:
+            word = ((const volatile uint16_t *)read_addr)[i];
+            break;
+        default:
+            word = ((const volatile uint32_t *)read_addr)[i];
+            break;
+        }
+
+        for (uint index = 0; index < 2; index++)
+        {
+            if (sim_dma[channel].write_addr == &sim_i2c_hw[index].data_cmd)
+            {
+                sim_i2c_data_cmd(index, sim_i2c_hw[index].tar, word); // 送り先は I2C の tar レジスタのアドレス
+                stalled |= sim_stalled[index];
+            }
+        }
+    }
+    sim_dma[channel].irq0_pending = !stalled; // 完了割り込みは次に割り込みを処理するときに入る
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled)
+{
+    sim_dma[channel].irq0_enabled = enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel)
+{
+    return sim_dma[channel].irq0_pending;
+}
+
+void dma_channel_acknowledge_irq0(uint channel)
+{
+    sim_dma[channel].irq0_pending = false;
+}
+
+void dma_channel_abort(uint channel)
+{
+    sim_dma[channel].irq0_pending = false;
+}
+
+/* 割り込み */
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    sim_irq_handlers[num] = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    sim_irq_enabled[num] = enabled;
+}
+
+// 割り込み番号 num のハンドラを呼ぶ (有効で、登録されていれば)
+static bool sim_raise_irq(uint num)
+{
+    if (!sim_irq_enabled[num] || sim_irq_handlers[num] == NULL)
+    {
+        return false;
+    }
+    sim_irq_handlers[num]();
+    return true;
+}
+
+// 保留中の割り込みをすべて処理する関数 (待ちループの中から呼ばれる)
+void sim_service_interrupts(void)
+{
+    if (sim_in_interrupt)
+    {
+        return;
+    }
+    sim_in_interrupt = true;
+
+    bool raised = true;
+    while (raised)
+    {
+        raised = false;
+        for (uint channel = 0; channel < SIM_DMA_CHANNELS; channel++)
+        {
+            if (sim_dma[channel].irq0_pending && sim_dma[channel].irq0_enabled)
+            {
+                raised |= sim_raise_irq(DMA_IRQ_0); // ハンドラが dma_channel_acknowledge_irq0 で保留を解く
+            }
+        }
+        for (uint index = 0; index < 2; index++)
+        {
+            i2c_hw_t *hw = &sim_i2c_hw[index];
+            if (sim_aborted[index] && (hw->intr_mask & hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS))
+            {
+                sim_aborted[index] = false; // clr_tx_abrt の読み出しの代わりに、届けるときに中断フラグを消す
+                hw->raw_intr_stat &= ~I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS;
+                hw->intr_stat = I2C_IC_INTR_STAT_R_TX_ABRT_BITS;
+                raised |= sim_raise_irq(I2C0_IRQ + index);
+                hw->intr_stat = 0;
+            }
+            else if (sim_stop_pending[index] && (hw->intr_mask & hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS))
+            {
+                sim_stop_pending[index] = false; // clr_stop_det の読み出しの代わりに、1 回だけ届ける
+                raised |= sim_raise_irq(I2C0_IRQ + index);
+            }
+        }
+    }
+
+    if (sim_alarm_callback != NULL && time_us_64() >= sim_alarm_time)
+    {
+        alarm_callback_t callback = sim_alarm_callback;
+        sim_alarm_callback = NULL;
+        callback(1, sim_alarm_user_data);
+    }
+
+    sim_in_interrupt = false;
+}
+
+/* 時間 */
+
+uint64_t time_us_64(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + now.tv_nsec / 1000;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+void busy_wait_us(uint64_t delay_us)
+{
+    uint64_t end = time_us_64() + delay_us;
+    while (time_us_64() < end)
+    {
+    }
+}
+
+void busy_wait_until(absolute_time_t t)
+{
+    while (time_us_64() < t)
+    {
+    }
+}
+
+absolute_time_t get_absolute_time(void)
+{
+    return time_us_64();
+}
+
+absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us)
+{
+    return t + us;
+}
+
+absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms)
+{
+    return t + (uint64_t)ms * 1000u;
+}
+
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return (int64_t)(to - from);
+}
+
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    (void)fire_if_past; // 期限を過ぎていれば、次に割り込みを処理するときに呼ぶ
+    sim_alarm_callback = callback;
+    sim_alarm_user_data = user_data;
+    sim_alarm_time = time;
+    return 1;
+}
+
+void sleep_ms(uint32_t ms)
+{
+    struct timespec duration = {ms / 1000, (long)(ms % 1000) * 1000000};
+    nanosleep(&duration, NULL);
+}
+
+/* そのほか */
+
+bool stdio_init_all(void)
+{
+    return true;
+}
+
+void tight_loop_contents(void)
+{
+    sim_service_interrupts();
+}
+
+void gpio_set_function(uint gpio, uint fn) { (void)gpio, (void)fn; }
+void gpio_pull_up(uint gpio) { (void)gpio; }
+
+/* GPIO (バスの解放) */
+// I2C のピンは 2 本ずつ i2c0 と i2c1 に交互に割り当てられ、偶数が SDA、奇数が SCL (GPIO 4/5 は i2c0、6/7 は i2c1)
+
+static bool sim_gpio_out[32]; // SIO の出力にしているか (出力するのは常に Low)
+
+void gpio_init(uint gpio)
+{
+    sim_gpio_out[gpio] = false;
+}
+
+// SCL を Low に引いてから放すと 1 パルスと数え、止まったスレーブは SIM_STALL_PULSES パルスで SDA を放す
+void gpio_set_dir(uint gpio, bool out)
+{
+    uint index = (gpio / 2) % 2;
+    if ((gpio & 1) && sim_gpio_out[gpio] && !out && sim_stalled[index] && ++sim_stall_pulses[index] >= SIM_STALL_PULSES)
+    {
+        sim_stalled[index] = false;
+    }
+    sim_gpio_out[gpio] = out;
+}
+
+void gpio_put(uint gpio, bool value) { (void)gpio, (void)value; } // 出力は常に Low なので、値は使わない
+
+// 出力にしていれば Low、入力ならプルアップで High (SDA はスレーブが止まっている間は Low)
+bool gpio_get(uint gpio)
+{
+    if (sim_gpio_out[gpio])
+    {
+        return false;
+    }
+    return (gpio & 1) || !sim_stalled[(gpio / 2) % 2];
+}
@@ -0,0 +1,35 @@
+// ホスト (Linux) 上で SSD1327 と I2C バスを模擬するシミュレータ
+// i2c_write_timeout_us と、data_cmd レジスタへの DMA 転送を SSD1327 のコマンドと表示データとして解釈し、
+// GDDRAM (表示 RAM) の内容と、送ったトランザクション数・バイト数・バス上の所要時間を記録する
+// パネルは (I2C の番号, アドレス) ごとに別々に持つので、2 つの I2C に 2 枚ずつ、計 4 枚までつなげる
+// 環境変数でバスの故障を起こせる (SSD1327_SIM_MAX_HZ：これより速いと NAK が出る配線の限界、
+// SSD1327_SIM_NAK_EVERY：このバイト数ごとの NAK、SSD1327_SIM_STALL_EVERY：このトランザクション数ごとに SDA を Low に保ったまま止まるスレーブ)
+#ifndef SSD1327_SIM_H
+#define SSD1327_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+
+#define SSD1327_SIM_WIDTH 128  // パネルの幅 (ピクセル)
+#define SSD1327_SIM_HEIGHT 128 // パネルの高さ (ピクセル)
+
+// バスに流れたデータの統計
+typedef struct
+{
+    uint32_t transactions;  // I2C トランザクション (START から STOP まで) の数
+    uint32_t bytes;         // アドレスバイトを除いて送ったバイト数 (制御バイトを含む)
+    uint32_t command_bytes; // そのうちコマンドとその引数として解釈したバイト数
+    uint32_t data_bytes;    // そのうち GDDRAM に書き込んだバイト数
+    uint64_t bus_ns;        // バス上の所要時間 (ns)。START/STOP、アドレス、ACK を含めたビット数を、その時点の通信速度で割ったもの (全バスの合計)
+    uint64_t busiest_ns;    // 最も長くかかったバスの所要時間 (ns)。2 つの I2C は同時に動くので、全パネルへの転送にかかる時間になる
+} ssd1327_sim_stats_t;
+
+void ssd1327_sim_set_faults(uint max_hz, uint nak_every, uint stall_every); // 故障の設定を環境変数の代わりに与える (意味は環境変数と同じ。0 なら起こさない)
+void ssd1327_sim_reset_stats(void);
+ssd1327_sim_stats_t ssd1327_sim_get_stats(void);
+uint64_t ssd1327_sim_bus_total_ns(uint bus); // I2C bus のバス上の所要時間の起動時からの合計 (ns)。ssd1327_sim_reset_stats では戻らない
+void ssd1327_sim_read_panel(uint bus, uint8_t address, uint8_t *pixels); // I2C bus のアドレス address のパネルにいま表示されている内容を、フレームバッファと同じ並び (1 バイトに横 2 ピクセル) で読み出す
+bool ssd1327_sim_write_pgm(uint bus, uint8_t address, const char *path); // I2C bus のアドレス address のパネルにいま表示されている内容を PGM 画像として書き出す
+
+#endif
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""font8x8.h の 8x8 フォントから、文字の索引と字形のテーブルを生成する。
+
+LCD_program のビルド時に CMake から呼ばれ、次のものをフラッシュに置く const 配列として出力する。
+
+- 文字コード (0〜127) から字形番号を引く 128 バイトの索引。表にない文字は 0x7F の字形 (四角) になる
+- 同じ形の字形を 1 つにまとめた 8x8 の字形 (1 ビット 1 ピクセル、1 字形 8 バイト)
+- 指定したスケールごとに、横方向だけ拡大して「1 バイトに横 2 ピクセル」の SSD1327 と同じ並びに
+  展開した字形。縦方向は同じ行を scale 回描けばよいので、元の 8 行分だけを持つ。
+  点灯ピクセルは 0xF、消灯は 0x0 になるので、描画側ではこの値をマスクとして明るさを重ねる。
+
+--rle を付けると、拡大した字形を (繰り返し回数, 値) の組の並びに圧縮して出力する。
+"""
+
+import argparse
+import ast
+import re
+import sys
+
+FONT_INDEX_SIZE = 128   # 索引に載せる文字コードの数 (7 ビット ASCII)
+MISSING_CODE = 0x7F     # 表にない文字の代わりに使う字形の文字コード
+
+
+def parse_font(path):
+    """font8x8.h を読み込み、{文字コード: 8 バイトのリスト} を返す。"""
+    with open(path, encoding="utf-8") as f:
+        text = f.read()
+    # コメントを除いてから [文字] = { 0x.., ... } の並びを拾う
+    text = re.sub(r"//[^\n]*", "", text)
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    body = text[text.index("=") + 1:]
+    glyphs = {}
+    for key, row in re.findall(r"\[\s*('(?:\\.|[^'\\])+'|0[xX][0-9A-Fa-f]+|\d+)\s*\]\s*=\s*\{([^{}]*)\}", body):
+        code = ord(ast.literal_eval(key)) if key.startswith("'") else int(key, 0)
+        values = [int(v, 0) for v in row.replace("\n", " ").split(",") if v.strip()]
+        if len(values) != 8:
+            sys.exit(f"{path}: 8 バイトでない字形があります: {key} {values}")
+        if not 0 <= code < FONT_INDEX_SIZE:
+            sys.exit(f"{path}: 文字コードが範囲外です: {key}")
+        glyphs[code] = values
+    if MISSING_CODE not in glyphs:
+        sys.exit(f"{path}: 表にない文字の代わりに使う字形 (0x{MISSING_CODE:02X}) がありません")
+    return glyphs
+
+
+def deduplicate(glyphs):
+    """同じ形の字形を 1 つにまとめ、(索引, 字形のリスト, 各字形を使う文字コードのリスト) を返す。"""
+    unique = []
+    users = []
+    number_of = {}
+    index = [0] * FONT_INDEX_SIZE
+    for code in sorted(glyphs):
+        shape = tuple(glyphs[code])
+        if shape not in number_of:
+            number_of[shape] = len(unique)
+            unique.append(shape)
+            users.append([])
+        index[code] = number_of[shape]
+        users[number_of[shape]].append(code)
+    missing = index[MISSING_CODE]
+    for code in range(FONT_INDEX_SIZE):
+        if code not in glyphs:
+            index[code] = missing
+    return index, unique, users
+
+
+def describe(codes):
+    """字形を使う文字の一覧をコメント用の文字列にする。"""
+    names = []
+    for code in codes:
+        ch = chr(code)
+        names.append(f"'{ch}'" if ch.isprintable() and ch not in "\\'" else f"0x{code:02X}")
+    return " ".join(names)
+
+
+def expand(glyph, scale):
+    """8x8 の字形を横に scale 倍に拡大し、行ごとに 1 バイト 2 ピクセルへ詰めたバイト列を返す (8 行分)。"""
+    width = 8 * scale
+    out = bytearray()
+    for line in glyph:
+        pixels = [0xF if line & (0x80 >> (x // scale)) else 0x0 for x in range(width)]
+        out += bytes((pixels[i] << 4) | pixels[i + 1] for i in range(0, width, 2))
+    return bytes(out)
+
+
+def rle(data):
+    """(繰り返し回数 1〜255, 値) の組の並びに圧縮する。"""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        run = 1
+        while i + run < len(data) and run < 255 and data[i + run] == data[i]:
+            run += 1
+        out += bytes((run, data[i]))
+        i += run
+    return bytes(out)
+
+
+def c_array(name, ctype, values, per_line=16):
+    lines = [f"static const {ctype} {name}[{len(values)}] = {{"]
+    for i in range(0, len(values), per_line):
+        chunk = values[i:i + per_line]
+        lines.append("    " + ", ".join(f"0x{v:02X}" if ctype == "uint8_t" else str(v) for v in chunk) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("font", help="入力する font8x8.h")
+    parser.add_argument("output", help="出力するヘッダファイル")
+    parser.add_argument("--scales", type=int, nargs="+", required=True, help="展開するスケール (例: 2 8)")
+    parser.add_argument("--rle", action="store_true", help="字形を RLE 圧縮して出力する")
+    args = parser.parse_args()
+
+    index, glyphs, users = deduplicate(parse_font(args.font))
+    scales = sorted(set(args.scales))
+    blank = glyphs.index((0,) * 8) if (0,) * 8 in glyphs else -1
+
+    parts = [
+        "// このファイルは tools/gen_glyphs.py が font8x8.h から自動生成したもの。直接編集しないこと",
+        "#ifndef GLYPHS_SCALED_H",
+        "#define GLYPHS_SCALED_H",
+        "",
+        "#include <stdint.h>",
+        "",
+        f"#define GLYPH_TABLE_RLE {1 if args.rle else 0} // 1 なら字形データは (繰り返し回数, 値) の組の並び",
+        f"#define GLYPH_TABLE_COUNT {len(scales)}",
+        f"#define FONT_INDEX_SIZE {FONT_INDEX_SIZE} // 索引に載っている文字コードの数",
+        f"#define FONT_GLYPH_COUNT {len(glyphs)} // 同じ形をまとめた後の字形の数",
+        f"#define FONT_GLYPH_MISSING {index[MISSING_CODE]} // 表にない文字に使う字形の番号",
+        f"#define FONT_GLYPH_BLANK {blank} // 何も描かない字形 (空白) の番号。なければ -1",
+        "",
+        "// 1 つのスケールに拡大した全字形のテーブル。各字形は元の 8 行分だけを持ち、1 行を縦に scale 回描く",
+        "typedef struct",
+        "{",
+        "    uint8_t scale;           // 拡大率",
+        "    uint8_t row_bytes;       // 字形 1 行あたりのバイト数 (8 * scale / 2)",
+        "    const uint8_t *data;     // 全字形のデータ",
+        "    const uint16_t *offsets; // 各字形のデータの開始位置 (字形の数 + 1 個)",
+        "} glyph_table_t;",
+        "",
+        "// 文字コード → 字形番号の索引",
+        c_array("font_glyph_index", "uint8_t", index),
+        "",
+        "// 同じ形をまとめた 8x8 の字形 (1 バイトが横 1 行、最上位ビットが左端)",
+        f"static const uint8_t font_glyphs[FONT_GLYPH_COUNT][8] = {{",
+    ]
+    for glyph, codes in zip(glyphs, users):
+        parts.append("    {" + ", ".join(f"0x{v:02X}" for v in glyph) + "}, // " + describe(codes))
+    parts.append("};")
+    parts.append("")
+
+    total = FONT_INDEX_SIZE + 8 * len(glyphs)
+    for scale in scales:
+        data = bytearray()
+        offsets = []
+        for glyph in glyphs:
+            offsets.append(len(data))
+            expanded = expand(glyph, scale)
+            data += rle(expanded) if args.rle else expanded
+        offsets.append(len(data))
+        if len(data) > 0xFFFF:
+            sys.exit(f"スケール {scale} の字形データが 64 KB を超えます ({len(data)} バイト)")
+        total += len(data) + 2 * len(offsets)
+        parts.append(f"// スケール {scale}: {len(glyphs)} 字形, {len(data)} バイト")
+        parts.append(c_array(f"glyph_data_x{scale}", "uint8_t", data))
+        parts.append(c_array(f"glyph_offsets_x{scale}", "uint16_t", offsets, per_line=12))
+        parts.append("")
+
+    parts.append(f"// テーブル全体のフラッシュ使用量: {total} バイト")
+    parts.append("static const glyph_table_t glyph_tables[GLYPH_TABLE_COUNT] = {")
+    for scale in scales:
+        parts.append(f"    {{{scale}, {4 * scale}, glyph_data_x{scale}, glyph_offsets_x{scale}}},")
+    parts.append("};")
+    parts.append("")
+    parts.append("#endif")
+    parts.append("")
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write("\n".join(parts))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,337 @@
+#!/usr/bin/env python3
+"""PGM / PNG の画像 (アニメーションのフレーム) を、SSD1327 へそのまま流し込める圧縮形式に変換する。
+
+LCD_program のビルド時に CMake から呼ばれ、フラッシュに置く const 配列としてヘッダファイルに出力する。
+画像は 128x128 の 8 ビットグレースケール (カラーは輝度に変換) で、4 ビットに減らしてから
+フレームバッファと同じ並び (1 バイトに横 2 ピクセル、上位 4 ビットが左) に詰める。
+
+- 1 フレーム目は全画面、2 フレーム目からは直前のフレームと違うバイトを囲む矩形 (ウィンドウ) だけを持つ
+- ウィンドウの中身は、行ごとに左から順に次の命令の並びに圧縮する (デコーダは 1 行分の履歴だけで展開できる)
+    0b00nnnnnn               : 続く n+1 バイトをそのまま出す (1〜64 バイト)
+    0b01nnnnnn, 値           : 値を n+1 回繰り返す (1〜64 バイト)
+    0b1nnnnnnn               : 1 行上の同じ位置のバイトを n+1 個写す (1〜128 バイト。最初の行の上は 0 とみなす)
+
+--dither を付けると、4 ビットに減らすときに 4x4 のベイヤー行列で組織的ディザをかける (写真やグラデーション向け)。
+式と行列は LCD_program.c の dither_row と同じなので、実行時に draw_gray8 で描いた画像と同じ結果になる。
+
+--demo を付けると、画像ファイルの代わりに動作確認用のアニメーション (グラデーションの上を玉が跳ねる) を生成する。
+"""
+
+import argparse
+import math
+import struct
+import sys
+import zlib
+
+WIDTH = 128   # パネルの幅
+HEIGHT = 128  # パネルの高さ
+LITERAL_MAX = 64
+RUN_MAX = 64
+COPY_MAX = 128
+BAYER4 = [          # 4x4 のベイヤー行列 (LCD_program.c の dither_bayer4 と同じ)
+    [0, 8, 2, 10],
+    [12, 4, 14, 6],
+    [3, 11, 1, 9],
+    [15, 7, 13, 5],
+]
+
+
+def read_pgm(path):
+    """PGM (P5 バイナリ / P2 テキスト) を読み込み、(幅, 高さ, 0〜255 の画素のリスト) を返す。"""
+    with open(path, "rb") as f:
+        data = f.read()
+    tokens = []
+    position = 0
+    while len(tokens) < 4:
+        while data[position:position + 1].isspace():
+            position += 1
+        if data[position:position + 1] == b"#":
+            position = data.index(b"\n", position)
+            continue
+        start = position
+        while not data[position:position + 1].isspace():
+            position += 1
+        tokens.append(data[start:position])
+    magic, width, height, maxval = tokens[0], int(tokens[1]), int(tokens[2]), int(tokens[3])
+    if magic == b"P5":
+        body = data[position + 1:]
+        if maxval < 256:
+            values = list(body[:width * height])
+        else:
+            values = list(struct.unpack(f">{width * height}H", body[:2 * width * height]))
+    elif magic == b"P2":
+        values = [int(v) for v in data[position:].split()[:width * height]]
+    else:
+        sys.exit(f"{path}: P5 / P2 形式の PGM ではありません")
+    if len(values) != width * height:
+        sys.exit(f"{path}: 画素が足りません")
+    return width, height, [v * 255 // maxval for v in values]
+
+
+def read_png(path):
+    """PNG (8 ビット、インターレースなし) を読み込み、(幅, 高さ, 0〜255 の輝度のリスト) を返す。"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        sys.exit(f"{path}: PNG ではありません")
+    position = 8
+    compressed = b""
+    palette = None
+    while position < len(data):
+        length, kind = struct.unpack(">I4s", data[position:position + 8])
+        chunk = data[position + 8:position + 8 + length]
+        position += 12 + length
+        if kind == b"IHDR":
+            width, height, depth, color, _, _, interlace = struct.unpack(">IIBBBBB", chunk)
+        elif kind == b"PLTE":
+            palette = [tuple(chunk[i:i + 3]) for i in range(0, len(chunk), 3)]
+        elif kind == b"IDAT":
+            compressed += chunk
+        elif kind == b"IEND":
+            break
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}.get(color)
+    if depth != 8 or interlace != 0 or channels is None:
+        sys.exit(f"{path}: 8 ビット・インターレースなしの PNG だけに対応しています")
+
+    raw = zlib.decompress(compressed)
+    stride = width * channels
+    rows = []
+    previous = bytearray(stride)
+    position = 0
+    for _ in range(height):
+        kind = raw[position]
+        line = bytearray(raw[position + 1:position + 1 + stride])
+        position += 1 + stride
+        for i in range(stride):
+            left = line[i - channels] if i >= channels else 0
+            up = previous[i]
+            corner = previous[i - channels] if i >= channels else 0
+            if kind == 1:
+                line[i] = (line[i] + left) & 0xFF
+            elif kind == 2:
+                line[i] = (line[i] + up) & 0xFF
+            elif kind == 3:
+                line[i] = (line[i] + (left + up) // 2) & 0xFF
+            elif kind == 4:
+                p = left + up - corner
+                pa, pb, pc = abs(p - left), abs(p - up), abs(p - corner)
+                predictor = left if pa <= pb and pa <= pc else (up if pb <= pc else corner)
+                line[i] = (line[i] + predictor) & 0xFF
+        rows.append(line)
+        previous = line
+
+    values = []
+    for line in rows:
+        for x in range(width):
+            pixel = line[x * channels:(x + 1) * channels]
+            if color == 3:
+                pixel = palette[pixel[0]]
+            if len(pixel) >= 3:
+                values.append((299 * pixel[0] + 587 * pixel[1] + 114 * pixel[2] + 500) // 1000)
+            else:
+                values.append(pixel[0])
+    return width, height, values
+
+
+def read_image(path):
+    width, height, values = read_png(path) if path.lower().endswith(".png") else read_pgm(path)
+    if (width, height) != (WIDTH, HEIGHT):
+        sys.exit(f"{path}: {WIDTH}x{HEIGHT} の画像だけに対応しています ({width}x{height})")
+    return values
+
+
+def demo_frames(count):
+    """動作確認用のアニメーション: 縦のグラデーションの上を、明るい玉が跳ねながら横切る。"""
+    frames = []
+    for t in range(count):
+        cx = 16 + (WIDTH - 32) * t / max(count - 1, 1)
+        cy = HEIGHT - 20 - 80 * abs(math.sin(math.pi * 2 * t / count))
+        values = []
+        for y in range(HEIGHT):
+            for x in range(WIDTH):
+                if (x - cx) ** 2 + (y - cy) ** 2 <= 12 ** 2:
+                    values.append(255)
+                else:
+                    values.append(y * 160 // HEIGHT)
+        frames.append(values)
+    return frames
+
+
+def quantize(values, dither=False):
+    """0〜255 の画素を 4 ビットの階調に丸め (dither なら組織的ディザをかけ)、1 バイト 2 ピクセルに詰めたバイト列を返す。"""
+    if dither:
+        levels = [(v * 241 + BAYER4[(i // WIDTH) & 3][(i % WIDTH) & 3] * 256 + 128) >> 12 for i, v in enumerate(values)]
+    else:
+        levels = [(v * 15 + 127) // 255 for v in values]
+    return bytes((levels[i] << 4) | levels[i + 1] for i in range(0, len(levels), 2))
+
+
+def changed_window(previous, current):
+    """直前のフレームと違うバイトを囲むウィンドウを (列0, 行0, 列1, 行1) で返す (列はバイト単位)。同じなら None。"""
+    row_bytes = WIDTH // 2
+    if previous is None:
+        return 0, 0, row_bytes - 1, HEIGHT - 1
+    columns = []
+    rows = []
+    for i, (a, b) in enumerate(zip(previous, current)):
+        if a != b:
+            rows.append(i // row_bytes)
+            columns.append(i % row_bytes)
+    if not rows:
+        return None
+    return min(columns), min(rows), max(columns), max(rows)
+
+
+def encode(window):
+    """ウィンドウの行 (bytes のリスト) を命令の並びに圧縮する。"""
+    out = bytearray()
+    above = bytes(len(window[0]))
+    for row in window:
+        literal = bytearray()
+
+        def flush_literal():
+            for i in range(0, len(literal), LITERAL_MAX):
+                part = literal[i:i + LITERAL_MAX]
+                out.append(len(part) - 1)
+                out.extend(part)
+            literal.clear()
+
+        x = 0
+        while x < len(row):
+            copy = 0
+            while x + copy < len(row) and copy < COPY_MAX and row[x + copy] == above[x + copy]:
+                copy += 1
+            run = 1
+            while x + run < len(row) and run < RUN_MAX and row[x + run] == row[x]:
+                run += 1
+            if copy >= 1 and copy >= run:
+                flush_literal()
+                out.append(0x80 | (copy - 1))
+                x += copy
+            elif run >= 3:
+                flush_literal()
+                out += bytes((0x40 | (run - 1), row[x]))
+                x += run
+            else:
+                literal.append(row[x])
+                x += 1
+        flush_literal()
+        above = row
+    return bytes(out)
+
+
+def decode(data, row_bytes, rows):
+    """encode の逆 (出力の確認用)。"""
+    out = bytearray()
+    above = bytearray(row_bytes)
+    position = 0
+    while len(out) < row_bytes * rows:
+        op = data[position]
+        position += 1
+        count = (op & 0x7F if op & 0x80 else op & 0x3F) + 1
+        for _ in range(count):
+            if op & 0x80:
+                value = above[len(out) % row_bytes]
+            elif op & 0x40:
+                value = data[position]
+            else:
+                value = data[position]
+                position += 1
+            above[len(out) % row_bytes] = value
+            out.append(value)
+        if op & 0xC0 == 0x40:
+            position += 1
+    return bytes(out)
+
+
+def pack(name, frames, dither):
+    """フレームのリストを 1 つのアニメーションとして圧縮し、(C のソース行のリスト, 圧縮後のバイト数) を返す。"""
+    data = bytearray()
+    entries = []
+    previous = None
+    for values in frames:
+        current = quantize(values, dither)
+        window = changed_window(previous, current)
+        if window is None:
+            entries.append((1, 0, 0, 0, len(data)))  # 変化なし (x0 > x1)
+        else:
+            c0, r0, c1, r1 = window
+            rows = [current[y * (WIDTH // 2) + c0:y * (WIDTH // 2) + c1 + 1] for y in range(r0, r1 + 1)]
+            encoded = encode(rows)
+            if decode(encoded, c1 - c0 + 1, r1 - r0 + 1) != b"".join(rows):
+                sys.exit(f"{name}: 圧縮したデータが元に戻りません")
+            entries.append((2 * c0, r0, 2 * c1 + 1, r1, len(data)))
+            data += encoded
+        previous = current
+
+    lines = [f"// {name}: {len(frames)} フレーム, {len(data)} バイト (圧縮前 {len(frames) * WIDTH * HEIGHT // 2} バイト)"]
+    lines.append(f"static const uint8_t {name}_data[{max(len(data), 1)}] = {{")
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join(f"0x{v:02X}" for v in data[i:i + 16]) + ",")
+    lines.append("};")
+    lines.append(f"static const image_frame_t {name}_frames[{len(entries)}] = {{")
+    for x0, y0, x1, y1, offset in entries:
+        lines.append(f"    {{{x0}, {y0}, {x1}, {y1}, {offset}}},")
+    lines.append("};")
+    lines.append(f"static const image_t {name} = {{{len(entries)}, {name}_frames, {name}_data}};")
+    lines.append("")
+    return lines, len(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="出力するヘッダファイル")
+    parser.add_argument("--animation", nargs="+", action="append", default=[], metavar=("NAME", "FILE"),
+                        help="名前と、そのフレームにする PGM / PNG ファイルの並び (繰り返し指定できる)")
+    parser.add_argument("--dither", action="store_true", help="4 ビットに減らすときに組織的ディザをかける")
+    parser.add_argument("--demo", metavar="NAME", help="動作確認用のアニメーションを NAME という名前で生成する")
+    parser.add_argument("--demo-frames", type=int, default=24, help="動作確認用のアニメーションのフレーム数")
+    args = parser.parse_args()
+
+    assets = [(entry[0], [read_image(path) for path in entry[1:]]) for entry in args.animation]
+    if args.demo:
+        assets.append((args.demo, demo_frames(args.demo_frames)))
+    for name, frames in assets:
+        if not frames:
+            sys.exit(f"{name}: フレームがありません")
+
+    parts = [
+        "// このファイルは tools/pack_images.py が自動生成したもの。直接編集しないこと",
+        "#ifndef IMAGES_H",
+        "#define IMAGES_H",
+        "",
+        "#include <stdint.h>",
+        "",
+        "// 圧縮した画像の 1 フレーム。直前のフレームから変わった矩形 (ウィンドウ) の中身だけを持つ",
+        "typedef struct",
+        "{",
+        "    uint8_t x0, y0;  // ウィンドウの左上 (x0 は偶数)",
+        "    uint8_t x1, y1;  // ウィンドウの右下 (x1 は奇数)。x0 > x1 なら直前のフレームと同じ",
+        "    uint32_t offset; // 圧縮データの開始位置",
+        "} image_frame_t;",
+        "",
+        "// 圧縮した画像 (アニメーション)。1 フレーム目は全画面で、2 フレーム目からは直前のフレームとの差分",
+        "typedef struct",
+        "{",
+        "    uint16_t frame_count;        // フレーム数",
+        "    const image_frame_t *frames; // 各フレームのウィンドウと圧縮データの位置",
+        "    const uint8_t *data;         // 圧縮データ",
+        "} image_t;",
+        "",
+    ]
+    total = 0
+    for name, frames in assets:
+        lines, size = pack(name, frames, args.dither)
+        parts += lines
+        total += size
+    parts.append(f"// 画像全体のフラッシュ使用量: {total} バイト")
+    parts.append("")
+    parts.append("#endif")
+    parts.append("")
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write("\n".join(parts))
+
+
+if __name__ == "__main__":
+    main()
@@ -2,11 +2,18 @@
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
 #include "hardware/timer.h"
-#include "hardware/adc.h"
+#include "hardware/sync.h"
+#include "debounce.h"
+#include "adc_capture.h"
+#include "curve.h"
+#include "tone.h"
 
 // 読み取るADチャネルを定義
 // 0: GP26 (ADC0) 照度センサ
-#define ADC_CHANNEL 0
+#define ADC_LIGHT 0
+
+// ADCで照度センサを読む周波数 (Hz)
+#define ADC_SAMPLE_RATE_HZ 8000
 
 // GPIOピンの定義
 #define BUTTON_PIN 3  // ボタンが接続されているGPIOピン番号
@@ -15,172 +22,117 @@
 // タイマー割り込みの周期 (ms)
 #define TIMER_INTERVAL_MS 10
 
-// ボタンの状態を格納するグローバル変数（volatileキーワードで最適化を防ぐ）
-volatile bool button_pressed = false; // ボタンが押されたかどうかを示すフラグ
-bool Current_BUTTON_State;   // 現在のボタンの状態を格納する変数
-bool Prev_BUTTON_State; // 前回のボタンの状態を格納する変数
+// エッジ割り込みでボタンを読むときに、確定してからチャタリングを無視する時間 (us)
+#define BUTTON_LOCKOUT_US 20000
 
-// BUZZERのデューティサイクルの定義
-#define BUZZER_OFF 1.0 // 常にHigh → 鳴らない
+// チャタリング除去 (押されている状態がこの回数続いたら確定する)
+#define DEBOUNCE_SAMPLES 3
 
-// ラの音（A3）を再生する関数
-// 引数: slice_num - PWMスライス番号(PWM機能を構成する独立した信号生成ユニット)
-void play_note_a(uint slice_num,float duty)
-{
-    int freq = 220; // ラの音（A3）の周波数（220Hz）
-
-    // pwm_set_clkdiv()はPWMのクロック分周比を設定する関数
-    // 125.0fはPWMのクロック分周比（125MHz / 125 = 1MHz）を指定している
-    // つまり、PWMのクロックは1MHzになり
-    // 例えば、1MHzのクロックで、周期を1000に設定すると、1kHzの音が鳴る
-    pwm_set_clkdiv(slice_num, 125.0f);
-
-    // PWMの周期を設定
-    // pwm_set_wrap()はPWMの周期を設定する関数
-    pwm_set_wrap(slice_num, 125000 / freq);
-
-    // pwm_set_chan_level()はPWMのデューティサイクルを設定する関数
-    // 125000 / freqはPWMの周期に対するデューティサイクルの比率を計算している
-    // 例えば、周波数が220Hzの場合、125000 / 220 = 568.18...となる
-    // これをデューティサイクルの比率として使用することで、音の大きさを調整できる
-    // 0.3はデューティサイクルの比率（30%）を指定している
-    pwm_set_chan_level(slice_num, PWM_CHAN_A, (125000 / freq) * duty);
-}
+// ボタンのチャタリング除去の状態（タイマー割り込みで更新される）
+debounce_t buttons;
 
-static int count = 0; //ボタンの連続状態をカウントする変数
-int adc_value = 0;// ADCから読み取った値を格納する変数
 
-// タイマー割り込み関数
-bool timer_callback(struct repeating_timer *rt)
-{
-    if( gpio_get(BUTTON_PIN) == 0 ){    
-        Current_BUTTON_State = true;    //LOWになったらボタンが押された
-    } else {
-        Current_BUTTON_State = false;   //HIGHになったらボタンが離された
-    }
+// 押しているあいだに照度センサを読み直す周期 (ms)
+#define SENSOR_INTERVAL_MS 10
 
-    if(Current_BUTTON_State == Prev_BUTTON_State){      //ボタンの状態が前回と一致しているか
-        if(count < 3){                                  //3回連続で同じ状態ならば
-            count++;                                    //カウントをインクリメント
-        }                                        
-        if(count >= 3){                                 //3回以上同じ状態ならば    
-            button_pressed = Current_BUTTON_State;      //ボタンの状態を確定させる 
-        }
-    }else{
-        count = 0;                                      //状態が変化したらカウントを0クリア
-    }
+// ブザーの状態 (鳴らしている音と、PWMに設定してある値)
+tone_t buzzer;
 
-    Prev_BUTTON_State = Current_BUTTON_State; // 前回の状態を更新
+// ADCの状態 (DMAで読み続け、ならした最新の値を持つ)
+adc_capture_t sensors;
 
-    return true; // 継続してタイマーを動作させる
-}
+int adc_value = 0;// ADCから読み取った値を格納する変数
 
 int command_light(){
-    adc_select_input(0); // ADCの入力チャネルを0 (GP26) に設定
-    return adc_read(); // ADCチャネルからの読み取り値を返す
+    return adc_capture_read12(&sensors, ADC_LIGHT); // ならした照度センサの最新の値を返す (ADCの変換は待たない)
 }
 
-// AD値をデューティサイクルに変換する関数
-typedef struct{
-    unsigned short ad_std;
-    float duty_std;
-}CONVERT_TO_DUTY;
-
-const CONVERT_TO_DUTY ad_duty[] = {
-    {400,1.0},
-    {800,0.9},
-    {1200,0.8},
-    {1600,0.7},
-    {2000,0.6},
-    {2400,0.5},
-    {2800,0.4},
-    {3200,0.3},
-    {3600,0.2}
+// AD値をデューティサイクルに変換する折れ線の折れ点
+// 折れ点のあいだは直線でつなぐので、明るさに合わせて音量がなめらかに変わる (折れ点の外は端の値のまま)
+// デューティ比はTONE_VOLUME_MAX (100%) を10としたときの値で書く
+#define DUTY(tenths) (TONE_VOLUME_MAX * (tenths) / 10)
+const curve_point_t ad_duty[] = {
+    {400, DUTY(10)},
+    {800, DUTY(9)},
+    {1200, DUTY(8)},
+    {1600, DUTY(7)},
+    {2000, DUTY(6)},
+    {2400, DUTY(5)},
+    {2800, DUTY(4)},
+    {3200, DUTY(3)},
+    {3600, DUTY(2)},
+    {4000, DUTY(1)}
 };
 
-float duty = 0.0;
-float Save_duty(){
+// 折れ点のまわりで照度センサの値が揺れても音量がふらつかないように、この幅 (AD値) までの変化は無視する
+#define DUTY_HYSTERESIS 8
+
+curve_t duty_curve;          // ad_dutyから作った変換表 (AD値の上位ビットで引いて、下位ビットで補間する)
+curve_follower_t duty_state; // 最後に音量を変えたときのAD値と音量
+
+uint16_t Save_duty(){
     adc_value = command_light();    // AD値を取得
-    int i = 0;
-    while(1){
-        if (adc_value <= ad_duty[i].ad_std) {   
-            duty = ad_duty[i].duty_std;
-            break;
-        }else if(adc_value > 3600){
-            duty = 0.1;
-            break;
-        }else{
-            i++;
-        }
-    }
-    return duty;
+    return curve_follow(&duty_curve, &duty_state, adc_value); // 折れ点の数によらず、表を1回引くだけ
 }
-    
 
 int main()
 {
     // 標準入出力を初期化（デバッグ用）
     stdio_init_all();
 
-        // ADC (アナログ-デジタル変換器) の初期化
-    adc_init();
-
-    // ADCを使用するGPIOピンの設定
-    // PicoのGPIOは、様々な機能に使用できる。
-    // ここでは、GP26をアナログ入力として設定する。
-    //  - gpio_set_function(ピン番号, 機能): ピンの機能を設定する。
-    //  - gpio_set_dir(ピン番号, 方向): ピンの方向を設定する (入力または出力)。
-    gpio_set_function(26, GPIO_FUNC_SIO); // GP26をSIO (標準入出力) 機能に設定
-    gpio_set_dir(26, GPIO_IN);            // GP26を入力に設定
-    
+    // ADC (アナログ-デジタル変換器) の初期化
+    // adc_capture_init()は、GP26をアナログ入力にして、DMAで照度センサを読み続ける準備をする関数
+    // 変換結果はDMAがメモリに書き込むので、CPUはADCの変換を待たなくてよい
+    adc_capture_init(&sensors, 1u << ADC_LIGHT, ADC_SAMPLE_RATE_HZ);
+    // 64サンプルずつ平均して (8msごと)、さらに新しい値を1/4ずつ混ぜてならす (ノイズで音量がふらつかないように)
+    adc_capture_set_filter(&sensors, ADC_LIGHT, 0, 2);
+    adc_capture_start(&sensors);
+
+    // AD値からデューティ比への変換表を作る (折れ点のあいだを補間する表を、ここで一度だけ作っておく)
+    curve_init(&duty_curve, ad_duty, count_of(ad_duty), DUTY_HYSTERESIS);
+
     // ボタン用GPIOの初期化
-    // gpio_init()はGPIOの初期化を行う関数
-    // gpio_set_dir()はGPIOの入出力方向を設定する関数
-    // gpio_pull_up()はGPIOのプルアップ抵抗を有効にする関数
+    // debounce_init_buttons()はボタンのピンをまとめて入力にし、プルアップ抵抗を有効にする関数
     // プルアップ抵抗とは、ボタンが押されていないときにGPIOピンをHIGHに保つための抵抗
-    gpio_init(BUTTON_PIN);
-    gpio_set_dir(BUTTON_PIN, GPIO_IN);
-    gpio_pull_up(BUTTON_PIN);
+    // 押されているとき (LOW) がDEBOUNCE_SAMPLES回続いたら押された、HIGHが続いたら離されたと確定する
+    debounce_init_buttons(&buttons, 1u << BUTTON_PIN, DEBOUNCE_SAMPLES);
 
     // ブザー用GPIOの初期化
-    // gpio_set_function()はGPIOの機能を設定する関数
-    // pwm_gpio_to_slice_num()はGPIOピン番号からPWMスライス番号を取得する関数
-    // PWMスライス番号はPWM機能を構成する独立した信号生成ユニット
-    // 例えば、GPIO12はPWM0のスライス番号0に対応している
-    gpio_set_function(BUZZER_PIN, GPIO_FUNC_PWM);
-    uint slice_num = pwm_gpio_to_slice_num(BUZZER_PIN);
-
-    // PWMの設定
-    // pwm_get_default_config()はPWMのデフォルト設定を取得する関数
-    // pwm_init()はPWMを初期化する関数
-    // pwm_set_chan_level()はPWMのデューティサイクルを設定する関数
-    pwm_config config = pwm_get_default_config();
-    pwm_init(slice_num, &config, true);
-    pwm_set_chan_level(slice_num, PWM_CHAN_A, BUZZER_OFF); // 最初は音を鳴らさない
-
-    // タイマーの設定
+    // tone_init()はブザーのピンをPWMに設定し、最初は音を鳴らさない状態にする関数
+    // 以降はtone_start_note()/tone_stop()で鳴らしたり止めたりする (値が変わったときだけPWMのレジスタを書き換える)
+    // 平均律の音の分周比と周期は、いまのシステムクロックからtone_init()が表にしておく
+    // このブザーはHIGHのままだと鳴らないので、止めているあいだは出力をHIGHに保つ (idle_high = true)
+    tone_init(&buzzer, BUZZER_PIN, true);
+
+#ifdef BUTTON_EDGE_DEBOUNCE
+    // ボタンの最初のエッジの割り込みで、すぐに押された (離された) と確定する
+    // その後BUTTON_LOCKOUT_USの間はハードウェアアラームが鳴るまでそのピンの割り込みを止めて、チャタリングを読み飛ばす
+    debounce_start_edge(&buttons, BUTTON_LOCKOUT_US);
+#else
+    // タイマーの設定 (TIMER_INTERVAL_MSごとにボタンを読む)
     struct repeating_timer timer; // タイマー構造体を宣言
     // 繰り返しタイマーを設定する関数
     // - 第1引数: 繰り返し間隔 (マイクロ秒)。負の値は、最初の実行も遅延させる
     // - 第2引数: コールバック関数 (タイマー割り込み時に実行される関数)
-    // - 第3引数: コールバック関数に渡すユーザーデータ (ここではNULL)
+    // - 第3引数: コールバック関数に渡すユーザーデータ (ここではボタンのチャタリング除去の状態)
     // - 第4引数: 設定するタイマー構造体へのポインタ
-    add_repeating_timer_ms(TIMER_INTERVAL_MS, timer_callback, NULL, &timer);
-
-    Current_BUTTON_State = 0;   // 現在のボタンの状態を初期化
-    Prev_BUTTON_State = 0;  // 前回のボタンの状態を初期化
+    add_repeating_timer_ms(TIMER_INTERVAL_MS, debounce_timer_callback, &buttons, &timer);
+#endif
 
     // メインループ
+    // 押しているあいだはSENSOR_INTERVAL_MSごとに照度センサを読み直し、離しているあいだはボタンが押されるまで眠る
     while (true)
     {
-        if (button_pressed)
+        if (debounce_is_down(&buttons, BUTTON_PIN))
         {
-            float duty = Save_duty(); // AD値を読み取り、デューティ比を取得
-            play_note_a(slice_num,duty);
+            uint16_t duty = Save_duty(); // AD値を読み取り、デューティ比 (0〜TONE_VOLUME_MAX) を取得
+            tone_start_note(&buzzer, TONE_NOTE_A3, duty); // 音量 (デューティ比) が変わったときだけPWMを書き換える
+            best_effort_wfe_or_timeout(make_timeout_time_ms(SENSOR_INTERVAL_MS)); // 次に読むまで眠る (離されたらすぐ起きる)
         }
         else
         {
-            pwm_set_chan_level(slice_num, PWM_CHAN_A, BUZZER_OFF); // ブザーをOFF
+            tone_stop(&buzzer); // ブザーをOFF
+            __wfe();            // ボタンの状態が変わる (__sev()が出る) まで眠る
         }
     }
     return 0;
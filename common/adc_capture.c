@@ -0,0 +1,196 @@
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "adc_capture.h"
+
+/* 定義 (マクロ) */
+#define ADC_CAPTURE_CYCLES_MIN 96 // 1 回の変換にかかる ADC のクロック数 (これより速くは変換できない)
+#define ADC_CAPTURE_GPIO_BASE 26  // ADC0 のピン (ADC n は GPIO 26 + n。ADC4 は温度センサ)
+#define ADC_CAPTURE_TEMP_INPUT 4  // 温度センサの入力番号
+
+/* グローバル変数 */
+static adc_capture_t *active_capture; // DMA 割り込みで処理する状態 (ADC は 1 つなので、同時に 1 つだけ)
+
+// 埋まったブロック block を入力ごとに足し込み、たまったら値を公開する関数 (DMA 割り込みから呼ぶ)
+static void adc_capture_process(adc_capture_t *capture, const uint16_t *block)
+{
+    uint32_t sums[ADC_CAPTURE_INPUT_MAX] = {0};
+    uint count = capture->input_count;
+    adc_capture_stream_t *stream = capture->stream;
+    uint16_t *out = stream != NULL ? &stream->samples[stream->produced & 1][stream->fill] : NULL;
+    for (uint i = 0; i < ADC_CAPTURE_BLOCK_SAMPLES; i++)
+    {
+        for (uint k = 0; k < count; k++)
+        {
+            if (out != NULL && capture->order[k] == stream->input)
+            {
+                *out++ = *block;
+            }
+            sums[k] += *block++; // ラウンドロビンなので、サンプルは order の順に並んでいる
+        }
+    }
+    if (stream != NULL && (stream->fill += ADC_CAPTURE_BLOCK_SAMPLES) == ADC_CAPTURE_STREAM_SAMPLES)
+    {
+        stream->fill = 0;
+        stream->produced++; // 次はもう片方のブロックを埋める
+        __sev();            // 待っているアプリケーションを起こす
+    }
+
+    for (uint k = 0; k < count; k++)
+    {
+        adc_capture_input_t *input = &capture->inputs[capture->order[k]];
+        input->sum += sums[k];
+        if (++input->blocks < (1u << input->decimate_shift))
+        {
+            continue;
+        }
+
+        // 2^(BLOCK_SHIFT + decimate_shift) サンプルの平均を、12 ビットから 16 ビットの目盛りに直す
+        uint32_t value = input->sum >> (ADC_CAPTURE_BLOCK_SHIFT + input->decimate_shift - 4);
+        input->sum = 0;
+        input->blocks = 0;
+        if (!input->primed)
+        {
+            input->filtered = value << 8; // 最初の値からならし始める
+            input->primed = true;
+        }
+        else
+        {
+            input->filtered += ((int32_t)(value << 8) - (int32_t)input->filtered) >> input->smooth_shift;
+        }
+        input->value = MIN(input->filtered >> 8, ADC_CAPTURE_FULL_SCALE);
+    }
+    capture->block_count++;
+}
+
+// DMA の割り込みハンドラ。埋まったブロックの DMA チャネルの書き込み先を戻して (次の番に備える)、ブロックを処理する
+static void adc_capture_dma_irq(void)
+{
+    adc_capture_t *capture = active_capture;
+    for (int b = 0; b < 2; b++)
+    {
+        int channel = capture->dma_channel[b];
+        if (!dma_channel_get_irq1_status(channel))
+        {
+            continue;
+        }
+        dma_channel_acknowledge_irq1(channel);
+        dma_channel_set_write_addr(channel, capture->buffer[b], false); // もう片方のチャネルが書いているあいだに戻しておく
+        adc_capture_process(capture, capture->buffer[b]);
+    }
+}
+
+// ADC の入力 input_mask (ビット n が ADC n) を、入力 1 つあたり sample_rate_hz でラウンドロビンに変換する準備をする関数
+// 入力のピンを ADC 用にし、DMA チャネルを 2 つ確保する。adc_capture_start() を呼ぶまでは変換しない
+void adc_capture_init(adc_capture_t *capture, uint input_mask, uint32_t sample_rate_hz)
+{
+    *capture = (adc_capture_t){0};
+    capture->input_mask = input_mask;
+    capture->sample_rate_hz = sample_rate_hz;
+    for (uint input = 0; input < ADC_CAPTURE_INPUT_MAX; input++)
+    {
+        if (input_mask & (1u << input))
+        {
+            capture->order[capture->input_count++] = input; // ラウンドロビンは番号の小さい順に回る
+        }
+    }
+
+    adc_init();
+    for (uint k = 0; k < capture->input_count; k++)
+    {
+        if (capture->order[k] == ADC_CAPTURE_TEMP_INPUT)
+        {
+            adc_set_temp_sensor_enabled(true);
+        }
+        else
+        {
+            adc_gpio_init(ADC_CAPTURE_GPIO_BASE + capture->order[k]); // デジタル入力を切り、プルアップ・プルダウンも外す
+        }
+    }
+
+    // 変換の間隔 = ADC のクロック / (サンプリング周波数 × 入力の数)。ADC は (1 + div) クロックごとに変換を始める
+    uint32_t cycles = clock_get_hz(clk_adc) / (sample_rate_hz * capture->input_count);
+    adc_set_clkdiv(MAX(cycles, ADC_CAPTURE_CYCLES_MIN) - 1);
+    adc_set_round_robin(input_mask);
+    adc_fifo_setup(true, true, 1, false, false); // FIFO を使い、1 サンプルごとに DMA を呼ぶ (エラービットとバイトへの切り詰めはしない)
+
+    // 2 つの DMA チャネルを互いに連鎖させ、片方が終わるともう片方がすぐ続きを書き込む
+    capture->dma_channel[0] = dma_claim_unused_channel(true);
+    capture->dma_channel[1] = dma_claim_unused_channel(true);
+    for (int b = 0; b < 2; b++)
+    {
+        dma_channel_config config = dma_channel_get_default_config(capture->dma_channel[b]);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+        channel_config_set_read_increment(&config, false);  // ADC の FIFO から読み続ける
+        channel_config_set_write_increment(&config, true);  // ブロックに順に書き込む
+        channel_config_set_dreq(&config, DREQ_ADC);         // ADC の変換が終わるたびに 1 つ転送する
+        channel_config_set_chain_to(&config, capture->dma_channel[b ^ 1]);
+        dma_channel_configure(capture->dma_channel[b], &config, capture->buffer[b], &adc_hw->fifo,
+                              capture->input_count * ADC_CAPTURE_BLOCK_SAMPLES, false);
+        dma_channel_set_irq1_enabled(capture->dma_channel[b], true);
+    }
+}
+
+// 入力 input のフィルタを設定する関数 (adc_capture_start() の前に呼ぶ)
+// 2^decimate_shift ブロックごとに値を更新し、新しい値を 1/2^smooth_shift だけ混ぜてならす
+void adc_capture_set_filter(adc_capture_t *capture, uint input, uint decimate_shift, uint smooth_shift)
+{
+    adc_capture_input_t *filter = &capture->inputs[input];
+    filter->decimate_shift = MIN(decimate_shift, ADC_CAPTURE_DECIMATE_MAX);
+    filter->smooth_shift = MIN(smooth_shift, 15u);
+}
+
+// ラウンドロビンの変換と DMA を動かし始める関数 (以降は CPU を使わずに変換が続き、ブロックごとに割り込みが来る)
+void adc_capture_start(adc_capture_t *capture)
+{
+    active_capture = capture;
+    irq_set_exclusive_handler(DMA_IRQ_1, adc_capture_dma_irq);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    adc_run(false);
+    adc_fifo_drain();
+    adc_select_input(capture->order[0]); // 最初の入力から回し始める (ブロックの先頭が order[0] になる)
+    dma_channel_start(capture->dma_channel[0]);
+    adc_run(true);
+}
+
+// 入力 input (adc_capture_init() で指定した入力のどれか) のサンプルを stream に集め始める関数 (adc_capture_start() の前に呼ぶ)
+void adc_capture_set_stream(adc_capture_t *capture, uint input, adc_capture_stream_t *stream)
+{
+    *stream = (adc_capture_stream_t){0};
+    stream->input = input;
+    capture->stream = stream;
+}
+
+// 埋まったブロックがあれば、その先頭を返す関数 (なければ NULL)。処理が終わったら adc_capture_stream_release() を呼ぶ
+// 処理が遅れて 2 つ以上たまっていたら、上書きされたブロックは捨てて最新のブロックを返す
+const uint16_t *adc_capture_stream_take(adc_capture_stream_t *stream)
+{
+    uint32_t produced = stream->produced;
+    if (produced == stream->consumed)
+    {
+        return NULL;
+    }
+    if (produced - stream->consumed > 1)
+    {
+        stream->dropped += produced - 1 - stream->consumed;
+        stream->consumed = produced - 1;
+    }
+    return stream->samples[stream->consumed & 1];
+}
+
+// adc_capture_stream_take() で受け取ったブロックの処理が終わったことを知らせる関数
+// 処理しているあいだに割り込みがそのブロックを上書きし始めていたら (処理が 1 ブロックの時間に間に合わなかったら) false を返す
+bool adc_capture_stream_release(adc_capture_stream_t *stream)
+{
+    bool intact = stream->produced - stream->consumed < 2;
+    if (!intact)
+    {
+        stream->dropped++;
+    }
+    stream->consumed++;
+    return intact;
+}
@@ -0,0 +1,79 @@
+// ADC の複数の入力を止めずに読み続けるサービス (ブザーのプログラムで共通に使う)
+// ADC をラウンドロビン (入力を順番に切り替えながら連続で変換する) で走らせ、FIFO から 2 本の DMA チャネルで
+// 2 つのブロックに交互に書き込む (片方が埋まると、もう片方に切り替わるので取りこぼしがない)。
+// ブロックが埋まるたびに DMA 割り込みで入力ごとに足し合わせ (オーバーサンプリング)、
+// 2^decimate_shift ブロック分たまったら平均して、さらに入力ごとの IIR フィルタでならした値を公開する。
+// アプリケーションは adc_capture_read() でいつでも最新の値を読める (メモリを 1 回読むだけで、ADC を待たない)
+// 音のように波形そのものが要る入力は adc_capture_set_stream() でストリームにつなぐと、その入力のサンプルだけを
+// 2 つのブロックに交互に集める (ピンポンバッファ)。埋まったブロックは割り込みの外で adc_capture_stream_take() で受け取る
+#ifndef ADC_CAPTURE_H
+#define ADC_CAPTURE_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+#define ADC_CAPTURE_INPUT_MAX 5           // ADC の入力の数 (ADC0〜ADC3 と温度センサ)
+#define ADC_CAPTURE_BLOCK_SAMPLES 64      // 1 ブロックに入る入力 1 つあたりのサンプル数
+#define ADC_CAPTURE_BLOCK_SHIFT 6         // log2(ADC_CAPTURE_BLOCK_SAMPLES)
+#define ADC_CAPTURE_DECIMATE_MAX 8        // decimate_shift の最大 (2^8 ブロック = 16384 サンプルまで平均できる)
+#define ADC_CAPTURE_FULL_SCALE 0xffff     // adc_capture_read() の値の最大 (12 ビットの変換結果を 16 ビットに左詰めした目盛り)
+#define ADC_CAPTURE_STREAM_SAMPLES 512    // ストリームの 1 ブロックのサンプル数 (ADC_CAPTURE_BLOCK_SAMPLES の倍数)
+
+// 入力 1 つ分のフィルタの設定と状態
+typedef struct
+{
+    uint8_t decimate_shift; // 2^decimate_shift ブロックの和を平均して 1 つの値にする (0〜ADC_CAPTURE_DECIMATE_MAX)
+    uint8_t smooth_shift;   // IIR フィルタの強さ (新しい値を 1/2^smooth_shift だけ混ぜる。0 ならならさない)
+    uint16_t blocks;        // sum に足し込んだブロックの数
+    uint32_t sum;           // 足し込んでいるサンプルの和
+    uint32_t filtered;      // IIR フィルタの状態 (16 ビットの目盛りに、さらに 8 ビットの小数部を付けた値)
+    bool primed;            // 最初の値でフィルタを初期化したか
+    volatile uint16_t value; // 公開している最新の値 (0〜ADC_CAPTURE_FULL_SCALE)
+} adc_capture_input_t;
+
+// 入力 1 つ分のサンプルをそのまま集めるストリーム (ピンポンバッファ)
+// 割り込みが samples[produced & 1] を埋めているあいだに、アプリケーションはもう片方のブロックを処理する
+typedef struct
+{
+    uint8_t input;             // 集める入力
+    uint16_t fill;             // 埋めているブロックに入れたサンプル数
+    volatile uint32_t produced; // 埋まったブロックの数
+    uint32_t consumed;         // 受け取ったブロックの数
+    uint32_t dropped;          // 処理が間に合わず、受け取る前 (処理している最中) に上書きされたブロックの数
+    uint16_t samples[2][ADC_CAPTURE_STREAM_SAMPLES];
+} adc_capture_stream_t;
+
+// ADC のラウンドロビンの変換と、その DMA の状態
+typedef struct
+{
+    uint8_t input_mask;     // 変換する入力 (ビット n が ADC n)
+    uint8_t input_count;    // 変換する入力の数 (1 ブロックの 1 巡あたりのサンプル数)
+    uint8_t order[ADC_CAPTURE_INPUT_MAX]; // ラウンドロビンで変換する順の入力番号
+    int dma_channel[2];     // ブロック 0 / 1 に書き込む DMA チャネル番号
+    uint32_t sample_rate_hz; // 入力 1 つあたりのサンプリング周波数
+    volatile uint32_t block_count; // 埋まったブロックの数
+    adc_capture_input_t inputs[ADC_CAPTURE_INPUT_MAX];
+    adc_capture_stream_t *stream; // サンプルを集めるストリーム (なければ NULL)
+    uint16_t buffer[2][ADC_CAPTURE_INPUT_MAX * ADC_CAPTURE_BLOCK_SAMPLES]; // DMA が書き込むブロック
+} adc_capture_t;
+
+void adc_capture_init(adc_capture_t *capture, uint input_mask, uint32_t sample_rate_hz);
+void adc_capture_set_filter(adc_capture_t *capture, uint input, uint decimate_shift, uint smooth_shift);
+void adc_capture_start(adc_capture_t *capture);
+void adc_capture_set_stream(adc_capture_t *capture, uint input, adc_capture_stream_t *stream);
+const uint16_t *adc_capture_stream_take(adc_capture_stream_t *stream);
+bool adc_capture_stream_release(adc_capture_stream_t *stream);
+
+// 入力 input の最新のフィルタ済みの値 (0〜ADC_CAPTURE_FULL_SCALE) を返す関数 (ADC を待たずに、メモリを読むだけ)
+static inline uint16_t adc_capture_read(const adc_capture_t *capture, uint input)
+{
+    return capture->inputs[input].value;
+}
+
+// 入力 input の最新の値を、adc_read() と同じ 12 ビット (0〜4095) の目盛りで返す関数
+static inline uint16_t adc_capture_read12(const adc_capture_t *capture, uint input)
+{
+    return capture->inputs[input].value >> 4;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#include "pico/stdlib.h"
+#include "curve.h"
+
+// 折れ点の表 points (x の小さい順に count 個) で、入力 x の出力を求める関数 (節点の表を作るときだけ使う)
+// 最初の折れ点より左は最初の y、最後の折れ点より右は最後の y のまま
+static int32_t curve_interpolate(const curve_point_t *points, uint count, uint x)
+{
+    if (x <= points[0].x)
+    {
+        return points[0].y;
+    }
+    for (uint i = 1; i < count; i++)
+    {
+        if (x <= points[i].x)
+        {
+            const curve_point_t *a = &points[i - 1], *b = &points[i];
+            int64_t dy = (int64_t)(b->y - a->y) * (int32_t)(x - a->x);
+            int32_t dx = b->x - a->x;
+            return a->y + (int32_t)((dy + (dy < 0 ? -dx / 2 : dx / 2)) / dx); // 四捨五入
+        }
+    }
+    return points[count - 1].y;
+}
+
+// 折れ点の表 points (x の小さい順に count 個。1 個以上) から校正曲線 curve を作る関数
+// hysteresis は curve_follow で無視する入力の変化の幅 (0 ならヒステリシスなし)
+void curve_init(curve_t *curve, const curve_point_t *points, uint count, uint hysteresis)
+{
+    for (uint i = 0; i < CURVE_KNOTS; i++)
+    {
+        curve->knots[i] = curve_interpolate(points, count, i << CURVE_INDEX_SHIFT); // 最後の節点 (4096) は 4080〜4095 の補間にだけ使う
+    }
+    curve->hysteresis = hysteresis;
+}
+
+// 入力 x の出力を、ヒステリシス付きで返す関数
+// 最後に出力を変えたときの入力から hysteresis 以内の変化なら前の出力を返すので、ノイズで出力がふらつかない
+int32_t curve_follow(const curve_t *curve, curve_follower_t *follower, uint x)
+{
+    uint distance = x > follower->x ? x - follower->x : follower->x - x;
+    if (follower->primed && distance <= curve->hysteresis)
+    {
+        return follower->y;
+    }
+    follower->primed = true;
+    follower->x = x;
+    follower->y = curve_lookup(curve, x);
+    return follower->y;
+}
@@ -0,0 +1,53 @@
+// 折れ線の校正曲線 (ブザーのプログラムで共通に使う)
+// センサの 12 ビットの値 (0〜4095) から出力 (音量、周波数など) への変換を、折れ点の表で決める。
+// curve_init で折れ点の表を 16 刻み (2^CURVE_INDEX_SHIFT) の節点の表に直しておき、curve_lookup は
+// 上位ビットで節点を引いて下位ビットで直線補間する (折れ点がいくつあっても、引く手間は同じ)。
+// 折れ点の x を 16 の倍数にしておけば、節点の表は折れ線をそのまま表す
+// curve_follow はヒステリシス付きで引く (入力が前に引いた値から hysteresis を超えて動くまで、出力を変えない)
+#ifndef CURVE_H
+#define CURVE_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+#define CURVE_INPUT_BITS 12                                                   // 入力のビット数 (ADC の変換結果)
+#define CURVE_INPUT_MAX ((1u << CURVE_INPUT_BITS) - 1)                        // 入力の最大
+#define CURVE_INDEX_SHIFT 4                                                   // 節点の間隔 (2^CURVE_INDEX_SHIFT)
+#define CURVE_KNOTS ((1u << (CURVE_INPUT_BITS - CURVE_INDEX_SHIFT)) + 1)      // 節点の数 (両端を含む)
+
+// 折れ点 (入力 x のときに出力 y)
+typedef struct
+{
+    uint16_t x;
+    int32_t y;
+} curve_point_t;
+
+// 校正曲線 (節点の表)
+typedef struct
+{
+    int32_t knots[CURVE_KNOTS]; // 入力 i << CURVE_INDEX_SHIFT のときの出力
+    uint16_t hysteresis;        // curve_follow で無視する入力の変化 (この幅までは出力を変えない)
+} curve_t;
+
+// curve_follow の状態 (入力 1 つごとに持つ)
+typedef struct
+{
+    bool primed;   // 最初の値を引いたか
+    uint16_t x;    // 最後に出力を変えたときの入力
+    int32_t y;     // そのときの出力
+} curve_follower_t;
+
+void curve_init(curve_t *curve, const curve_point_t *points, uint count, uint hysteresis);
+int32_t curve_follow(const curve_t *curve, curve_follower_t *follower, uint x);
+
+// 入力 x (0〜CURVE_INPUT_MAX) の出力を、節点のあいだを直線補間して返す関数 (折れ点の数によらず同じ手間)
+static inline int32_t curve_lookup(const curve_t *curve, uint x)
+{
+    x = MIN(x, CURVE_INPUT_MAX);
+    uint i = x >> CURVE_INDEX_SHIFT;
+    int32_t frac = x & ((1u << CURVE_INDEX_SHIFT) - 1);
+    int32_t y0 = curve->knots[i];
+    return y0 + (((curve->knots[i + 1] - y0) * frac) >> CURVE_INDEX_SHIFT);
+}
+
+#endif
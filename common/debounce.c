@@ -0,0 +1,203 @@
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "debounce.h"
+
+static debounce_t *edge_debounce; // エッジ割り込みのモードで動いている入力 (GPIO 割り込みのコールバックはコアに 1 つなので、同時に 1 つだけ)
+
+// mask のピンのチャタリング除去を初期化する関数 (active_low のピンは Low で押されたとみなす)
+// window は確定までに続けて同じ値が必要なサンプル数。最初はすべて離されている状態から始める
+void debounce_init(debounce_t *debounce, uint32_t mask, uint32_t active_low, uint window)
+{
+    *debounce = (debounce_t){0};
+    debounce->alarm = -1;
+    debounce->mask = mask;
+    debounce->active_low = active_low & mask;
+    debounce->window = window < 1 ? 1 : window > DEBOUNCE_WINDOW_MAX ? DEBOUNCE_WINDOW_MAX : window;
+}
+
+// mask のピンをプルアップ付きの入力にして、押すと Low になるボタンとして初期化する関数
+void debounce_init_buttons(debounce_t *debounce, uint32_t mask, uint window)
+{
+    gpio_init_mask(mask);
+    gpio_set_dir_in_masked(mask);
+    for (uint pin = 0; pin < 32; pin++)
+    {
+        if (mask & (1u << pin))
+        {
+            gpio_pull_up(pin);
+        }
+    }
+    debounce_init(debounce, mask, mask, window);
+}
+
+// GPIO の値 raw (gpio_get_all() の値) を 1 サンプル処理して、状態が変わったピンのマスクを返す関数
+// 確定した状態と違う値が window 回続いたピンだけを反転させる。同じ値に戻ったピンはカウンタを 0 に戻す
+uint32_t debounce_update(debounce_t *debounce, uint32_t raw)
+{
+    uint32_t input = (raw ^ debounce->active_low) & debounce->mask; // 1 を押されている、にそろえる
+    uint32_t differ = input ^ debounce->state;                      // 確定した状態と違うピン
+
+    // differ のピンのカウンタを 1 増やし、それ以外は 0 に戻す (ビット平面ごとに半加算器で桁上げを伝える)
+    uint32_t carry = differ;
+    uint32_t reached = differ; // カウンタが window に達したピン
+    for (int bit = 0; bit < DEBOUNCE_COUNTER_BITS; bit++)
+    {
+        uint32_t plane = debounce->counter[bit];
+        uint32_t next = (plane ^ carry) & differ;
+        carry &= plane;
+        debounce->counter[bit] = next;
+        reached &= (debounce->window >> bit) & 1u ? next : ~next;
+    }
+
+    if (reached != 0)
+    {
+        for (int bit = 0; bit < DEBOUNCE_COUNTER_BITS; bit++)
+        {
+            debounce->counter[bit] &= ~reached; // 反転させたピンのカウンタは 0 から数え直す
+        }
+        uint32_t state = debounce->state ^ reached;
+        debounce->state = state;
+        debounce->pressed |= reached & state;
+        debounce->released |= reached & ~state;
+        debounce->event_us = time_us_32();
+        __sev(); // __wfe() で待っているメインループを起こす
+    }
+    return reached;
+}
+
+// add_repeating_timer_ms に渡すタイマー割り込み関数 (user_data に debounce_t を渡す)
+bool debounce_timer_callback(struct repeating_timer *rt)
+{
+    debounce_sample((debounce_t *)rt->user_data);
+    return true; // 継続してタイマーを動作させる
+}
+
+// 前に読んでから押されたピンのマスクを返し、クリアする関数
+uint32_t debounce_take_pressed(debounce_t *debounce)
+{
+    uint32_t interrupts = save_and_disable_interrupts(); // タイマー割り込みで増えた分を取りこぼさないようにする
+    uint32_t pressed = debounce->pressed;
+    debounce->pressed = 0;
+    restore_interrupts(interrupts);
+    return pressed;
+}
+
+// 前に読んでから離されたピンのマスクを返し、クリアする関数
+uint32_t debounce_take_released(debounce_t *debounce)
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    uint32_t released = debounce->released;
+    debounce->released = 0;
+    restore_interrupts(interrupts);
+    return released;
+}
+
+/* エッジ割り込みのモード */
+
+// ピン pin が確定した状態から離れる向きのエッジ (押されていなければ押す向き) を返す関数
+static uint32_t debounce_edge_events(const debounce_t *debounce, uint pin)
+{
+    bool high = ((debounce->state ^ debounce->active_low) >> pin) & 1u; // 確定した状態のときのピンの電圧
+    return high ? GPIO_IRQ_EDGE_FALL : GPIO_IRQ_EDGE_RISE;
+}
+
+// ピン pin の状態を反転させて確定し、lockout_us の間その割り込みを止める関数 (割り込みの中から呼ぶ)
+// ロックアウトの長さはどのピンも同じなので、後から止めたピンが先に終わることはない。最初に止めたピンでアラームを合わせる
+static void debounce_edge_toggle(debounce_t *debounce, uint pin, uint64_t now)
+{
+    uint32_t bit = 1u << pin;
+    uint32_t state = debounce->state ^ bit;
+    debounce->state = state;
+    debounce->pressed |= bit & state;
+    debounce->released |= bit & ~state;
+    debounce->event_us = (uint32_t)now;
+    __sev();
+
+    debounce->unlock_us[pin] = now + debounce->lockout_us;
+    if (debounce->locked == 0)
+    {
+        hardware_alarm_set_target(debounce->alarm, from_us_since_boot(debounce->unlock_us[pin]));
+    }
+    debounce->locked |= bit;
+}
+
+// GPIO 割り込みのコールバック：最初のエッジで状態を確定させ、ロックアウトに入る
+static void debounce_gpio_irq(uint gpio, uint32_t events)
+{
+    (void)events; // 立ち上がりでも立ち下がりでも、エッジが来たら状態を反転させる
+    debounce_t *debounce = edge_debounce;
+    if (debounce == NULL || !(debounce->mask & (1u << gpio)))
+    {
+        return;
+    }
+    gpio_set_irq_enabled(gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, false); // ロックアウトが終わるまで、チャタリングのエッジは受け付けない
+    debounce_edge_toggle(debounce, gpio, time_us_64());
+}
+
+// ロックアウトの終わりに鳴るアラームのコールバック：ロックアウトが終わったピンの割り込みを戻す
+// ロックアウト中に離された (押された) ままならそのエッジを取りこぼしているので、ここで確定させて、もう一度ロックアウトに入る
+static void debounce_alarm_irq(uint alarm)
+{
+    debounce_t *debounce = edge_debounce;
+    uint64_t now = time_us_64();
+    uint32_t expired = 0;
+    for (uint32_t pending = debounce->locked; pending != 0; pending &= pending - 1)
+    {
+        uint pin = __builtin_ctz(pending);
+        if (now >= debounce->unlock_us[pin])
+        {
+            expired |= 1u << pin;
+        }
+    }
+    debounce->locked &= ~expired;
+
+    for (; expired != 0; expired &= expired - 1)
+    {
+        uint pin = __builtin_ctz(expired);
+        gpio_acknowledge_irq(pin, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE); // ロックアウト中に溜まったエッジを捨ててから読む
+        bool down = (gpio_get(pin) ^ ((debounce->active_low >> pin) & 1u)) != 0;
+        if (down != (((debounce->state >> pin) & 1u) != 0))
+        {
+            debounce_edge_toggle(debounce, pin, now);
+        }
+        else
+        {
+            gpio_set_irq_enabled(pin, debounce_edge_events(debounce, pin), true);
+        }
+    }
+
+    // まだロックアウト中のピンがあれば、最も早く終わる時刻にアラームを鳴らし直す
+    if (debounce->locked != 0)
+    {
+        uint64_t next = UINT64_MAX;
+        for (uint32_t pending = debounce->locked; pending != 0; pending &= pending - 1)
+        {
+            next = MIN(next, debounce->unlock_us[__builtin_ctz(pending)]);
+        }
+        if (hardware_alarm_set_target(alarm, from_us_since_boot(next)))
+        {
+            debounce_alarm_irq(alarm); // もう過ぎていた
+        }
+    }
+}
+
+// debounce をエッジ割り込みのモードで動かし始める関数 (debounce_init_buttons の後に、ポーリングのタイマーの代わりに呼ぶ)
+// 押されたエッジ (離されたエッジ) が来た時点で確定させ、その後 lockout_us の間はそのピンの変化を無視する
+void debounce_start_edge(debounce_t *debounce, uint32_t lockout_us)
+{
+    debounce->lockout_us = lockout_us;
+    debounce->alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(debounce->alarm, debounce_alarm_irq);
+    edge_debounce = debounce;
+
+    uint32_t raw = gpio_get_all();
+    debounce->state = (raw ^ debounce->active_low) & debounce->mask; // いまの状態から始める (変化はエッジで受け取る)
+    for (uint32_t pins = debounce->mask; pins != 0; pins &= pins - 1)
+    {
+        uint pin = __builtin_ctz(pins);
+        gpio_acknowledge_irq(pin, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE);
+        gpio_set_irq_enabled_with_callback(pin, debounce_edge_events(debounce, pin), true, debounce_gpio_irq);
+    }
+}
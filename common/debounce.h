@@ -0,0 +1,55 @@
+// 複数のボタンのチャタリング除去 (ブザーのプログラムで共通に使う)
+// GPIO の全ピンを gpio_get_all() で 1 回に読み、最大 32 本の入力を縦型カウンタ (ビットごとのカウンタを
+// ビット平面に分けて持ち、ビット演算でまとめて数える) で並列に処理する。1 本でも 32 本でも処理の手間は同じ
+// エッジ割り込みのモード (debounce_start_edge) では、最初のエッジですぐに確定させ、その後の lockout_us の間は
+// ハードウェアアラームが鳴るまでそのピンの割り込みを止めて、チャタリングを読み飛ばす (定期的なサンプリングは不要)
+// どちらのモードでも状態が変わると __sev() を出すので、メインループは __wfe() で次の変化まで眠れる
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+#define DEBOUNCE_COUNTER_BITS 4                                 // 縦型カウンタのビット数 (ビット平面の数)
+#define DEBOUNCE_WINDOW_MAX ((1u << DEBOUNCE_COUNTER_BITS) - 1) // 設定できる安定期間の最大 (サンプル数)
+
+// 入力のまとまり (ピンのビットマスクで指定) のチャタリング除去の状態
+typedef struct
+{
+    uint32_t mask;                            // 処理するピン (ビット n が GPIO n)
+    uint32_t active_low;                      // Low で押されたとみなすピン (プルアップのボタン)
+    uint8_t window;                           // 確定までに続けて同じ値が必要なサンプル数 (1〜DEBOUNCE_WINDOW_MAX)
+    uint32_t counter[DEBOUNCE_COUNTER_BITS];  // 確定した状態と違う値が続いたサンプル数 (ビット平面ごと。counter[0] が最下位ビット)
+    volatile uint32_t state;                  // 確定した状態 (1 なら押されている)
+    volatile uint32_t pressed;                // 押されたエッジ (debounce_take_pressed で読むまで溜める)
+    volatile uint32_t released;               // 離されたエッジ
+
+    // エッジ割り込みのモードで使う
+    uint32_t lockout_us;                      // 確定してから次の変化を受け付けるまでの時間
+    int alarm;                                // ロックアウトの終わりに鳴らすハードウェアアラームの番号 (-1 ならポーリングのモード)
+    volatile uint32_t locked;                 // ロックアウト中のピン
+    uint64_t unlock_us[32];                   // 各ピンのロックアウトが終わる時刻
+    volatile uint32_t event_us;               // 最後に状態を確定させた時刻 (反応の遅れを測るため)
+} debounce_t;
+
+void debounce_init(debounce_t *debounce, uint32_t mask, uint32_t active_low, uint window);
+void debounce_init_buttons(debounce_t *debounce, uint32_t mask, uint window);
+uint32_t debounce_update(debounce_t *debounce, uint32_t raw);
+bool debounce_timer_callback(struct repeating_timer *rt);
+uint32_t debounce_take_pressed(debounce_t *debounce);
+uint32_t debounce_take_released(debounce_t *debounce);
+void debounce_start_edge(debounce_t *debounce, uint32_t lockout_us);
+
+// GPIO をまとめて読み、1 サンプル分処理する関数 (状態が変わったピンのマスクを返す)
+static inline uint32_t debounce_sample(debounce_t *debounce)
+{
+    return debounce_update(debounce, gpio_get_all());
+}
+
+// ピン pin が押されていると確定しているかを返す関数
+static inline bool debounce_is_down(const debounce_t *debounce, uint pin)
+{
+    return (debounce->state >> pin) & 1u;
+}
+
+#endif
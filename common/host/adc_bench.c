@@ -0,0 +1,123 @@
+// ADC のサービス (adc_capture.c) のホスト (Linux) 上のベンチマーク
+// ノイズのある照度センサとボリュームを、元のプログラムのように 10ms ごとに adc_select_input() と adc_read() で読んだときと、
+// ラウンドロビンと DMA で読み続けてフィルタした値を adc_capture_read() で読んだときで、ばらつき (標準偏差)、
+// 読むのにかかる時間、値が変わってから追いつくまでの時間、割り込みの回数を比べる
+#include <stdio.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "adc_capture.h"
+#include "pico_sim.h"
+
+/* 定義 (マクロ) */
+#define BENCH_LIGHT_INPUT 0        // 照度センサ (ADC0)
+#define BENCH_POT_INPUT 1          // ボリューム (ADC1)
+#define BENCH_MIC_INPUT 2          // マイク (ADC2)
+#define BENCH_READ_INTERVAL_US 10000 // アプリケーションが値を読む周期 (ブザーのプログラムと同じ 10ms)
+#define BENCH_READS 2000           // 読む回数
+#define BENCH_RATE_HZ 8000         // 入力 1 つあたりのサンプリング周波数
+#define BENCH_LIGHT_MEAN 1500.0    // 照度センサの電圧の平均 (LSB)
+#define BENCH_LIGHT_NOISE 12.0     // 照度センサのノイズの標準偏差 (LSB)
+#define BENCH_POT_MEAN 2000.5      // ボリュームの電圧の平均 (LSB)
+#define BENCH_POT_NOISE 6.0        // ボリュームのノイズの標準偏差 (LSB)
+#define BENCH_STEP_FROM 1000.0     // 追いつくまでの時間を測るときの、ボリュームを回す前の値 (LSB)
+#define BENCH_STEP_TO 3000.0       // 回した後の値 (LSB)
+
+// ばらつきの統計
+typedef struct
+{
+    double sum, sum_sq;
+    uint32_t count;
+} spread_t;
+
+static void spread_add(spread_t *spread, double value)
+{
+    spread->sum += value;
+    spread->sum_sq += value * value;
+    spread->count++;
+}
+
+static double spread_stddev(const spread_t *spread)
+{
+    double mean = spread->sum / spread->count;
+    return sqrt(MAX(spread->sum_sq / spread->count - mean * mean, 0.0));
+}
+
+static void bench_inputs(void)
+{
+    sim_reset();
+    sim_adc_set(BENCH_LIGHT_INPUT, BENCH_LIGHT_MEAN, BENCH_LIGHT_NOISE);
+    sim_adc_set(BENCH_POT_INPUT, BENCH_POT_MEAN, BENCH_POT_NOISE);
+    sim_adc_set(BENCH_MIC_INPUT, 2048.0, 200.0);
+}
+
+// 元のプログラムと同じく、読むたびに入力を選んで 1 回変換する
+static void bench_blocking(void)
+{
+    spread_t light = {0}, pot = {0};
+    bench_inputs();
+    adc_init();
+    uint64_t busy_us = 0;
+    for (int i = 0; i < BENCH_READS; i++)
+    {
+        uint64_t start = time_us_64();
+        adc_select_input(BENCH_LIGHT_INPUT);
+        spread_add(&light, adc_read());
+        adc_select_input(BENCH_POT_INPUT);
+        spread_add(&pot, adc_read());
+        busy_us += time_us_64() - start;
+        sim_run_until(start + BENCH_READ_INTERVAL_US);
+    }
+    printf("%-22s  %8.2f  %8.2f  %9.2f  %8s  %8s  %8lu\n", "adc_read (blocking)", spread_stddev(&light),
+           spread_stddev(&pot), (double)busy_us / BENCH_READS, "-", "0", 0ul);
+}
+
+// ラウンドロビンと DMA で読み続け、フィルタした値を読む
+static void bench_capture(const char *name, uint decimate_shift, uint smooth_shift)
+{
+    static adc_capture_t capture;
+    spread_t light = {0}, pot = {0};
+    bench_inputs();
+    adc_capture_init(&capture, (1u << BENCH_LIGHT_INPUT) | (1u << BENCH_POT_INPUT) | (1u << BENCH_MIC_INPUT), BENCH_RATE_HZ);
+    adc_capture_set_filter(&capture, BENCH_LIGHT_INPUT, decimate_shift, smooth_shift);
+    adc_capture_set_filter(&capture, BENCH_POT_INPUT, decimate_shift, smooth_shift);
+    adc_capture_start(&capture);
+    sim_run_until(time_us_64() + 500000); // フィルタが落ち着くまで待つ
+
+    uint32_t irqs = sim_get_stats().dma_irqs;
+    uint64_t begin_us = time_us_64();
+    for (int i = 0; i < BENCH_READS; i++)
+    {
+        spread_add(&light, adc_capture_read(&capture, BENCH_LIGHT_INPUT) / 16.0); // 12 ビットの LSB 単位で比べる
+        spread_add(&pot, adc_capture_read(&capture, BENCH_POT_INPUT) / 16.0);
+        sim_run_until(time_us_64() + BENCH_READ_INTERVAL_US);
+    }
+    double irqs_per_s = (sim_get_stats().dma_irqs - irqs) * 1e6 / (double)(time_us_64() - begin_us);
+
+    // ボリュームを一気に回して、変化の 99% に追いつくまでの時間を測る
+    sim_adc_set(BENCH_POT_INPUT, BENCH_STEP_FROM, BENCH_POT_NOISE);
+    sim_run_until(time_us_64() + 2000000);
+    sim_adc_set(BENCH_POT_INPUT, BENCH_STEP_TO, BENCH_POT_NOISE);
+    uint64_t step_us = time_us_64();
+    double threshold = BENCH_STEP_TO - (BENCH_STEP_TO - BENCH_STEP_FROM) * 0.01;
+    while (adc_capture_read(&capture, BENCH_POT_INPUT) / 16.0 < threshold && time_us_64() - step_us < 2000000)
+    {
+        sim_run_until(time_us_64() + 100);
+    }
+    printf("%-22s  %8.2f  %8.2f  %9.2f  %8.1f  %8.0f  %8lu\n", name, spread_stddev(&light), spread_stddev(&pot), 0.0,
+           (time_us_64() - step_us) / 1000.0, irqs_per_s, (unsigned long)sim_get_stats().adc_overruns);
+}
+
+int main()
+{
+    printf("sensor noise seen by the application (std dev in 12-bit LSB), read every %d ms, %d Hz per input x 3 inputs\n",
+           BENCH_READ_INTERVAL_US / 1000, BENCH_RATE_HZ);
+    printf("light noise %.1f LSB, pot noise %.1f LSB\n", BENCH_LIGHT_NOISE, BENCH_POT_NOISE);
+    printf("%-22s  %8s  %8s  %9s  %8s  %8s  %8s\n", "mode", "light_sd", "pot_sd", "read_us", "step_ms", "irqs/s", "overruns");
+    bench_blocking();
+    bench_capture("capture avg64", 0, 0);
+    bench_capture("capture avg64 iir/4", 0, 2);
+    bench_capture("capture avg256 iir/4", 2, 2);
+    bench_capture("capture avg1024", 4, 0);
+    return 0;
+}
@@ -0,0 +1,116 @@
+// 校正曲線 (curve.c) のホスト (Linux) 上のベンチマーク
+// 折れ点の数を変えながら、curve_lookup と、元の Save_duty() のように折れ点の表を頭から調べる方法で、
+// 1 回引くのにかかる時間を比べる (curve_lookup は折れ点の数によらず同じになるはず)。
+// また、折れ点のまわりでノイズのある入力を引いたときに、出力が変わった回数をヒステリシスのあるなしで比べる
+#include <stdio.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "curve.h"
+
+/* 定義 (マクロ) */
+#define BENCH_POINTS_MAX 256       // 試す折れ点の数の最大
+#define BENCH_LOOKUPS 4000000      // 時間を測るときに引く回数
+#define BENCH_NOISY_READS 100000   // ヒステリシスを試すときに引く回数
+#define BENCH_NOISE_LSB 3          // そのときの入力のノイズの幅 (±LSB)
+
+static curve_point_t bench_points[BENCH_POINTS_MAX];
+static curve_t bench_curve;
+static uint16_t bench_inputs[4096];
+static volatile int32_t bench_sink; // 最適化で消されないように結果を書き込む
+static uint32_t bench_random_state = 12345;
+
+// 疑似乱数 (0〜range-1) を返す関数 (結果を毎回同じにするため、線形合同法で作る)
+static uint32_t bench_random(uint32_t range)
+{
+    bench_random_state = bench_random_state * 1103515245u + 12345u;
+    return (bench_random_state >> 8) % range;
+}
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 元の Save_duty() と同じく、折れ点の表を頭から調べて、入力以上の最初の折れ点の y を返す (補間しない)
+static int32_t bench_scan(const curve_point_t *points, uint count, uint x)
+{
+    for (uint i = 0; i < count; i++)
+    {
+        if (x <= points[i].x)
+        {
+            return points[i].y;
+        }
+    }
+    return points[count - 1].y;
+}
+
+// 入力の範囲に等間隔に count 個の折れ点を作る
+static void bench_make_points(uint count)
+{
+    for (uint i = 0; i < count; i++)
+    {
+        bench_points[i].x = count == 1 ? 0 : i * CURVE_INPUT_MAX / (count - 1);
+        bench_points[i].y = (int32_t)bench_random(65536);
+    }
+    curve_init(&bench_curve, bench_points, count, 0);
+}
+
+static void bench_cost(uint count)
+{
+    bench_make_points(count);
+    double start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        bench_sink = curve_lookup(&bench_curve, bench_inputs[i & 4095]);
+    }
+    double lookup_ns = (bench_now_ns() - start) / BENCH_LOOKUPS;
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        bench_sink = bench_scan(bench_points, count, bench_inputs[i & 4095]);
+    }
+    double scan_ns = (bench_now_ns() - start) / BENCH_LOOKUPS;
+    printf("%6u  %10.2f  %10.2f\n", count, lookup_ns, scan_ns);
+}
+
+// 折れ点 x の上で揺れる入力を引き、出力が変わった回数を数える
+static void bench_chatter(uint hysteresis)
+{
+    static const curve_point_t points[] = {{400, 256}, {800, 230}, {1200, 204}};
+    curve_t curve;
+    curve_follower_t follower = {0};
+    curve_init(&curve, points, count_of(points), hysteresis);
+
+    uint32_t changes = 0;
+    int32_t last = curve_follow(&curve, &follower, 800);
+    for (uint32_t i = 0; i < BENCH_NOISY_READS; i++)
+    {
+        int32_t y = curve_follow(&curve, &follower, 800 - BENCH_NOISE_LSB + bench_random(2 * BENCH_NOISE_LSB + 1));
+        changes += y != last;
+        last = y;
+    }
+    printf("hysteresis %2u LSB: output changed %6lu times in %d reads of 800 +/- %d LSB\n", hysteresis,
+           (unsigned long)changes, BENCH_NOISY_READS, BENCH_NOISE_LSB);
+}
+
+int main()
+{
+    static const uint counts[] = {2, 10, 32, 100, 256};
+
+    for (uint i = 0; i < count_of(bench_inputs); i++)
+    {
+        bench_inputs[i] = bench_random(CURVE_INPUT_MAX + 1);
+    }
+    printf("cost per lookup (ns) over %d random 12-bit inputs\n", BENCH_LOOKUPS);
+    printf("points   curve_ns     scan_ns\n");
+    for (uint i = 0; i < count_of(counts); i++)
+    {
+        bench_cost(counts[i]);
+    }
+    bench_chatter(0);
+    bench_chatter(BENCH_NOISE_LSB * 2);
+    return 0;
+}
@@ -0,0 +1,126 @@
+// common/ のモジュールのホスト (Linux) 上のベンチマーク
+// チャタリングのあるボタンの押し離しをシミュレータ上で何度も再現し、ポーリングのモードとエッジ割り込みのモードで、
+// 最初のエッジから押された (離された) と確定するまでの遅れ、取りこぼしと余分なエッジ、割り込みの回数を表示する
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "debounce.h"
+#include "pico_sim.h"
+
+/* 定義 (マクロ) */
+#define BENCH_BUTTON_PIN 3         // ボタンのピン (押すと Low)
+#define BENCH_TRIALS 1000          // 押して離す回数
+#define BENCH_POLL_INTERVAL_MS 10  // ポーリングのモードのサンプリング周期 (ブザーのプログラムと同じ)
+#define BENCH_POLL_SAMPLES 3       // ポーリングのモードで確定に必要なサンプル数
+#define BENCH_LOCKOUT_US 20000     // エッジ割り込みのモードのロックアウト
+#define BENCH_BOUNCE_MAX 8         // 1 回の押し離しで跳ねる回数の上限
+#define BENCH_BOUNCE_GAP_US 400    // 跳ねる間隔の上限
+#define BENCH_HOLD_US 150000       // 押したまま (離したまま) にしておく時間
+
+// 押し離しの遅れの統計
+typedef struct
+{
+    uint64_t total_us;
+    uint32_t min_us, max_us;
+    uint32_t count;
+} latency_t;
+
+static uint32_t bench_random_state = 12345;
+
+// 疑似乱数 (0〜range-1) を返す関数 (結果を毎回同じにするため、線形合同法で作る)
+static uint32_t bench_random(uint32_t range)
+{
+    bench_random_state = bench_random_state * 1103515245u + 12345u;
+    return (bench_random_state >> 8) % range;
+}
+
+static void latency_add(latency_t *latency, uint32_t us)
+{
+    latency->min_us = latency->count == 0 ? us : MIN(latency->min_us, us);
+    latency->max_us = MAX(latency->max_us, us);
+    latency->total_us += us;
+    latency->count++;
+}
+
+// いまの時刻から、ボタンのピンを跳ねさせながら level にする関数 (最後は level で落ち着く)。落ち着いた時刻を返す
+static uint64_t bench_bounce(uint64_t time_us, bool level)
+{
+    int bounces = bench_random(BENCH_BOUNCE_MAX / 2 + 1) * 2; // 偶数回跳ねれば、最後は level になる
+    sim_run_until(time_us);
+    sim_gpio_set(BENCH_BUTTON_PIN, level);
+    for (int i = 0; i < bounces; i++)
+    {
+        time_us += 20 + bench_random(BENCH_BOUNCE_GAP_US);
+        sim_run_until(time_us);
+        sim_gpio_set(BENCH_BUTTON_PIN, (i & 1) ? level : !level);
+    }
+    return time_us;
+}
+
+// 1 つのモードで押し離しを BENCH_TRIALS 回くり返し、結果を表示する関数 (edge が true ならエッジ割り込みのモード)
+static void bench_mode(const char *name, bool edge)
+{
+    debounce_t buttons;
+    struct repeating_timer timer;
+    latency_t press = {0}, release = {0};
+    uint32_t errors = 0;
+
+    sim_reset();
+    bench_random_state = 12345; // どちらのモードも同じ押し方にする
+    debounce_init_buttons(&buttons, 1u << BENCH_BUTTON_PIN, BENCH_POLL_SAMPLES);
+    if (edge)
+    {
+        debounce_start_edge(&buttons, BENCH_LOCKOUT_US);
+    }
+    else
+    {
+        add_repeating_timer_ms(BENCH_POLL_INTERVAL_MS, debounce_timer_callback, &buttons, &timer);
+    }
+
+    uint64_t now = 1000;
+    for (int trial = 0; trial < BENCH_TRIALS; trial++)
+    {
+        uint64_t pressed_at = now + bench_random(BENCH_POLL_INTERVAL_MS * 1000); // サンプリングの周期とずらして押す
+        now = bench_bounce(pressed_at, false) + BENCH_HOLD_US;
+        sim_run_until(now);
+        if (debounce_take_pressed(&buttons) == (1u << BENCH_BUTTON_PIN) && debounce_take_released(&buttons) == 0)
+        {
+            latency_add(&press, buttons.event_us - (uint32_t)pressed_at);
+        }
+        else
+        {
+            errors++;
+        }
+
+        uint64_t released_at = now + bench_random(BENCH_POLL_INTERVAL_MS * 1000);
+        now = bench_bounce(released_at, true) + BENCH_HOLD_US;
+        sim_run_until(now);
+        if (debounce_take_released(&buttons) == (1u << BENCH_BUTTON_PIN) && debounce_take_pressed(&buttons) == 0)
+        {
+            latency_add(&release, buttons.event_us - (uint32_t)released_at);
+        }
+        else
+        {
+            errors++;
+        }
+    }
+    pico_sim_stats_t busy = sim_get_stats();
+    sim_run_until(now + 1000000); // 何も押さない 1 秒間の割り込みの数
+    pico_sim_stats_t idle = sim_get_stats();
+    uint32_t busy_irqs = busy.gpio_irqs + busy.alarm_irqs + busy.timer_irqs;
+    uint32_t idle_irqs = idle.gpio_irqs + idle.alarm_irqs + idle.timer_irqs - busy_irqs;
+
+    printf("%-5s  %6lu  %6lu  %6lu  %6lu  %6lu  %6lu  %6lu  %8.1f  %7lu\n", name,
+           (unsigned long)press.min_us, (unsigned long)(press.count ? press.total_us / press.count : 0), (unsigned long)press.max_us,
+           (unsigned long)release.min_us, (unsigned long)(release.count ? release.total_us / release.count : 0), (unsigned long)release.max_us,
+           (unsigned long)errors, (double)busy_irqs / BENCH_TRIALS, (unsigned long)idle_irqs);
+}
+
+int main()
+{
+    printf("press-to-event latency (us) over %d bouncy presses, sampled every %d ms x %d / edge lockout %d us\n",
+           BENCH_TRIALS, BENCH_POLL_INTERVAL_MS, BENCH_POLL_SAMPLES, BENCH_LOCKOUT_US);
+    printf("mode   pr_min  pr_avg  pr_max  rl_min  rl_avg  rl_max  errors  irqs/press  idle_irqs/s\n");
+    bench_mode("poll", false);
+    bench_mode("edge", true);
+    return 0;
+}
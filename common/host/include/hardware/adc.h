@@ -0,0 +1,29 @@
+// ホストビルド用の hardware/adc.h の代わり
+// 各入力の電圧 (平均とノイズ) はシミュレータ (sim_adc_set) が決める。adc_run(true) の後は、仮想の時刻で
+// (1 + div) ADC クロックごとに変換し、FIFO を読む DMA チャネルに渡す (FIFO の深さは模擬しない)
+#ifndef HOST_HARDWARE_ADC_H
+#define HOST_HARDWARE_ADC_H
+
+#include "pico/stdlib.h"
+
+typedef struct
+{
+    volatile uint32_t fifo;
+} adc_hw_t;
+
+extern adc_hw_t adc_sim_hw;
+#define adc_hw (&adc_sim_hw)
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+uint adc_get_selected_input(void);
+void adc_set_round_robin(uint input_mask);
+void adc_set_temp_sensor_enabled(bool enable);
+void adc_set_clkdiv(float clkdiv);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_fifo_drain(void);
+void adc_run(bool run);
+uint16_t adc_read(void); // 1 回変換する時間 (96 ADC クロック) だけ仮想の時刻を進める
+
+#endif
@@ -0,0 +1,16 @@
+// ホストビルド用の hardware/clocks.h の代わり
+// システムクロックの周波数はシミュレータ (sim_set_sys_clock_hz) が決める。ADC のクロックは 48MHz 固定
+#ifndef HOST_HARDWARE_CLOCKS_H
+#define HOST_HARDWARE_CLOCKS_H
+
+#include "pico/stdlib.h"
+
+enum clock_index
+{
+    clk_sys = 5,
+    clk_adc = 7,
+};
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+#endif
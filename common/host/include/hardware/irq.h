@@ -0,0 +1,18 @@
+// ホストビルド用の hardware/irq.h の代わり (DMA の割り込みだけを模擬する)
+#ifndef HOST_HARDWARE_IRQ_H
+#define HOST_HARDWARE_IRQ_H
+
+#include "pico/stdlib.h"
+
+enum irq_number
+{
+    DMA_IRQ_0 = 11,
+    DMA_IRQ_1 = 12,
+};
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+#endif
@@ -0,0 +1,26 @@
+// ホストビルド用の hardware/pwm.h の代わり
+// 書き込んだ分周比、周期、レベルはシミュレータが覚えておき、sim_get_pwm() で読み出せる
+#ifndef HOST_HARDWARE_PWM_H
+#define HOST_HARDWARE_PWM_H
+
+#include "pico/stdlib.h"
+
+#define PWM_CHAN_A 0
+#define PWM_CHAN_B 1
+
+typedef struct
+{
+    uint32_t div;  // 分周比 (整数部 << 4 | 小数部)
+    uint32_t top;  // 周期 (wrap)
+} pwm_config;
+
+static inline uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7u; }
+static inline uint pwm_gpio_to_channel(uint gpio) { return gpio & 1u; }
+static inline pwm_config pwm_get_default_config(void) { return (pwm_config){1u << 4, 0xffff}; }
+
+void pwm_init(uint slice_num, pwm_config *config, bool start);
+void pwm_set_clkdiv_int_frac(uint slice_num, uint8_t integer, uint8_t fract);
+void pwm_set_wrap(uint slice_num, uint16_t wrap);
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level);
+
+#endif
@@ -0,0 +1,14 @@
+// ホストビルド用の hardware/sync.h の代わり
+// 割り込みはシミュレータが時刻を進めるときにしか起きないので、割り込みの禁止と復帰は何もしない
+#ifndef HOST_HARDWARE_SYNC_H
+#define HOST_HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+static inline void __wfi(void) {}
+static inline void __wfe(void) {}
+static inline void __sev(void) {}
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void)status; }
+
+#endif
@@ -0,0 +1,14 @@
+// ホストビルド用の hardware/timer.h の代わり (ハードウェアアラームはシミュレータの仮想時刻で鳴る)
+#ifndef HOST_HARDWARE_TIMER_H
+#define HOST_HARDWARE_TIMER_H
+
+#include "pico/stdlib.h"
+
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t); // 時刻がもう過ぎていれば true を返す (コールバックは呼ばない)
+void hardware_alarm_cancel(uint alarm_num);
+
+#endif
@@ -0,0 +1,41 @@
+// ホスト (Linux) ビルド用の pico/stdlib.h の代わり。common/ のモジュールが使う分だけを宣言する
+// 実体は pico_sim.c にあり、時間は実時間ではなくシミュレータが進める仮想の時刻 (us)
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t; // 起動からの時間 (us)
+
+struct repeating_timer;
+typedef bool (*repeating_timer_callback_t)(struct repeating_timer *rt);
+
+struct repeating_timer
+{
+    int64_t delay_us;
+    repeating_timer_callback_t callback;
+    void *user_data;
+    uint64_t next_us; // 次に呼ぶ時刻 (シミュレータが使う)
+};
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+static inline absolute_time_t from_us_since_boot(uint64_t us) { return us; }
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, struct repeating_timer *out);
+bool cancel_repeating_timer(struct repeating_timer *timer);
+
+#endif
@@ -0,0 +1,109 @@
+// マイクのパイプライン (mic.c) のホスト (Linux) 上のベンチマーク
+// ボリュームのプログラムと同じく照度センサ、ボリューム、マイクをラウンドロビンで読み、マイクに正弦波とノイズを入れて、
+// 推定した音の高さのずれ (セント)、大きさ、捨てたブロックの数、1 ブロックの処理時間 (ホストでの実測) を表示する
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "adc_capture.h"
+#include "mic.h"
+#include "tone.h"
+#include "pico_sim.h"
+
+/* 定義 (マクロ) */
+#define BENCH_LIGHT_INPUT 0      // 照度センサ (ADC0)
+#define BENCH_POT_INPUT 1        // ボリューム (ADC1)
+#define BENCH_MIC_INPUT 2        // マイク (ADC2)
+#define BENCH_RUN_US 2000000     // 1 つの音を聞かせる時間
+#define BENCH_POLL_US 1000       // mic_poll() を呼ぶ間隔
+#define BENCH_AMPLITUDE 300.0    // 正弦波の振幅 (LSB)
+#define BENCH_LOUD 2000.0        // 大きな音の振幅 (LSB。Goertzel フィルタの状態と強さが一番大きくなる)
+#define BENCH_NOISE 20.0         // ノイズの標準偏差 (LSB)
+#define BENCH_CENTS_MAX 20.0     // 音の高さが分かったとみなす推定のずれ (セント)
+
+static adc_capture_t bench_capture;
+static mic_t bench_mic;
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 入力 1 つあたり rate_hz でマイクに振幅 amplitude、hz の音 (hz が 0 なら無音) を聞かせ、poll_us ごとに mic_poll() を呼ぶ
+// 半分以上のブロックで pitched になり、最後の推定のずれが BENCH_CENTS_MAX セント以内なら true を返す
+static bool bench_tone(uint32_t rate_hz, double amplitude, double hz, uint32_t poll_us)
+{
+    sim_reset();
+    sim_adc_set(BENCH_LIGHT_INPUT, 1500.0, 10.0);
+    sim_adc_set(BENCH_POT_INPUT, 2000.0, 5.0);
+    sim_adc_set(BENCH_MIC_INPUT, 2048.0, BENCH_NOISE);
+    sim_adc_set_tone(BENCH_MIC_INPUT, hz > 0.0 ? amplitude : 0.0, hz);
+    adc_capture_init(&bench_capture, (1u << BENCH_LIGHT_INPUT) | (1u << BENCH_POT_INPUT) | (1u << BENCH_MIC_INPUT), rate_hz);
+    mic_init(&bench_mic, &bench_capture, BENCH_MIC_INPUT);
+    adc_capture_start(&bench_capture);
+
+    double busy_ns = 0.0;
+    uint32_t pitched = 0;
+    while (time_us_64() < BENCH_RUN_US)
+    {
+        sim_run_until(time_us_64() + poll_us);
+        double start = bench_now_ns();
+        bool polled = mic_poll(&bench_mic);
+        busy_ns += bench_now_ns() - start; // 間引くときは、結果を出さない呼び出しでも間引く分の時間がかかる
+        if (polled)
+        {
+            pitched += bench_mic.pitched;
+        }
+    }
+
+    double cents = 0.0;
+    char heard[16] = "-";
+    if (bench_mic.pitched && hz > 0.0)
+    {
+        cents = 1200.0 * log2(bench_mic.freq / (double)TONE_HZ(1) / hz);
+        snprintf(heard, sizeof(heard), "%.1f", bench_mic.freq / (double)TONE_HZ(1));
+    }
+    double block_ns = bench_mic.block_us * 1e3;
+    printf("%6lu  %7.1f  %8s  %7.1f  %4u  %5u  %3lu/%-3lu  %7lu  %9.1f  %6.2f\n", (unsigned long)rate_hz, hz, heard, cents,
+           bench_mic.note, bench_mic.level, (unsigned long)pitched, (unsigned long)bench_mic.blocks, (unsigned long)mic_dropped(&bench_mic),
+           busy_ns / MAX(bench_mic.blocks, 1u) / 1000.0, busy_ns / MAX(bench_mic.blocks, 1u) / block_ns * 100.0);
+    return bench_mic.pitched && pitched * 2 >= bench_mic.blocks && fabs(cents) <= BENCH_CENTS_MAX;
+}
+
+int main()
+{
+    static const double tones_hz[] = {0.0, 220.0, 261.6, 300.0, 440.0, 523.3, 700.0, 880.0, 1318.5, 1760.0};
+
+    printf("mic pitch/level over %d ms per tone (amplitude %.0f LSB, noise %.0f LSB), light/pot/mic round-robin\n",
+           BENCH_RUN_US / 1000, BENCH_AMPLITUDE, BENCH_NOISE);
+    printf("rate_hz  tone_hz  heard_hz    cents  note  level  pitched  dropped  host_us/blk  host_%%\n");
+    for (uint i = 0; i < count_of(tones_hz); i++)
+    {
+        bench_tone(8000, BENCH_AMPLITUDE, tones_hz[i], BENCH_POLL_US);
+    }
+    bench_tone(16000, BENCH_AMPLITUDE, 440.0, BENCH_POLL_US);
+    bench_tone(48000, BENCH_AMPLITUDE, 440.0, BENCH_POLL_US);
+
+    // 48kHz で読んでも、8kHz 付近まで間引いてから調べるので、一番低い音まで分かること
+    printf("48 kHz capture (decimated to %d Hz): pitched in at least half the blocks and within %.0f cents\n",
+           MIC_ANALYSIS_HZ, BENCH_CENTS_MAX);
+    int failures = 0;
+    static const double decimated_hz[] = {220.0, 440.0, 1760.0};
+    for (uint i = 0; i < count_of(decimated_hz); i++)
+    {
+        bool ok = bench_tone(48000, BENCH_AMPLITUDE, decimated_hz[i], BENCH_POLL_US);
+        printf("        -> %s\n", ok ? "PASS" : "FAIL");
+        failures += !ok;
+    }
+
+    printf("loud tone (amplitude %.0f LSB): note must stay on the played note and level must not collapse\n", BENCH_LOUD);
+    bench_tone(8000, BENCH_LOUD, 220.0, BENCH_POLL_US);
+    bench_tone(48000, BENCH_LOUD, 220.0, BENCH_POLL_US);
+    bench_tone(48000, BENCH_LOUD, 1760.0, BENCH_POLL_US);
+
+    printf("late consumer (polls every 150 ms, blocks are 64 ms): blocks must be counted as dropped\n");
+    bench_tone(8000, BENCH_AMPLITUDE, 440.0, 150000);
+    return failures != 0;
+}
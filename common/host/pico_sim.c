@@ -0,0 +1,563 @@
+#include <string.h> // memset を使うためにインクルード
+#include <math.h>   // ADC のノイズ (正規分布) を作るためにインクルード
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "pico_sim.h"
+
+/* 定義 (マクロ) */
+#define SIM_GPIO_COUNT 32  // 模擬する GPIO の数
+#define SIM_ALARM_COUNT 4  // 模擬するハードウェアアラームの数
+#define SIM_TIMER_MAX 4    // 同時に動かせる繰り返しタイマーの数
+#define SIM_PWM_COUNT 8    // 模擬する PWM スライスの数
+#define SIM_SYS_CLOCK_HZ 125000000 // システムクロックの初期値 (SDK の既定値)
+#define SIM_ADC_CLOCK_HZ 48000000  // ADC のクロック
+#define SIM_ADC_CYCLES 96          // 1 回の変換にかかる ADC のクロック数
+#define SIM_ADC_INPUTS 5           // ADC の入力の数
+#define SIM_DMA_COUNT 12           // 模擬する DMA チャネルの数
+
+/* グローバル変数 */
+static uint64_t sim_now_us;                          // 仮想の時刻
+static uint32_t sim_gpio_level = 0xffffffffu;        // 各ピンの電圧 (プルアップで、何もつながなければ High)
+static uint32_t sim_gpio_enabled[SIM_GPIO_COUNT];    // 各ピンの有効にした割り込みの種類
+static uint32_t sim_gpio_latched[SIM_GPIO_COUNT];    // 各ピンで起きて、まだ消していないエッジ
+static gpio_irq_callback_t sim_gpio_callback;
+static bool sim_in_gpio_irq;                         // GPIO 割り込みのコールバックの中か (中から有効にしても入れ子にしない)
+
+static struct
+{
+    bool claimed;
+    bool armed;
+    uint64_t target_us;
+    hardware_alarm_callback_t callback;
+} sim_alarms[SIM_ALARM_COUNT];
+
+static struct repeating_timer *sim_timers[SIM_TIMER_MAX];
+static pico_sim_stats_t sim_stats;
+static pico_sim_pwm_t sim_pwm[SIM_PWM_COUNT];
+static uint32_t sim_sys_clock_hz = SIM_SYS_CLOCK_HZ;
+
+static struct
+{
+    double mean[SIM_ADC_INPUTS];  // 各入力の電圧の平均 (LSB)
+    double noise[SIM_ADC_INPUTS]; // 各入力のノイズの標準偏差 (LSB)
+    double tone_amplitude[SIM_ADC_INPUTS]; // 各入力に重ねる正弦波の振幅 (LSB)
+    double tone_hz[SIM_ADC_INPUTS];        // その周波数
+    uint selected;                // 次に変換する入力
+    uint round_robin;             // ラウンドロビンで回す入力
+    uint32_t cycles;              // 変換の間隔 (ADC のクロック数)
+    bool running;
+    uint64_t next_ns;             // 次の変換が終わる時刻 (ns)
+    uint32_t random_state;
+} sim_adc;
+adc_hw_t adc_sim_hw;
+
+static struct
+{
+    bool claimed;
+    bool busy;
+    bool irq1_enabled;
+    bool irq1_status;
+    dma_channel_config config;
+    volatile uint16_t *write_addr;
+    uint32_t reload;              // 起動したときの転送回数
+    uint32_t remaining;
+} sim_dma[SIM_DMA_COUNT];
+static irq_handler_t sim_dma_irq1_handler;
+static bool sim_dma_irq1_enabled;
+
+/* 時間 */
+
+uint64_t time_us_64(void)
+{
+    return sim_now_us;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)sim_now_us;
+}
+
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, struct repeating_timer *out)
+{
+    for (int i = 0; i < SIM_TIMER_MAX; i++)
+    {
+        if (sim_timers[i] == NULL)
+        {
+            out->delay_us = (int64_t)delay_ms * 1000;
+            out->callback = callback;
+            out->user_data = user_data;
+            out->next_us = sim_now_us + (delay_ms < 0 ? -out->delay_us : out->delay_us);
+            sim_timers[i] = out;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cancel_repeating_timer(struct repeating_timer *timer)
+{
+    for (int i = 0; i < SIM_TIMER_MAX; i++)
+    {
+        if (sim_timers[i] == timer)
+        {
+            sim_timers[i] = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ハードウェアアラーム */
+
+int hardware_alarm_claim_unused(bool required)
+{
+    (void)required; // 空きがなければ -1 を返す (SDK のように panic はしない)
+    for (int i = 0; i < SIM_ALARM_COUNT; i++)
+    {
+        if (!sim_alarms[i].claimed)
+        {
+            sim_alarms[i].claimed = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback)
+{
+    sim_alarms[alarm_num].callback = callback;
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t)
+{
+    if (t <= sim_now_us)
+    {
+        sim_alarms[alarm_num].armed = false;
+        return true;
+    }
+    sim_alarms[alarm_num].armed = true;
+    sim_alarms[alarm_num].target_us = t;
+    return false;
+}
+
+void hardware_alarm_cancel(uint alarm_num)
+{
+    sim_alarms[alarm_num].armed = false;
+}
+
+/* GPIO */
+
+void gpio_init(uint gpio) { (void)gpio; }
+void gpio_init_mask(uint32_t mask) { (void)mask; }
+void gpio_set_dir(uint gpio, bool out) { (void)gpio, (void)out; }
+void gpio_set_function(uint gpio, enum gpio_function fn) { (void)gpio, (void)fn; }
+void gpio_set_dir_in_masked(uint32_t mask) { (void)mask; }
+void gpio_pull_up(uint gpio) { (void)gpio; }
+
+bool gpio_get(uint gpio)
+{
+    return (sim_gpio_level >> gpio) & 1u;
+}
+
+uint32_t gpio_get_all(void)
+{
+    return sim_gpio_level;
+}
+
+// ピン gpio に、有効で消していないエッジがあれば割り込みのコールバックを呼ぶ (SDK と同じく、呼ぶ前にそのエッジを消す)
+static void sim_gpio_raise(uint gpio)
+{
+    uint32_t events = sim_gpio_latched[gpio] & sim_gpio_enabled[gpio];
+    if (events == 0 || sim_gpio_callback == NULL || sim_in_gpio_irq)
+    {
+        return;
+    }
+    sim_gpio_latched[gpio] &= ~events;
+    sim_stats.gpio_irqs++;
+    sim_in_gpio_irq = true;
+    sim_gpio_callback(gpio, events);
+    sim_in_gpio_irq = false;
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+    if (enabled)
+    {
+        sim_gpio_enabled[gpio] |= event_mask;
+        sim_gpio_raise(gpio); // 前に起きたエッジが残っていれば、有効にした時点で割り込みが入る
+    }
+    else
+    {
+        sim_gpio_enabled[gpio] &= ~event_mask;
+    }
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback)
+{
+    sim_gpio_callback = callback;
+    gpio_set_irq_enabled(gpio, event_mask, enabled);
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t event_mask)
+{
+    sim_gpio_latched[gpio] &= ~event_mask;
+}
+
+/* PWM とクロック */
+
+void pwm_init(uint slice_num, pwm_config *config, bool start)
+{
+    sim_pwm[slice_num] = (pico_sim_pwm_t){config->div, config->top, {0, 0}, start};
+}
+
+void pwm_set_clkdiv_int_frac(uint slice_num, uint8_t integer, uint8_t fract)
+{
+    sim_pwm[slice_num].div = (uint32_t)integer << 4 | (fract & 0xfu);
+    sim_stats.pwm_writes++;
+}
+
+void pwm_set_wrap(uint slice_num, uint16_t wrap)
+{
+    sim_pwm[slice_num].wrap = wrap;
+    sim_stats.pwm_writes++;
+}
+
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level)
+{
+    sim_pwm[slice_num].level[chan] = level;
+    sim_stats.pwm_writes++;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    return clk_index == clk_adc ? SIM_ADC_CLOCK_HZ : sim_sys_clock_hz;
+}
+
+/* ADC と DMA */
+
+// 正規分布の乱数を返す関数 (結果を毎回同じにするため、線形合同法とボックス＝ミュラー法で作る)
+static double sim_gauss(void)
+{
+    double u[2];
+    for (int i = 0; i < 2; i++)
+    {
+        sim_adc.random_state = sim_adc.random_state * 1103515245u + 12345u;
+        u[i] = ((sim_adc.random_state >> 8) + 1.0) / 16777217.0;
+    }
+    return sqrt(-2.0 * log(u[0])) * cos(2.0 * M_PI * u[1]);
+}
+
+// 選んでいる入力を時刻 time_ns に 1 回変換した値を返し、ラウンドロビンなら次の入力に進める関数
+static uint16_t sim_adc_convert(uint64_t time_ns)
+{
+    uint input = sim_adc.selected;
+    double value = sim_adc.mean[input] + sim_adc.noise[input] * sim_gauss() +
+                   sim_adc.tone_amplitude[input] * sin(2.0 * M_PI * sim_adc.tone_hz[input] * (time_ns * 1e-9));
+    sim_stats.adc_conversions++;
+    if (sim_adc.round_robin != 0)
+    {
+        do
+        {
+            sim_adc.selected = (sim_adc.selected + 1) % SIM_ADC_INPUTS;
+        } while ((sim_adc.round_robin & (1u << sim_adc.selected)) == 0);
+    }
+    return (uint16_t)MIN(MAX(lround(value), 0), 4095);
+}
+
+// 変換した値 sample を、ADC の FIFO を読む DMA チャネルに渡す関数。転送が終わったら連鎖と割り込みを起こす
+static void sim_dma_adc_request(uint16_t sample)
+{
+    for (int channel = 0; channel < SIM_DMA_COUNT; channel++)
+    {
+        if (!sim_dma[channel].busy || sim_dma[channel].config.dreq != DREQ_ADC)
+        {
+            continue;
+        }
+        *sim_dma[channel].write_addr = sample;
+        sim_dma[channel].write_addr += sim_dma[channel].config.write_increment;
+        if (--sim_dma[channel].remaining != 0)
+        {
+            return;
+        }
+        sim_dma[channel].busy = false;
+        if (sim_dma[channel].config.chain_to != channel)
+        {
+            dma_channel_start(sim_dma[channel].config.chain_to);
+        }
+        if (sim_dma[channel].irq1_enabled)
+        {
+            sim_dma[channel].irq1_status = true;
+            if (sim_dma_irq1_enabled && sim_dma_irq1_handler != NULL)
+            {
+                sim_stats.dma_irqs++;
+                sim_dma_irq1_handler();
+            }
+        }
+        return;
+    }
+    sim_stats.adc_overruns++; // 受け取る DMA チャネルがない (FIFO があふれる)
+}
+
+void adc_init(void)
+{
+    sim_adc.selected = 0;
+    sim_adc.round_robin = 0;
+    sim_adc.cycles = SIM_ADC_CYCLES;
+    sim_adc.running = false;
+}
+
+void adc_gpio_init(uint gpio) { (void)gpio; }
+void adc_set_temp_sensor_enabled(bool enable) { (void)enable; }
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift)
+{
+    (void)en, (void)dreq_en, (void)dreq_thresh, (void)err_in_fifo, (void)byte_shift; // FIFO は常に 1 サンプルごとに DREQ を出すものとして模擬する
+}
+void adc_fifo_drain(void) {}
+
+void adc_select_input(uint input)
+{
+    sim_adc.selected = input;
+}
+
+uint adc_get_selected_input(void)
+{
+    return sim_adc.selected;
+}
+
+void adc_set_round_robin(uint input_mask)
+{
+    sim_adc.round_robin = input_mask;
+}
+
+void adc_set_clkdiv(float clkdiv)
+{
+    sim_adc.cycles = MAX((uint32_t)clkdiv + 1, SIM_ADC_CYCLES);
+}
+
+void adc_run(bool run)
+{
+    if (run && !sim_adc.running)
+    {
+        sim_adc.next_ns = sim_now_us * 1000 + (uint64_t)sim_adc.cycles * 1000000000u / SIM_ADC_CLOCK_HZ;
+    }
+    sim_adc.running = run;
+}
+
+uint16_t adc_read(void)
+{
+    uint16_t sample = sim_adc_convert(sim_now_us * 1000);
+    sim_run_until(sim_now_us + (SIM_ADC_CYCLES * 1000000u + SIM_ADC_CLOCK_HZ - 1) / SIM_ADC_CLOCK_HZ); // 変換が終わるまで待つ
+    return sample;
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    (void)required; // 空きがなければ -1 を返す (SDK のように panic はしない)
+    for (int channel = 0; channel < SIM_DMA_COUNT; channel++)
+    {
+        if (!sim_dma[channel].claimed)
+        {
+            sim_dma[channel].claimed = true;
+            return channel;
+        }
+    }
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    return (dma_channel_config){DMA_SIZE_32, true, false, 0x3f, channel};
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint32_t transfer_count, bool trigger)
+{
+    (void)read_addr; // 読み出し元は DREQ_ADC で決まる ADC の FIFO しか模擬しない
+    sim_dma[channel].config = *config;
+    sim_dma[channel].write_addr = write_addr;
+    sim_dma[channel].reload = transfer_count;
+    if (trigger)
+    {
+        dma_channel_start(channel);
+    }
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger)
+{
+    sim_dma[channel].write_addr = write_addr;
+    if (trigger)
+    {
+        dma_channel_start(channel);
+    }
+}
+
+void dma_channel_start(uint channel)
+{
+    sim_dma[channel].busy = true;
+    sim_dma[channel].remaining = sim_dma[channel].reload; // 起動するたびに転送回数を読み込み直す
+}
+
+void dma_channel_abort(uint channel)
+{
+    sim_dma[channel].busy = false;
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled)
+{
+    sim_dma[channel].irq1_enabled = enabled;
+}
+
+bool dma_channel_get_irq1_status(uint channel)
+{
+    return sim_dma[channel].irq1_status;
+}
+
+void dma_channel_acknowledge_irq1(uint channel)
+{
+    sim_dma[channel].irq1_status = false;
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    (void)num; // 模擬する割り込みは DMA_IRQ_1 だけ
+    sim_dma_irq1_handler = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    (void)num;
+    sim_dma_irq1_enabled = enabled;
+}
+
+/* シミュレータの操作 */
+
+void sim_reset(void)
+{
+    sim_now_us = 0;
+    sim_gpio_level = 0xffffffffu;
+    memset(sim_gpio_enabled, 0, sizeof(sim_gpio_enabled));
+    memset(sim_gpio_latched, 0, sizeof(sim_gpio_latched));
+    sim_gpio_callback = NULL;
+    memset(sim_alarms, 0, sizeof(sim_alarms));
+    memset(sim_timers, 0, sizeof(sim_timers));
+    memset(&sim_stats, 0, sizeof(sim_stats));
+    memset(sim_pwm, 0, sizeof(sim_pwm));
+    memset(&sim_adc, 0, sizeof(sim_adc));
+    sim_adc.cycles = SIM_ADC_CYCLES;
+    sim_adc.random_state = 12345;
+    memset(sim_dma, 0, sizeof(sim_dma));
+    sim_dma_irq1_handler = NULL;
+    sim_dma_irq1_enabled = false;
+}
+
+// 時刻を time_us まで進める関数。その間に期限の来たアラームとタイマーを、期限の早い順に呼ぶ
+void sim_run_until(uint64_t time_us)
+{
+    for (;;)
+    {
+        uint64_t next = time_us + 1;
+        int alarm = -1;
+        struct repeating_timer *timer = NULL;
+        for (int i = 0; i < SIM_ALARM_COUNT; i++)
+        {
+            if (sim_alarms[i].armed && sim_alarms[i].target_us < next)
+            {
+                next = sim_alarms[i].target_us;
+                alarm = i;
+            }
+        }
+        for (int i = 0; i < SIM_TIMER_MAX; i++)
+        {
+            if (sim_timers[i] != NULL && sim_timers[i]->next_us < next)
+            {
+                next = sim_timers[i]->next_us;
+                timer = sim_timers[i];
+                alarm = -1;
+            }
+        }
+        bool adc = false;
+        if (sim_adc.running && sim_adc.next_ns / 1000 < next)
+        {
+            next = sim_adc.next_ns / 1000;
+            adc = true;
+        }
+        if (next > time_us)
+        {
+            break;
+        }
+
+        sim_now_us = next;
+        if (adc)
+        {
+            uint64_t time_ns = sim_adc.next_ns;
+            sim_adc.next_ns += (uint64_t)sim_adc.cycles * 1000000000u / SIM_ADC_CLOCK_HZ;
+            sim_dma_adc_request(sim_adc_convert(time_ns));
+        }
+        else if (timer != NULL)
+        {
+            sim_stats.timer_irqs++;
+            timer->next_us += timer->delay_us < 0 ? -timer->delay_us : timer->delay_us;
+            if (!timer->callback(timer))
+            {
+                cancel_repeating_timer(timer);
+            }
+        }
+        else
+        {
+            sim_alarms[alarm].armed = false;
+            sim_stats.alarm_irqs++;
+            sim_alarms[alarm].callback(alarm);
+        }
+    }
+    sim_now_us = time_us;
+}
+
+// ピン gpio の電圧を level にする関数 (いまの時刻で変わったことにする)。変われば、そのエッジの割り込みを起こす
+void sim_gpio_set(uint gpio, bool level)
+{
+    uint32_t bit = 1u << gpio;
+    if (((sim_gpio_level & bit) != 0) == level)
+    {
+        return;
+    }
+    sim_gpio_level ^= bit;
+    sim_gpio_latched[gpio] |= level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+    sim_gpio_raise(gpio);
+}
+
+pico_sim_stats_t sim_get_stats(void)
+{
+    return sim_stats;
+}
+
+pico_sim_pwm_t sim_get_pwm(uint slice)
+{
+    return sim_pwm[slice];
+}
+
+// システムクロックの周波数を変える関数 (sim_reset() では戻さない)
+void sim_set_sys_clock_hz(uint32_t hz)
+{
+    sim_sys_clock_hz = hz;
+}
+
+// ADC の入力 input の電圧を、平均 mean_lsb、ノイズの標準偏差 noise_lsb (どちらも 12 ビットの LSB 単位) にする関数
+void sim_adc_set(uint input, double mean_lsb, double noise_lsb)
+{
+    sim_adc.mean[input] = mean_lsb;
+    sim_adc.noise[input] = noise_lsb;
+    sim_adc.tone_amplitude[input] = 0.0;
+}
+
+// ADC の入力 input に、振幅 amplitude_lsb、周波数 hz の正弦波を重ねる関数 (マイクに入る音の代わり)
+void sim_adc_set_tone(uint input, double amplitude_lsb, double hz)
+{
+    sim_adc.tone_amplitude[input] = amplitude_lsb;
+    sim_adc.tone_hz[input] = hz;
+}
@@ -0,0 +1,41 @@
+// ホスト (Linux) 上で GPIO、タイマー、ハードウェアアラームを模擬するシミュレータ
+// 時刻は仮想の us で、sim_run_until() で進めた分だけ進み、その間に期限の来たタイマーとアラームを順に呼ぶ。
+// PWM のレジスタに書いた値は sim_get_pwm() で読み出せ、システムクロックは sim_set_sys_clock_hz() で変えられる。
+// ADC の各入力の電圧は sim_adc_set() と sim_adc_set_tone() で決め、走らせた ADC は仮想の時刻で変換して DMA に渡す。
+// ピンの電圧を sim_gpio_set() で変えると、有効にしたエッジの割り込みのコールバックをその場で呼ぶ (割り込みの遅れは 0 とみなす)
+#ifndef PICO_SIM_H
+#define PICO_SIM_H
+
+#include "pico/stdlib.h"
+
+// 呼んだ割り込みの数
+typedef struct
+{
+    uint32_t gpio_irqs;  // GPIO のエッジ割り込み
+    uint32_t alarm_irqs; // ハードウェアアラーム
+    uint32_t timer_irqs; // 繰り返しタイマー
+    uint32_t pwm_writes; // PWM のレジスタの書き込み
+    uint32_t adc_conversions; // ADC の変換
+    uint32_t adc_overruns;    // 受け取る DMA チャネルがなく、捨てた変換結果
+    uint32_t dma_irqs;        // DMA の割り込み
+} pico_sim_stats_t;
+
+// PWM スライス 1 つ分のレジスタ
+typedef struct
+{
+    uint32_t div;      // 分周比 (整数部 << 4 | 小数部)
+    uint16_t wrap;     // 周期 (カウンタの最大値)
+    uint16_t level[2]; // チャネル A / B のレベル
+    bool enabled;
+} pico_sim_pwm_t;
+
+void sim_reset(void);
+void sim_run_until(uint64_t time_us);
+void sim_gpio_set(uint gpio, bool level);
+pico_sim_stats_t sim_get_stats(void);
+pico_sim_pwm_t sim_get_pwm(uint slice);
+void sim_set_sys_clock_hz(uint32_t hz);
+void sim_adc_set(uint input, double mean_lsb, double noise_lsb);
+void sim_adc_set_tone(uint input, double amplitude_lsb, double hz);
+
+#endif
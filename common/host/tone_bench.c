@@ -0,0 +1,134 @@
+// トーンエンジン (tone.c) のホスト (Linux) 上のベンチマーク
+// システムクロックを変えながら、平均律の各音について PWM に書いた分周比と周期から実際に出る周波数を求め、
+// 目的の周波数とのずれ (セント) を表示する。比較のため、分周比 125 固定で周期 = 125000 / 周波数 とする元の式のずれも表示する
+#include <stdio.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "tone.h"
+#include "pico_sim.h"
+
+/* 定義 (マクロ) */
+#define BENCH_BUZZER_PIN 15      // ブザーのピン
+#define BENCH_OLD_CLKDIV 125     // 元の式の分周比
+#define BENCH_OLD_SCALE 125000   // 元の式の 周期 = BENCH_OLD_SCALE / 周波数
+
+// ずれの統計
+typedef struct
+{
+    double max_cents;
+    double total_cents;
+    uint32_t count;
+} cents_t;
+
+static void cents_add(cents_t *cents, double out_hz, double want_hz)
+{
+    double c = fabs(1200.0 * log2(out_hz / want_hz));
+    cents->max_cents = MAX(cents->max_cents, c);
+    cents->total_cents += c;
+    cents->count++;
+}
+
+// PWM のレジスタから、実際に出る周波数を求める関数
+static double pwm_output_hz(uint32_t clock_hz, pico_sim_pwm_t pwm)
+{
+    return clock_hz * 16.0 / ((double)pwm.div * (pwm.wrap + 1.0));
+}
+
+// システムクロック clock_hz で、ノート番号 low〜high の音のずれを測る関数
+static void bench_notes(uint32_t clock_hz, uint low, uint high)
+{
+    tone_t tone;
+    cents_t now = {0}, old = {0};
+    uint32_t writes = 0;
+    uint slice = pwm_gpio_to_slice_num(BENCH_BUZZER_PIN);
+
+    sim_reset();
+    sim_set_sys_clock_hz(clock_hz);
+    tone_init(&tone, BENCH_BUZZER_PIN, false);
+    for (uint note = low; note <= high; note++)
+    {
+        double want_hz = 440.0 * pow(2.0, ((int)note - TONE_NOTE_A4) / 12.0);
+        uint32_t before = sim_get_stats().pwm_writes;
+        tone_start_note(&tone, note, TONE_VOLUME_MAX / 2);
+        tone_start_note(&tone, note, TONE_VOLUME_MAX / 2); // 同じ音ならレジスタは書き換えないはず
+        writes = MAX(writes, sim_get_stats().pwm_writes - before);
+        cents_add(&now, pwm_output_hz(clock_hz, sim_get_pwm(slice)), want_hz);
+
+        uint32_t old_wrap = BENCH_OLD_SCALE / (uint32_t)lround(want_hz); // 元の式 (整数の Hz しか扱えない)
+        if (old_wrap >= 1 && old_wrap <= 0xffff)
+        {
+            cents_add(&old, clock_hz / (double)BENCH_OLD_CLKDIV / (old_wrap + 1.0), want_hz);
+        }
+    }
+    printf("%7.1f  %3u-%-3u  %8.3f  %8.3f  %6lu  %8.1f  %8.1f  %4lu\n", clock_hz / 1e6, low, high,
+           now.max_cents, now.total_cents / now.count, (unsigned long)writes,
+           old.max_cents, old.count ? old.total_cents / old.count : 0.0, (unsigned long)old.count);
+}
+
+// TONE_NOTE_LOW〜TONE_NOTE_HIGH の外の音 (分周比と周期で数セント以内に合わせられない音) が、鳴らされずに断られるかを確かめる関数
+static void bench_out_of_range(uint32_t clock_hz)
+{
+    tone_t tone;
+    uint32_t rejected = 0, outside = 0;
+
+    sim_reset();
+    sim_set_sys_clock_hz(clock_hz);
+    tone_init(&tone, BENCH_BUZZER_PIN, false);
+    uint32_t before = sim_get_stats().pwm_writes;
+    for (uint note = 0; note < 128; note++)
+    {
+        if (note >= TONE_NOTE_LOW && note <= TONE_NOTE_HIGH)
+        {
+            continue;
+        }
+        outside++;
+        rejected += !tone_start_note(&tone, note, TONE_VOLUME_MAX / 2);
+    }
+    printf("%7.1f  notes outside %u-%u: %lu/%lu rejected, %lu PWM writes, %s\n", clock_hz / 1e6, TONE_NOTE_LOW, TONE_NOTE_HIGH,
+           (unsigned long)rejected, (unsigned long)outside, (unsigned long)(sim_get_stats().pwm_writes - before),
+           tone.playing ? "playing" : "silent");
+}
+
+// ボリュームのプログラムと同じ、220Hz〜1760Hz を 1/256 Hz 単位でなめらかに変えたときのずれを測る関数
+static void bench_sweep(uint32_t clock_hz)
+{
+    tone_t tone;
+    cents_t sweep = {0};
+
+    sim_reset();
+    sim_set_sys_clock_hz(clock_hz);
+    tone_init(&tone, BENCH_BUZZER_PIN, false);
+    for (uint32_t raw = 0; raw < 4096; raw++)
+    {
+        uint32_t freq = TONE_HZ(220) + (TONE_HZ(1540) * raw >> 12);
+        tone_start(&tone, freq, TONE_VOLUME_MAX / 2);
+        cents_add(&sweep, pwm_output_hz(clock_hz, sim_get_pwm(pwm_gpio_to_slice_num(BENCH_BUZZER_PIN))),
+                  freq / (double)TONE_HZ(1));
+    }
+    printf("%7.1f  pot sweep 220-1760 Hz: max %.4f cents, avg %.4f cents, %lu PWM writes for %lu steps\n",
+           clock_hz / 1e6, sweep.max_cents, sweep.total_cents / sweep.count,
+           (unsigned long)sim_get_stats().pwm_writes, (unsigned long)sweep.count);
+}
+
+int main()
+{
+    static const uint32_t clocks_hz[] = {125000000, 133000000, 150000000, 200000000};
+
+    printf("equal-temperament pitch error in cents (new: clock-aware div/wrap, old: div %d, wrap = %d / Hz)\n",
+           BENCH_OLD_CLKDIV, BENCH_OLD_SCALE);
+    printf("clk_MHz  notes    new_max   new_avg  writes   old_max   old_avg  old_n\n");
+    for (uint i = 0; i < count_of(clocks_hz); i++)
+    {
+        bench_notes(clocks_hz[i], TONE_NOTE_LOW, TONE_NOTE_HIGH);
+    }
+    for (uint i = 0; i < count_of(clocks_hz); i++)
+    {
+        bench_out_of_range(clocks_hz[i]);
+    }
+    for (uint i = 0; i < count_of(clocks_hz); i++)
+    {
+        bench_sweep(clocks_hz[i]);
+    }
+    return 0;
+}
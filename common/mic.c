@@ -0,0 +1,171 @@
+#include <math.h> // Goertzel フィルタの係数を作るためにインクルード (初期化のときだけ使う)
+#include "pico/stdlib.h"
+#include "mic.h"
+#include "tone.h"
+
+/* 定義 (マクロ) */
+#define MIC_SEMITONE_Q16 3786    // 半音の周波数の比の自然対数 (ln2 / 12、1/65536 単位)
+
+// 係数 coeff (1/2^MIC_COEFF_BITS 単位) と s の積を返す関数
+// RP2350 の Cortex-M33 は 32×32→64 ビットの乗算 (SMULL) を 1 命令で行うので、64 ビットで掛けてから縮める
+static inline int32_t mic_mul_coeff(int32_t coeff, int32_t s)
+{
+    return (int32_t)(((int64_t)coeff * s) >> MIC_COEFF_BITS);
+}
+
+// 64 ビットの整数の平方根 (切り捨て) を返す関数
+static uint32_t mic_isqrt(uint64_t x)
+{
+    uint64_t root = 0;
+    for (uint64_t bit = 1ull << 62; bit != 0; bit >>= 2)
+    {
+        if (x >= root + bit)
+        {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+// マイクのパイプラインを準備する関数。capture の入力 input (マイク) のサンプルをストリームで受け取るようにする
+// capture は adc_capture_init() の後、adc_capture_start() の前に渡す
+void mic_init(mic_t *mic, adc_capture_t *capture, uint input)
+{
+    *mic = (mic_t){0};
+    mic->sample_rate_hz = capture->sample_rate_hz;
+    mic->decimation = MAX(mic->sample_rate_hz / MIC_ANALYSIS_HZ, 1u);
+    mic->block_us = (uint32_t)((uint64_t)ADC_CAPTURE_STREAM_SAMPLES * mic->decimation * 1000000 / mic->sample_rate_hz);
+    float analysis_rate_hz = (float)mic->sample_rate_hz / mic->decimation;
+    for (uint bin = 0; bin < MIC_BINS; bin++)
+    {
+        float omega = 2.0f * (float)M_PI * tone_note_freq(MIC_NOTE_LOW + bin) / TONE_HZ(1) / analysis_rate_hz;
+        mic->coeff[bin] = (int32_t)lroundf(2.0f * cosf(omega) * (1 << MIC_COEFF_BITS));
+    }
+    adc_capture_set_stream(capture, input, &mic->stream);
+}
+
+// 1 ブロック分のサンプル samples を調べ、結果を mic に書き込む関数
+static void mic_process(mic_t *mic, const uint16_t *samples)
+{
+    // 直流分 (平均) を求める
+    uint32_t sum = 0;
+    for (uint i = 0; i < ADC_CAPTURE_STREAM_SAMPLES; i++)
+    {
+        sum += samples[i];
+    }
+    int32_t mean = sum / ADC_CAPTURE_STREAM_SAMPLES;
+
+    // 大きさ (直流分を除いた RMS)。2 乗の和は 32 ビットを超えることがあるので 64 ビットで足す (足し算だけなので軽い)
+    uint64_t sum_sq = 0;
+    for (uint i = 0; i < ADC_CAPTURE_STREAM_SAMPLES; i++)
+    {
+        int32_t x = samples[i] - mean;
+        sum_sq += (uint32_t)(x * x);
+    }
+    mic->level = mic_isqrt(sum_sq / ADC_CAPTURE_STREAM_SAMPLES);
+
+    // 各音の Goertzel フィルタ: s[n] = x[n] + coeff × s[n-1] - s[n-2]、強さ = s1^2 + s2^2 - coeff × s1 × s2
+    // 状態 s は |x| × ブロックの長さ × 1/sin(2πf/fs) を超えないので、間引いた後の fs (MIC_ANALYSIS_HZ〜その 2 倍) では 32 ビットに収まる。
+    // 強さは 2 乗なので 64 ビットで求める (大きな音を聞くと 32 ビットを超える)
+    uint best = 0;
+    uint64_t total = 0;
+    for (uint bin = 0; bin < MIC_BINS; bin++)
+    {
+        int32_t coeff = mic->coeff[bin];
+        int32_t s1 = 0, s2 = 0;
+        for (uint i = 0; i < ADC_CAPTURE_STREAM_SAMPLES; i++)
+        {
+            int32_t s0 = (samples[i] - mean) + mic_mul_coeff(coeff, s1) - s2;
+            s2 = s1;
+            s1 = s0;
+        }
+        int64_t power = (int64_t)s1 * s1 + (int64_t)s2 * s2 - (((int64_t)coeff * s1) >> MIC_COEFF_BITS) * s2;
+        mic->power[bin] = MAX(power, 0);
+        total += mic->power[bin];
+        if (mic->power[bin] > mic->power[best])
+        {
+            best = bin;
+        }
+    }
+
+    // 十分大きく、一つの音が目立っていれば、両隣の強さから半音より細かい位置を放物線で補間する
+    mic->note = MIC_NOTE_LOW + best;
+    mic->pitched = mic->level >= MIC_LEVEL_MIN && mic->power[best] * MIC_BINS > total * MIC_TONAL_RATIO;
+    int32_t offset = 0; // 一番強い音からのずれ (半音の 1/256 単位、-128〜128)
+    if (best > 0 && best < MIC_BINS - 1)
+    {
+        int32_t left = mic_isqrt(mic->power[best - 1]);
+        int32_t center = mic_isqrt(mic->power[best]);
+        int32_t right = mic_isqrt(mic->power[best + 1]);
+        int32_t curvature = left - 2 * center + right;
+        if (curvature < 0)
+        {
+            offset = MIN(MAX(128 * (left - right) / curvature, -128), 128);
+        }
+    }
+    uint32_t freq = tone_note_freq(mic->note);
+    mic->freq = freq + (int32_t)(((int64_t)freq * offset * MIC_SEMITONE_Q16) >> 24); // 2^(ずれ/12) ≈ 1 + ずれ × ln2/12
+}
+
+// ストリームの 1 ブロック分のサンプル samples を decimation 個ずつ平均して間引き、mic->block にためる関数
+// 平均は簡単なローパスフィルタを兼ねるので、MIC_ANALYSIS_HZ の半分より高い音が低い音に化けにくくなる。
+// ブロックの長さが decimation で割り切れなくても、余りは次のブロックのサンプルと合わせて平均する (間隔がずれない)
+static void mic_decimate(mic_t *mic, const uint16_t *samples)
+{
+    for (uint i = 0; i < ADC_CAPTURE_STREAM_SAMPLES; i++)
+    {
+        mic->decimate_sum += samples[i];
+        if (++mic->decimate_count == mic->decimation)
+        {
+            mic->block[mic->block_fill++] = mic->decimate_sum / mic->decimation;
+            mic->decimate_sum = 0;
+            mic->decimate_count = 0;
+            if (mic->block_fill == ADC_CAPTURE_STREAM_SAMPLES)
+            {
+                return; // 残りはブロックを調べた後に捨てる (次のブロックの始まりが少し遅れるだけ)
+            }
+        }
+    }
+}
+
+// マイクのブロックがそろっていれば調べて true を返す関数 (そろっていなければ false を返す)
+// 間引くときは、ストリームのブロックを受け取るたびに間引いてため、ADC_CAPTURE_STREAM_SAMPLES 個たまったときだけ調べる。
+// ストリームの 1 ブロックの時間より長く呼ばないと、次のブロックが上書きされて捨てられる (mic_dropped() で数えられる)
+bool mic_poll(mic_t *mic)
+{
+    const uint16_t *samples = adc_capture_stream_take(&mic->stream);
+    if (samples == NULL)
+    {
+        return false;
+    }
+    uint32_t start = time_us_32();
+    if (mic->decimation > 1)
+    {
+        mic_decimate(mic, samples);
+        adc_capture_stream_release(&mic->stream);
+        if (mic->block_fill < ADC_CAPTURE_STREAM_SAMPLES)
+        {
+            mic->pending_us += time_us_32() - start;
+            return false;
+        }
+        mic->block_fill = 0;
+        mic_process(mic, mic->block);
+    }
+    else
+    {
+        mic_process(mic, samples);
+        adc_capture_stream_release(&mic->stream);
+    }
+
+    mic->busy_us = time_us_32() - start + mic->pending_us;
+    mic->pending_us = 0;
+    mic->load_permille = MIN((uint64_t)mic->busy_us * 1000 / mic->block_us, UINT16_MAX);
+    mic->max_load_permille = MAX(mic->max_load_permille, mic->load_permille);
+    mic->blocks++;
+    return true;
+}
@@ -0,0 +1,61 @@
+// マイクの音の高さと大きさを調べるパイプライン (ブザーのプログラムで使う)
+// adc_capture のストリームでマイクのサンプルを ADC_CAPTURE_STREAM_SAMPLES ずつ受け取り、ブロックごとに
+// 直流分を引いて大きさ (RMS) を求め、平均律の MIC_NOTE_LOW〜MIC_NOTE_HIGH の音に合わせた Goertzel フィルタの列で
+// 各音の強さを求める。一番強い音とその両隣から、音の高さを半音より細かく推定する (固定小数点の演算だけで行う)
+// ブロックの処理にかかった時間と、ブロックの長さに対する割合 (CPU 負荷) も記録する
+// 聞き分けられる周波数の細かさはおよそ サンプリング周波数 / ADC_CAPTURE_STREAM_SAMPLES なので、MIC_ANALYSIS_HZ の 2 倍以上で
+// 読んだサンプルは、数サンプルずつ平均して MIC_ANALYSIS_HZ 付近まで間引き、ADC_CAPTURE_STREAM_SAMPLES 個たまってから調べる
+// (48kHz で読んでも 8kHz と同じ細かさになる。結果が出るのはストリームの数ブロックに 1 回で、大きさも間引いた後のサンプルで求める)
+#ifndef MIC_H
+#define MIC_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "adc_capture.h"
+
+#define MIC_ANALYSIS_HZ 8000                            // 音の高さを調べるサンプリング周波数の目安 (これより速く読んだサンプルは間引く)
+#define MIC_NOTE_LOW 57                                 // 調べる一番低い音 (A3、220Hz) のノート番号 (これより低いと隣の音と分けられない)
+#define MIC_NOTE_HIGH 93                                // 調べる一番高い音 (A6、1760Hz) のノート番号
+#define MIC_BINS (MIC_NOTE_HIGH - MIC_NOTE_LOW + 1)     // Goertzel フィルタの数
+#define MIC_COEFF_BITS 14                               // Goertzel フィルタの係数の小数部のビット数
+#define MIC_LEVEL_MIN 8                                 // 音が鳴っているとみなす大きさ (RMS、12 ビットの LSB)
+#define MIC_TONAL_RATIO 12                               // 一番強い音が、全体の平均のこの倍より強ければ音の高さがあるとみなす
+
+// マイクのパイプラインの状態と結果
+typedef struct
+{
+    adc_capture_stream_t stream;   // マイクのサンプルを集めるストリーム
+    uint32_t sample_rate_hz;       // マイクのサンプリング周波数
+    uint32_t block_us;             // 1 ブロック (結果を 1 回出すまでに聞く時間) の長さ (us)
+    uint16_t decimation;           // 何サンプルずつ平均して間引くか (1 なら間引かない)
+    uint16_t block_fill;           // block にためた間引いたサンプルの数
+    uint16_t decimate_count;       // 平均している途中のサンプルの数
+    uint32_t decimate_sum;         // 平均している途中のサンプルの和
+    uint16_t block[ADC_CAPTURE_STREAM_SAMPLES]; // 間引いたサンプルを 1 ブロック分ためるバッファ (間引くときだけ使う)
+    uint32_t pending_us;           // ためている途中のブロックの間引きにかかった時間
+    int32_t coeff[MIC_BINS];       // 各音の Goertzel フィルタの係数 (2cos(2πf/fs)、1/2^MIC_COEFF_BITS 単位)
+    uint64_t power[MIC_BINS];      // 最後のブロックの各音の強さ
+
+    // 最後のブロックの結果
+    bool pitched;                  // 音の高さがあるか (十分大きく、一つの音が目立っているか)
+    uint8_t note;                  // 一番強い音のノート番号
+    uint32_t freq;                 // 推定した周波数 (1/256 Hz 単位。pitched のときだけ意味がある)
+    uint16_t level;                // 大きさ (直流分を除いた RMS、12 ビットの LSB)
+
+    // 処理の統計
+    uint32_t blocks;               // 処理したブロックの数 (結果を出した回数)
+    uint32_t busy_us;              // 最後のブロックの処理にかかった時間 (間引きを含む)
+    uint16_t load_permille;        // 最後のブロックの CPU 負荷 (処理時間 / ブロックの長さ、1/1000 単位)
+    uint16_t max_load_permille;    // CPU 負荷の最大
+} mic_t;
+
+void mic_init(mic_t *mic, adc_capture_t *capture, uint input);
+bool mic_poll(mic_t *mic);
+
+// 処理が間に合わずに捨てたブロックの数を返す関数
+static inline uint32_t mic_dropped(const mic_t *mic)
+{
+    return mic->stream.dropped;
+}
+
+#endif
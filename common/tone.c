@@ -0,0 +1,218 @@
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "tone.h"
+
+/* 定義 (マクロ) */
+#define TONE_DIV_MIN 16          // 分周比の最小 (1.0。1/16 単位)
+#define TONE_DIV_MAX 0xfff       // 分周比の最大 (255 + 15/16)
+#define TONE_PERIOD_MAX 0x10000  // 周期 (wrap + 1) の最大
+#define TONE_DIV_CANDIDATES 8    // 誤差の最も小さい組を探すときに試す分周比の数 (周期の大きい、音量の細かく決められる側から)
+#define TONE_TOP_OCTAVE 10       // note_freq_top の音のオクターブ (MIDI のノート番号 120〜131 は 10 オクターブ目)
+
+// 分周比と周期の組 (PWM のレジスタに書く値)
+typedef struct
+{
+    uint16_t div;  // 分周比 (整数部 << 4 | 小数部)
+    uint16_t wrap; // 周期 - 1
+} tone_divider_t;
+
+// 平均律の一番上のオクターブ (MIDI のノート番号 120〜131、C9〜B9) の周波数 (1/65536 Hz 単位)
+// 下のオクターブは 1 オクターブごとに半分にする (A4 = 440Hz)
+static const uint32_t note_freq_top[12] = {
+    548668578, 581294109, 615859655, 652480576, 691279090, 732384684,
+    775934544, 822074013, 870957077, 922746880, 977616265, 1035748353,
+};
+
+static uint32_t tone_clock_hz;                          // 表を作ったときのシステムクロック
+static tone_divider_t tone_notes[TONE_NOTE_COUNT];      // 各ノート番号 (TONE_NOTE_LOW から) の分周比と周期
+
+// ノート番号 note の平均律の周波数 (1/256 Hz 単位) を返す関数
+uint32_t tone_note_freq(uint note)
+{
+    int shift = (TONE_TOP_OCTAVE - note / 12) + (16 - TONE_FREQ_FRAC_BITS);
+    return (note_freq_top[note % 12] + (1u << (shift - 1))) >> shift; // 四捨五入して 1/256 Hz 単位にする
+}
+
+// 周波数 freq (1/256 Hz 単位) に最も近い音の出る分周比と周期の組を選ぶ関数 (整数演算だけで求める)
+// 出る周波数は clock_hz / (分周比 × 周期) なので、分周比 (1/16 単位) × 周期 を n = 16 × clock_hz / 周波数 に近づける。
+// 周期が大きいほど音量 (レベル) を細かく決められるので、周期が上限に収まる最小の分周比から TONE_DIV_CANDIDATES 個を試す
+static tone_divider_t tone_divider(uint32_t clock_hz, uint32_t freq)
+{
+    // n = 16 × clock_hz × 256 / freq を 32 ビットのまま求める (商と余りに分けて 8 ビットずつ割る)
+    uint32_t clock16 = clock_hz * 16; // 268MHz まで 32 ビットに収まる
+    uint32_t n_high = clock16 / freq;
+    uint32_t n_low = ((clock16 % freq) << TONE_FREQ_FRAC_BITS) / freq; // 余りは freq より小さいので、8 ビットずらしても 32 ビットに収まる
+    uint32_t n = n_high >> (32 - TONE_FREQ_FRAC_BITS) != 0
+                     ? UINT32_MAX // 低すぎる (分周比を最大にしても届かない)
+                     : (n_high << TONE_FREQ_FRAC_BITS) | n_low;
+
+    uint32_t div = MAX((n + TONE_PERIOD_MAX - 1) / TONE_PERIOD_MAX, TONE_DIV_MIN);
+    tone_divider_t best = {TONE_DIV_MAX, TONE_PERIOD_MAX - 1};
+    uint32_t best_error = UINT32_MAX;
+    for (int i = 0; i < TONE_DIV_CANDIDATES && div <= TONE_DIV_MAX; i++, div++)
+    {
+        uint32_t period = MIN(MAX((n + div / 2) / div, 1u), TONE_PERIOD_MAX); // 四捨五入した周期
+        uint32_t product = div * period;
+        uint32_t error = product > n ? product - n : n - product;
+        if (error < best_error)
+        {
+            best = (tone_divider_t){div, period - 1};
+            best_error = error;
+        }
+    }
+    return best;
+}
+
+// 分周比、周期、レベルを PWM に設定する関数 (いまの値と違うものだけ書き換える)
+static void tone_write(tone_t *tone, uint32_t div, uint16_t wrap, uint16_t level)
+{
+    if (tone->div != div)
+    {
+        pwm_set_clkdiv_int_frac(tone->slice, div >> 4, div & 0xf);
+        tone->div = div;
+        tone->writes++;
+    }
+    if (tone->wrap != wrap)
+    {
+        pwm_set_wrap(tone->slice, wrap);
+        tone->wrap = wrap;
+        tone->writes++;
+    }
+    if (tone->level != level)
+    {
+        pwm_set_chan_level(tone->slice, tone->channel, level);
+        tone->level = level;
+        tone->writes++;
+    }
+}
+
+// いまの周波数と音量 (止めていれば無音) を PWM に反映する関数
+static void tone_apply(tone_t *tone)
+{
+    if (!tone->playing)
+    {
+        uint16_t level = !tone->idle_high ? 0 : tone->wrap < 0xffff ? tone->wrap + 1 : 0xffff; // 周期より大きいレベルなら常に High、0 なら常に Low
+        tone_write(tone, tone->div, tone->wrap, level);
+        return;
+    }
+    uint16_t level = ((uint32_t)tone->next_wrap + 1) * tone->volume / TONE_VOLUME_MAX; // 音量はデューティ比 (周期に対するレベルの比率)
+    tone_write(tone, tone->next_div, tone->next_wrap, level);
+}
+
+// gpio につないだブザーを PWM で鳴らせるようにする関数 (最初は鳴らさない)
+// idle_high が true なら、止めているときに出力を High に保つ。
+// 最初に呼んだとき (とシステムクロックが変わっていたとき) に、いまのシステムクロックで平均律の表を作る
+void tone_init(tone_t *tone, uint gpio, bool idle_high)
+{
+    uint32_t clock_hz = clock_get_hz(clk_sys);
+    if (tone_clock_hz != clock_hz)
+    {
+        for (uint note = TONE_NOTE_LOW; note <= TONE_NOTE_HIGH; note++)
+        {
+            tone_notes[note - TONE_NOTE_LOW] = tone_divider(clock_hz, tone_note_freq(note));
+        }
+        tone_clock_hz = clock_hz;
+    }
+
+    *tone = (tone_t){0};
+    tone->slice = pwm_gpio_to_slice_num(gpio);
+    tone->channel = pwm_gpio_to_channel(gpio);
+    tone->idle_high = idle_high;
+
+    gpio_set_function(gpio, GPIO_FUNC_PWM);
+    pwm_config config = pwm_get_default_config();
+    pwm_init(tone->slice, &config, true);
+    tone->div = 1 << 4; // pwm_get_default_config() の設定 (分周なし、周期 0xffff、レベル 0)
+    tone->wrap = 0xffff;
+    tone->level = 0;
+    tone_apply(tone);
+}
+
+// 周波数 freq (1/256 Hz 単位。TONE_HZ() で Hz から直せる)、音量 volume (0〜TONE_VOLUME_MAX) で鳴らし始める関数 (鳴っていれば音を変える)
+void tone_start(tone_t *tone, uint32_t freq, uint16_t volume)
+{
+    if (tone->playing && tone->freq == freq && tone->volume == volume)
+    {
+        return; // 同じ音を鳴らし続けている
+    }
+    tone->volume = volume;
+    tone->playing = true;
+    tone_set_freq(tone, freq);
+    tone_apply(tone);
+}
+
+// ノート番号 note の平均律の音を、音量 volume で鳴らし始める関数 (分周比と周期は表から引く)
+// note が TONE_NOTE_LOW〜TONE_NOTE_HIGH の外なら、何も変えずに false を返す
+bool tone_start_note(tone_t *tone, uint note, uint16_t volume)
+{
+    if (note < TONE_NOTE_LOW || note > TONE_NOTE_HIGH)
+    {
+        return false;
+    }
+    tone->volume = volume;
+    tone->playing = true;
+    tone_set_note(tone, note);
+    tone_apply(tone);
+    return true;
+}
+
+// 音を止める関数
+void tone_stop(tone_t *tone)
+{
+    if (!tone->playing)
+    {
+        return;
+    }
+    tone->playing = false;
+    tone_apply(tone);
+}
+
+// 周波数 freq (1/256 Hz 単位) に変える関数 (止めていれば、次に鳴らすときの周波数になる)
+void tone_set_freq(tone_t *tone, uint32_t freq)
+{
+    if (tone->freq == freq || freq == 0)
+    {
+        return;
+    }
+    tone_divider_t divider = tone_divider(tone_clock_hz, freq);
+    tone->freq = freq;
+    tone->next_div = divider.div;
+    tone->next_wrap = divider.wrap;
+    if (tone->playing)
+    {
+        tone_apply(tone);
+    }
+}
+
+// ノート番号 note の平均律の音に変える関数 (止めていれば、次に鳴らすときの音になる)
+// note が TONE_NOTE_LOW〜TONE_NOTE_HIGH の外なら、何も変えずに false を返す (表の端の音に丸めると、違う高さで鳴ってしまう)
+bool tone_set_note(tone_t *tone, uint note)
+{
+    if (note < TONE_NOTE_LOW || note > TONE_NOTE_HIGH)
+    {
+        return false;
+    }
+    tone->freq = tone_note_freq(note);
+    tone->next_div = tone_notes[note - TONE_NOTE_LOW].div;
+    tone->next_wrap = tone_notes[note - TONE_NOTE_LOW].wrap;
+    if (tone->playing)
+    {
+        tone_apply(tone);
+    }
+    return true;
+}
+
+// 音量を変える関数 (止めていれば、次に鳴らすときの音量になる)
+void tone_set_volume(tone_t *tone, uint16_t volume)
+{
+    if (tone->volume == volume)
+    {
+        return;
+    }
+    tone->volume = volume;
+    if (tone->playing)
+    {
+        tone_apply(tone);
+    }
+}
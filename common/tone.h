@@ -0,0 +1,50 @@
+// ブザーの音を PWM で鳴らすトーンエンジン (ブザーのプログラムで共通に使う)
+// いま PWM に設定している分周比、周期 (wrap)、レベルを覚えておき、値が変わったレジスタだけを書き換える。
+// 同じ音を鳴らし続けるあいだはハードウェアに触らないので、メインループから何度呼んでもよい
+// 分周比 (整数部 + 1/16 単位の小数部) と周期は、実際のシステムクロック (clock_get_hz(clk_sys)) から
+// 目的の周波数に最も近い組を整数演算で選ぶ。平均律のピアノの 88 鍵 (MIDI のノート番号 21〜108) の組は tone_init で表にしておく
+// (これより低い音は 150MHz 以上で分周比と周期が足りず、高い音は周期が短すぎて、数セント以内に合わせられない)
+#ifndef TONE_H
+#define TONE_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+#define TONE_VOLUME_MAX 256                                        // 音量の最大 (デューティ比 100%)。音量はデューティ比を 1/256 単位で表す
+#define TONE_FREQ_FRAC_BITS 8                                      // 周波数の小数部のビット数 (周波数は 1/256 Hz 単位の固定小数点)
+#define TONE_HZ(hz) ((uint32_t)(hz) << TONE_FREQ_FRAC_BITS)        // 整数の Hz を周波数の固定小数点に直す
+#define TONE_NOTE_LOW 21                                           // 鳴らせる一番低い音 (A0、27.5Hz) のノート番号
+#define TONE_NOTE_HIGH 108                                         // 鳴らせる一番高い音 (C8、約 4186Hz) のノート番号
+#define TONE_NOTE_COUNT (TONE_NOTE_HIGH - TONE_NOTE_LOW + 1)       // 表にしておく音の数
+#define TONE_NOTE_A3 57                                            // ラの音 (A3、220Hz) のノート番号
+#define TONE_NOTE_A4 69                                            // ラの音 (A4、440Hz) のノート番号
+
+// ブザー 1 つ分の状態
+typedef struct
+{
+    uint slice;         // PWM スライス番号
+    uint channel;       // PWM チャネル (PWM_CHAN_A / PWM_CHAN_B)
+    bool idle_high;     // 止めているときに出力を High に保つか (High で鳴らないブザー)
+    bool playing;       // 鳴らしているか
+    uint32_t freq;      // 鳴らす周波数 (1/256 Hz 単位)
+    uint16_t volume;    // 鳴らす音量 (0〜TONE_VOLUME_MAX)
+    uint16_t next_div;  // 鳴らす周波数の分周比 (整数部 << 4 | 小数部)
+    uint16_t next_wrap; // 鳴らす周波数の周期
+
+    // PWM に設定してある値 (この値と違うときだけレジスタを書き換える)
+    uint32_t div;       // 分周比 (整数部 << 4 | 小数部)
+    uint16_t wrap;      // 周期 (カウンタの最大値)
+    uint16_t level;     // レベル (カウンタがこの値より小さいあいだ High)
+    uint32_t writes;    // レジスタを書き換えた回数
+} tone_t;
+
+void tone_init(tone_t *tone, uint gpio, bool idle_high);
+void tone_start(tone_t *tone, uint32_t freq, uint16_t volume);
+bool tone_start_note(tone_t *tone, uint note, uint16_t volume);
+void tone_stop(tone_t *tone);
+void tone_set_freq(tone_t *tone, uint32_t freq);
+bool tone_set_note(tone_t *tone, uint note);
+void tone_set_volume(tone_t *tone, uint16_t volume);
+uint32_t tone_note_freq(uint note);
+
+#endif
@@ -2,13 +2,23 @@
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
 #include "hardware/timer.h"
-#include "hardware/adc.h"
-
-// 読み取るADチャネルを定義
+#include "hardware/sync.h"
+#include "debounce.h"
+#include "adc_capture.h"
+#include "curve.h"
+#include "mic.h"
+#include "tone.h"
+
+// ADチャネルの定義
 // 0: GP26 (ADC0) 照度センサ
 // 1: GP27 (ADC1) ボリューム
 // 2: GP28 (ADC2) マイク
-#define ADC_CHANNEL 1
+#define ADC_LIGHT 0
+#define ADC_POT 1
+#define ADC_MIC 2
+
+// ADCのラウンドロビンで、各チャネルを読む周波数 (Hz)
+#define ADC_SAMPLE_RATE_HZ 8000
 
 // GPIOピンの定義
 #define BUTTON_PIN 3  // ボタンが接続されているGPIOピン番号
@@ -17,60 +27,54 @@
 // タイマー割り込みの周期 (ms)
 #define TIMER_INTERVAL_MS 10
 
-// ボタンの状態を格納するグローバル変数（volatileキーワードで最適化を防ぐ）
-volatile bool button_pressed = false;
+// エッジ割り込みでボタンを読むときに、確定してからチャタリングを無視する時間 (us)
+#define BUTTON_LOCKOUT_US 20000
+
+// チャタリング除去 (押されている状態がこの回数続いたら確定する)
+#define DEBOUNCE_SAMPLES 3
+
+// 押しているあいだにボリュームを読み直す周期 (ms)
+#define SENSOR_INTERVAL_MS 10
+
+// ボタンのチャタリング除去の状態（タイマー割り込みで更新される）
+debounce_t buttons;
 
 // BUZZERのデューティサイクルの定義
-#define BUZZER_ON 0.7 // ブザーONのデューティサイクル（30%）
-#define BUZZER_OFF 0  // ブザーOFFのデューティサイクル（0%）
+#define BUZZER_VOLUME (TONE_VOLUME_MAX * 7 / 10) // ブザーONのデューティサイクル（70%）
 
-// 引数: slice_num - PWMスライス番号(PWM機能を構成する独立した信号生成ユニット)
-void play_note_a(uint slice_num,float tone)
-{
-    float freq = tone;
-    // pwm_set_clkdiv()はPWMのクロック分周比を設定する関数
-    // 125.0fはPWMのクロック分周比（125MHz / 125 = 1MHz）を指定している
-    // つまり、PWMのクロックは1MHzになり
-    // 例えば、1MHzのクロックで、周期を1000に設定すると、1kHzの音が鳴る
-    pwm_set_clkdiv(slice_num, 125.0f);
-
-    // PWMの周期を設定
-    // pwm_set_wrap()はPWMの周期を設定する関数
-    pwm_set_wrap(slice_num, 125000 / freq);
-
-    // pwm_set_chan_level()はPWMのデューティサイクルを設定する関数
-    // 125000 / freqはPWMの周期に対するデューティサイクルの比率を計算している
-    // 例えば、周波数が220Hzの場合、125000 / 220 = 568.18...となる
-    // これをデューティサイクルの比率として使用することで、音の大きさを調整できる
-    // 0.3はデューティサイクルの比率（30%）を指定している
-    pwm_set_chan_level(slice_num, PWM_CHAN_A, (125000 / freq) * BUZZER_ON);
-}
-
-static int count = 0;
-// タイマー割り込み関数
-bool timer_callback(struct repeating_timer *rt)
-{
-    // ボタンの状態を読み取る（プルアップなので、押されていないときはHIGH、押されているときはLOW）
-    if (gpio_get(BUTTON_PIN) == 0){
-        if(count < 3){
-            count++;
-        }
+// ブザーの状態 (鳴らしている音と、PWMに設定してある値)
+tone_t buzzer;
 
-        if(count >=3){
-            button_pressed = true;
-        }else{
-            button_pressed = false;
-        }
-        // ボタンが押されたときの処理
-    }
-    else
-    {
-        // ボタンが離されたときの処理
-        button_pressed = false;
-        count = 0;
-    }
-    return true; // 継続してタイマーを動作させる
-}
+// ADCのラウンドロビンの状態 (DMAで読み続け、チャネルごとにならした最新の値を持つ)
+adc_capture_t sensors;
+
+// ボリュームの位置 (AD値 0〜4095) から鳴らす周波数 (1/256 Hz単位) への折れ線の折れ点
+// 折れ点のあいだは直線でつなぐ。音の変わり方を変えたいときは、折れ点を足すだけでよい
+const curve_point_t pot_freq[] = {
+    {0, TONE_HZ(220)},
+    {4096, TONE_HZ(1760)}
+};
+
+// ボリュームの値がこの幅 (AD値) までしか変わらないときは、周波数を変えない (音がふらつかないように)
+#define POT_HYSTERESIS 2
+
+curve_t pot_curve;          // pot_freqから作った変換表
+curve_follower_t pot_state; // 最後に周波数を変えたときのAD値と周波数
+
+#ifdef MIC_PITCH_ANSWER
+// マイクのパイプラインの状態 (マイクの音の高さと大きさ、処理の負荷)
+mic_t mic;
+
+// 聞こえた音に答えてブザーを鳴らしておく時間 (ms)
+// マイクはブザーの音も拾うので、鳴らしている間は聞かず、止めてから次の音を聞く
+#define MIC_ANSWER_MS 500
+
+// マイクの統計をUSBシリアルに表示する間隔 (ブロック数。1ブロックは64ms)
+#define MIC_REPORT_BLOCKS 16
+
+uint64_t answer_until_us; // ブザーで答えるのをやめる時刻 (0なら答えていない)
+uint64_t listen_from_us;  // マイクの結果を使い始める時刻 (ブザーの音が入ったブロックを読み飛ばす)
+#endif
 
 int main()
 {
@@ -78,89 +82,104 @@ int main()
 
     stdio_init_all();
 
-    adc_init(); // ADCの初期化
-
-      // ADCを使用するGPIOピンの設定
-    // PicoのGPIOは、様々な機能に使用できる。
-    // ここでは、GP26, GP27, GP28をアナログ入力として設定する。
-    //  - gpio_set_function(ピン番号, 機能): ピンの機能を設定する。
-    //  - gpio_set_dir(ピン番号, 方向): ピンの方向を設定する (入力または出力)。
-    gpio_set_function(26, GPIO_FUNC_SIO); // GP26をSIO (標準入出力) 機能に設定
-    gpio_set_dir(26, GPIO_IN);            // GP26を入力に設定
-    gpio_set_function(27, GPIO_FUNC_SIO); // GP27をSIO機能に設定
-    gpio_set_dir(27, GPIO_IN);            // GP27を入力に設定
-    gpio_set_function(28, GPIO_FUNC_SIO); // GP28をSIO機能に設定
-    gpio_set_dir(28, GPIO_IN);            // GP28を入力に設定
-
-    // 選択されたADチャネルを設定
-    // ADCには複数の入力チャネルがあり、どれを読み取るかを指定する必要がある。
-    if (ADC_CHANNEL == 0)
-    {
-        adc_select_input(0); // ADC0 (GP26) を選択
-    }
-    else if (ADC_CHANNEL == 1)
-    {
-        adc_select_input(1); // ADC1 (GP27) を選択
-    }
-    else if (ADC_CHANNEL == 2)
-    {
-        adc_select_input(2); // ADC2 (GP28) を選択
-    }
-    else
-    {
-        // 定義されていないADC_CHANNELが指定された場合は、エラーとしてプログラムを終了する。
-        return 1;
-    }
+    // ADC (アナログ-デジタル変換器) の初期化
+    // adc_capture_init()は、ADC0〜ADC2のピン (GP26, GP27, GP28) をアナログ入力にして、
+    // ラウンドロビン (チャネルを順番に切り替えながら連続で変換する) とDMAで読み続ける準備をする関数
+    // 変換結果はDMAがメモリに書き込むので、CPUはADCの変換を待たなくてよい
+    //  - 第2引数: 読むチャネル (ビットnがADCn)
+    //  - 第3引数: 各チャネルを読む周波数
+    adc_capture_init(&sensors, (1u << ADC_LIGHT) | (1u << ADC_POT) | (1u << ADC_MIC), ADC_SAMPLE_RATE_HZ);
+    // 64サンプルずつ平均して (8msごと)、さらにボリュームは新しい値を1/2ずつ、照度センサは1/4ずつ混ぜてならす (ノイズで音がふらつかないように)
+    adc_capture_set_filter(&sensors, ADC_POT, 0, 1);
+    adc_capture_set_filter(&sensors, ADC_LIGHT, 0, 2);
+#ifdef MIC_PITCH_ANSWER
+    // マイクのサンプルは512個 (64ms) ずつ集めて、メインループで音の高さと大きさを調べる
+    mic_init(&mic, &sensors, ADC_MIC);
+#endif
+    adc_capture_start(&sensors);
+
+    // ボリュームの位置から周波数への変換表を作る (折れ点のあいだを補間する表を、ここで一度だけ作っておく)
+    curve_init(&pot_curve, pot_freq, count_of(pot_freq), POT_HYSTERESIS);
 
     // ボタン用GPIOの初期化
-    // gpio_init()はGPIOの初期化を行う関数
-    // gpio_set_dir()はGPIOの入出力方向を設定する関数
-    // gpio_pull_up()はGPIOのプルアップ抵抗を有効にする関数
+    // debounce_init_buttons()はボタンのピンをまとめて入力にし、プルアップ抵抗を有効にする関数
     // プルアップ抵抗とは、ボタンが押されていないときにGPIOピンをHIGHに保つための抵抗
-    gpio_init(BUTTON_PIN);
-    gpio_set_dir(BUTTON_PIN, GPIO_IN);
-    gpio_pull_up(BUTTON_PIN);
+    // 押されているとき (LOW) がDEBOUNCE_SAMPLES回続いたら押された、HIGHが続いたら離されたと確定する
+    debounce_init_buttons(&buttons, 1u << BUTTON_PIN, DEBOUNCE_SAMPLES);
 
     // ブザー用GPIOの初期化
-    // gpio_set_function()はGPIOの機能を設定する関数
-    // pwm_gpio_to_slice_num()はGPIOピン番号からPWMスライス番号を取得する関数
-    // PWMスライス番号はPWM機能を構成する独立した信号生成ユニット
-    // 例えば、GPIO12はPWM0のスライス番号0に対応している
-    gpio_set_function(BUZZER_PIN, GPIO_FUNC_PWM);
-    uint slice_num = pwm_gpio_to_slice_num(BUZZER_PIN);
-
-    // PWMの設定
-    // pwm_get_default_config()はPWMのデフォルト設定を取得する関数
-    // pwm_init()はPWMを初期化する関数
-    // pwm_set_chan_level()はPWMのデューティサイクルを設定する関数
-    pwm_config config = pwm_get_default_config();
-    pwm_init(slice_num, &config, true);
-    pwm_set_chan_level(slice_num, PWM_CHAN_A, BUZZER_OFF); // 最初は音を鳴らさない
-
-    // タイマーの設定
+    // tone_init()はブザーのピンをPWMに設定し、最初は音を鳴らさない状態にする関数
+    // 以降はtone_start()/tone_stop()で鳴らしたり止めたりする (値が変わったときだけPWMのレジスタを書き換える)
+    tone_init(&buzzer, BUZZER_PIN, false);
+
+#ifdef BUTTON_EDGE_DEBOUNCE
+    // ボタンの最初のエッジの割り込みで、すぐに押された (離された) と確定する
+    // その後BUTTON_LOCKOUT_USの間はハードウェアアラームが鳴るまでそのピンの割り込みを止めて、チャタリングを読み飛ばす
+    debounce_start_edge(&buttons, BUTTON_LOCKOUT_US);
+#else
+    // タイマーの設定 (TIMER_INTERVAL_MSごとにボタンを読む)
     struct repeating_timer timer; // タイマー構造体を宣言
     // 繰り返しタイマーを設定する関数
     // - 第1引数: 繰り返し間隔 (マイクロ秒)。負の値は、最初の実行も遅延させる
     // - 第2引数: コールバック関数 (タイマー割り込み時に実行される関数)
-    // - 第3引数: コールバック関数に渡すユーザーデータ (ここではNULL)
+    // - 第3引数: コールバック関数に渡すユーザーデータ (ここではボタンのチャタリング除去の状態)
     // - 第4引数: 設定するタイマー構造体へのポインタ
-    add_repeating_timer_ms(TIMER_INTERVAL_MS, timer_callback, NULL, &timer);
+    add_repeating_timer_ms(TIMER_INTERVAL_MS, debounce_timer_callback, &buttons, &timer);
+#endif
 
     // メインループ
+    // 押しているあいだはSENSOR_INTERVAL_MSごとにボリュームを読み直し、離しているあいだはボタンが押されるまで眠る
     while (true)
     {
+#ifdef MIC_PITCH_ANSWER
+        // マイクのブロックが埋まっていれば、音の高さと大きさを調べる (埋まると__sev()で起こされる)
+        // ブザーが鳴っている間と、止めてからブザーの音が入ったブロックが出ていくまで (2ブロック分) の結果は使わない
+        bool polled = mic_poll(&mic);
+        bool heard = polled && answer_until_us == 0 && time_us_64() >= listen_from_us;
+        if (polled && mic.blocks % MIC_REPORT_BLOCKS == 0)
+        {
+            // 1ブロックの処理がブロックの長さに対してどれだけかかったか (CPU負荷) と、間に合わずに捨てたブロックの数
+            printf("mic: level %u, note %u%s, load %u.%u%% (max %u.%u%%), dropped %lu\n",
+                   mic.level, mic.note, mic.pitched ? "" : " (no pitch)",
+                   mic.load_permille / 10, mic.load_permille % 10, mic.max_load_permille / 10, mic.max_load_permille % 10,
+                   (unsigned long)mic_dropped(&mic));
+        }
+#endif
+
         // ボタンが押されていたら音を鳴らす
-        if (button_pressed)
+        if (debounce_is_down(&buttons, BUTTON_PIN))
         {
-            adc_select_input(1);
-            uint16_t raw = adc_read();
-            float adjust = raw / 4096.0; //0~1の値をいれる
-            float freq = 220 + (1540 * adjust); 
-            play_note_a(slice_num,freq);
+#ifdef MIC_PITCH_ANSWER
+            // 聞こえた音に一番近い平均律の音でMIC_ANSWER_MSだけ答え、止めてからまた聞く (ボリュームは使わない)
+            if (answer_until_us != 0 && time_us_64() >= answer_until_us)
+            {
+                tone_stop(&buzzer);
+                answer_until_us = 0;
+                listen_from_us = time_us_64() + 2 * mic.block_us;
+            }
+            else if (heard && mic.pitched)
+            {
+                tone_start_note(&buzzer, mic.note, BUZZER_VOLUME);
+                answer_until_us = time_us_64() + MIC_ANSWER_MS * 1000;
+            }
+#else
+            uint16_t raw = adc_capture_read12(&sensors, ADC_POT); // ならしたボリュームの最新の値 (メモリを読むだけ)
+            uint32_t freq = curve_follow(&pot_curve, &pot_state, raw); // ボリュームの位置 (0〜4095) に合わせて220Hz〜1760Hz (1/256 Hz 単位)
+            tone_start(&buzzer, freq, BUZZER_VOLUME); // 周波数が変わったときだけPWMを書き換える
+#endif
+            best_effort_wfe_or_timeout(make_timeout_time_ms(SENSOR_INTERVAL_MS)); // 次に読むまで眠る (離されたらすぐ起きる)
         }
         else
         {
-            pwm_set_chan_level(slice_num, PWM_CHAN_A, BUZZER_OFF); // ブザーをOFF
+            tone_stop(&buzzer); // ブザーをOFF
+#ifdef MIC_PITCH_ANSWER
+            if (answer_until_us != 0)
+            {
+                answer_until_us = 0; // 答えている途中で離されたら、ブザーの音が入ったブロックを読み飛ばしてから聞き直す
+                listen_from_us = time_us_64() + 2 * mic.block_us;
+            }
+#endif
+            __wfe();            // ボタンの状態が変わる (__sev()が出る) まで眠る
         }
     }
 